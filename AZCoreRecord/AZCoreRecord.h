@@ -7,6 +7,16 @@
 //
 
 #import "AZCoreRecordManager.h"
+#import "AZCoreRecordChangeJournal.h"
+#import "AZCoreRecordDeduplicator.h"
+#import "AZCoreRecordDeviceRegistry.h"
+#import "AZCoreRecordDownloadTracker.h"
+#import "AZCoreRecordLiveQuery.h"
+#import "AZCoreRecordMaintenanceScheduler.h"
+#import "AZCoreRecordMigrator.h"
+#import "AZCoreRecordSQLiteOptions.h"
+#import "AZCoreRecordSectionDiff.h"
+#import "AZCoreRecordStoreShard.h"
 #import "AZCoreRecordUbiquitySentinel.h"
 #import "NSManagedObject+AZCoreRecord.h"
 #import "NSManagedObject+AZCoreRecordImport.h"
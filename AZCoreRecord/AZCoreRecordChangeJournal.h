@@ -0,0 +1,58 @@
+//
+//  AZCoreRecordChangeJournal.h
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import <CoreData/CoreData.h>
+
+extern NSString *const AZCoreRecordManagerDidReplayFallbackChangesNotification;
+extern NSString *const AZCoreRecordReplayedChangeCountKey;
+
+/** A compact record of the changes saved to one store, so they can be
+ replayed somewhere else later.
+
+ AZCoreRecordManager keeps one for the fallback store while ubiquity is
+ wanted but unavailable. Once the ubiquitous store comes online, only the
+ journaled objects are copied over instead of re-seeding the whole store.
+
+ Changes are coalesced per object: an insert followed by updates stays an
+ insert, and an insert followed by a delete disappears. Updates and
+ deletes are matched to the destination through the entity's
+ `primaryAttribute` (see NSManagedObject+AZCoreRecordImport); without one,
+ only inserts can be replayed. The journal is a small property list saved
+ next to the store after every save.
+ */
+@interface AZCoreRecordChangeJournal : NSObject
+{
+@private
+	NSURL *_URL;
+	dispatch_queue_t _queue;
+	NSMutableDictionary *_entries;
+	NSMutableDictionary *_committedPrimaryValues;
+	__weak NSPersistentStore *_store;
+}
+
+- (id) initWithURL: (NSURL *) URL;
+
+@property (nonatomic, copy, readonly) NSURL *URL;
+@property (nonatomic, readonly) NSUInteger changeCount;
+
+- (void) startRecordingChangesToStore: (NSPersistentStore *) store;
+- (void) stopRecording;
+
+/** Copies the journaled objects from the store file at `sourceURL` into
+ `store`, `pageSize` objects per save. Call it off the main thread. Returns
+ the number of changes applied, or NSNotFound on failure.
+
+ Each saved page is taken out of the journal, or marked as copied until its
+ relationships are done, so replaying again after a failure picks up where
+ the last attempt stopped. */
+- (NSUInteger) replayChangesFromStoreAtURL: (NSURL *) sourceURL intoStore: (NSPersistentStore *) store pageSize: (NSUInteger) pageSize error: (NSError **) error;
+
+/** Forgets every change and deletes the journal file. */
+- (void) discard;
+
+@end
@@ -0,0 +1,513 @@
+//
+//  AZCoreRecordChangeJournal.m
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordChangeJournal.h"
+#import "AZCoreRecordManager.h"
+#import "NSManagedObject+AZCoreRecordImport.h"
+
+NSString *const AZCoreRecordManagerDidReplayFallbackChangesNotification = @"AZCoreRecordManagerDidReplayFallbackChangesNotification";
+NSString *const AZCoreRecordReplayedChangeCountKey = @"AZCoreRecordReplayedChangeCount";
+
+static NSString *const azcr_journalOperationKey = @"op";
+static NSString *const azcr_journalEntityKey = @"entity";
+static NSString *const azcr_journalPrimaryValueKey = @"primary";
+static NSString *const azcr_journalTargetKey = @"target";
+
+enum {
+	AZCoreRecordJournalInsert = 0,
+	AZCoreRecordJournalUpdate,
+	AZCoreRecordJournalDelete
+};
+typedef NSUInteger AZCoreRecordJournalOperation;
+
+static NSString *azcr_primaryAttributeName(NSEntityDescription *entity)
+{
+	NSString *name = [entity.userInfo objectForKey: AZCoreRecordImportPrimaryAttributeKey];
+	return (name && [entity.attributesByName objectForKey: name]) ? name : nil;
+}
+
+static NSArray *azcr_persistentAttributeNames(NSEntityDescription *entity)
+{
+	return [[entity.attributesByName keysOfEntriesPassingTest: ^BOOL(id key, NSAttributeDescription *attribute, BOOL *stop) {
+		return !attribute.isTransient;
+	}] allObjects];
+}
+
+static BOOL azcr_isPropertyListValue(id value)
+{
+	return [value isKindOfClass: [NSString class]] || [value isKindOfClass: [NSNumber class]] || [value isKindOfClass: [NSDate class]] || [value isKindOfClass: [NSData class]];
+}
+
+@interface AZCoreRecordChangeJournal ()
+
+- (void) azcr_contextWillSave: (NSNotification *) note;
+- (void) azcr_contextDidSave: (NSNotification *) note;
+
+@end
+
+@implementation AZCoreRecordChangeJournal
+
+@synthesize URL = _URL;
+
+- (id) initWithURL: (NSURL *) URL
+{
+	NSParameterAssert(URL);
+	
+	if ((self = [super init]))
+	{
+		_URL = [URL copy];
+		_queue = dispatch_queue_create("com.AZCoreRecord.changeJournal", DISPATCH_QUEUE_SERIAL);
+		_committedPrimaryValues = [NSMutableDictionary dictionary];
+		
+		NSData *data = [NSData dataWithContentsOfURL: URL];
+		id entries = data ? [NSPropertyListSerialization propertyListWithData: data options: NSPropertyListMutableContainers format: NULL error: NULL] : nil;
+		_entries = [entries isKindOfClass: [NSMutableDictionary class]] ? entries : [NSMutableDictionary dictionary];
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver: self];
+	dispatch_release(_queue);
+}
+
+- (NSUInteger) changeCount
+{
+	__block NSUInteger count = 0;
+	dispatch_sync(_queue, ^{
+		count = _entries.count;
+	});
+	return count;
+}
+
+#pragma mark - Recording
+
+- (void) startRecordingChangesToStore: (NSPersistentStore *) store
+{
+	NSParameterAssert(store);
+	
+	[self stopRecording];
+	
+	dispatch_sync(_queue, ^{
+		_store = store;
+	});
+	
+	NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+	[nc addObserver: self selector: @selector(azcr_contextWillSave:) name: NSManagedObjectContextWillSaveNotification object: nil];
+	[nc addObserver: self selector: @selector(azcr_contextDidSave:) name: NSManagedObjectContextDidSaveNotification object: nil];
+}
+
+- (void) stopRecording
+{
+	NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+	[nc removeObserver: self name: NSManagedObjectContextWillSaveNotification object: nil];
+	[nc removeObserver: self name: NSManagedObjectContextDidSaveNotification object: nil];
+	
+	dispatch_sync(_queue, ^{
+		_store = nil;
+		[_committedPrimaryValues removeAllObjects];
+	});
+}
+
+- (NSPersistentStore *) azcr_recordedStoreForContext: (NSManagedObjectContext *) context
+{
+	__block NSPersistentStore *store = nil;
+	dispatch_sync(_queue, ^{
+		store = _store;
+	});
+	
+	if (!store || context.parentContext || context.persistentStoreCoordinator != store.persistentStoreCoordinator)
+		return nil;
+	
+	return store;
+}
+
+- (void) azcr_contextWillSave: (NSNotification *) note
+{
+	NSManagedObjectContext *context = note.object;
+	NSPersistentStore *store = [self azcr_recordedStoreForContext: context];
+	if (!store)
+		return;
+	
+	// Updates and deletes are matched by the primary value the other store
+	// still has, which is the committed one rather than the one being saved.
+	NSMutableSet *objects = [NSMutableSet setWithSet: context.updatedObjects];
+	[objects unionSet: context.deletedObjects];
+	
+	NSMutableDictionary *values = [NSMutableDictionary dictionary];
+	for (NSManagedObject *object in objects)
+	{
+		NSManagedObjectID *objectID = object.objectID;
+		NSString *primaryKey = azcr_primaryAttributeName(object.entity);
+		if (!primaryKey || objectID.isTemporaryID || objectID.persistentStore != store)
+			continue;
+		
+		id value = [[object committedValuesForKeys: [NSArray arrayWithObject: primaryKey]] objectForKey: primaryKey];
+		if (azcr_isPropertyListValue(value))
+			[values setObject: value forKey: objectID.URIRepresentation.absoluteString];
+	}
+	
+	if (!values.count)
+		return;
+	
+	dispatch_sync(_queue, ^{
+		[_committedPrimaryValues addEntriesFromDictionary: values];
+	});
+}
+
+- (void) azcr_contextDidSave: (NSNotification *) note
+{
+	NSPersistentStore *store = [self azcr_recordedStoreForContext: note.object];
+	if (!store)
+		return;
+	
+	NSMutableArray *changes = [NSMutableArray array];
+	NSDictionary *operations = [NSDictionary dictionaryWithObjectsAndKeys:
+								[NSNumber numberWithUnsignedInteger: AZCoreRecordJournalInsert], NSInsertedObjectsKey,
+								[NSNumber numberWithUnsignedInteger: AZCoreRecordJournalUpdate], NSUpdatedObjectsKey,
+								[NSNumber numberWithUnsignedInteger: AZCoreRecordJournalDelete], NSDeletedObjectsKey, nil];
+	
+	[operations enumerateKeysAndObjectsUsingBlock: ^(NSString *key, NSNumber *operation, BOOL *stop) {
+		for (NSManagedObject *object in [note.userInfo objectForKey: key])
+		{
+			NSManagedObjectID *objectID = object.objectID;
+			if (objectID.persistentStore != store)
+				continue;
+			
+			[changes addObject: [NSArray arrayWithObjects: objectID.URIRepresentation.absoluteString, objectID.entity.name, operation, nil]];
+		}
+	}];
+	
+	if (!changes.count)
+		return;
+	
+	dispatch_async(_queue, ^{
+		for (NSArray *change in changes)
+		{
+			NSString *key = [change objectAtIndex: 0];
+			AZCoreRecordJournalOperation operation = [[change objectAtIndex: 2] unsignedIntegerValue];
+			id primaryValue = [_committedPrimaryValues objectForKey: key];
+			[_committedPrimaryValues removeObjectForKey: key];
+			
+			NSMutableDictionary *entry = [_entries objectForKey: key];
+			if (!entry)
+			{
+				entry = [NSMutableDictionary dictionaryWithObjectsAndKeys: [change objectAtIndex: 1], azcr_journalEntityKey, [change objectAtIndex: 2], azcr_journalOperationKey, primaryValue, azcr_journalPrimaryValueKey, nil];
+				[_entries setObject: entry forKey: key];
+				continue;
+			}
+			
+			// Inserts absorb later updates; an insert that gets deleted never happened
+			AZCoreRecordJournalOperation previous = [[entry objectForKey: azcr_journalOperationKey] unsignedIntegerValue];
+			if (operation == AZCoreRecordJournalDelete && previous == AZCoreRecordJournalInsert)
+				[_entries removeObjectForKey: key];
+			else if (operation != AZCoreRecordJournalUpdate)
+				[entry setObject: [change objectAtIndex: 2] forKey: azcr_journalOperationKey];
+		}
+		
+		[self azcr_writeEntries];
+	});
+}
+
+- (void) azcr_writeEntries
+{
+	// Runs on the journal queue
+	NSFileManager *fm = [NSFileManager new];
+	if (!_entries.count)
+	{
+		[fm removeItemAtURL: self.URL error: NULL];
+		return;
+	}
+	
+	NSError *error = nil;
+	NSData *data = [NSPropertyListSerialization dataWithPropertyList: _entries format: NSPropertyListBinaryFormat_v1_0 options: 0 error: &error];
+	if (!data || ![data writeToURL: self.URL options: NSDataWritingAtomic error: &error])
+		[AZCoreRecordManager handleError: error];
+}
+
+- (void) discard
+{
+	dispatch_sync(_queue, ^{
+		[_entries removeAllObjects];
+		[self azcr_writeEntries];
+	});
+}
+
+#pragma mark - Replaying
+
+- (void) azcr_recordTargets: (NSDictionary *) targets finishedKeys: (NSArray *) finishedKeys
+{
+	if (!targets.count && !finishedKeys.count)
+		return;
+	
+	// Progress is saved with each page so a failed replay resumes where it
+	// stopped instead of copying objects a second time.
+	dispatch_sync(_queue, ^{
+		[targets enumerateKeysAndObjectsUsingBlock: ^(NSString *key, NSString *targetURI, BOOL *stop) {
+			[[_entries objectForKey: key] setObject: targetURI forKey: azcr_journalTargetKey];
+		}];
+		[_entries removeObjectsForKeys: finishedKeys];
+		[self azcr_writeEntries];
+	});
+}
+
+- (NSManagedObject *) azcr_objectOfEntity: (NSEntityDescription *) entity primaryValue: (id) value inContext: (NSManagedObjectContext *) context store: (NSPersistentStore *) store
+{
+	NSString *primaryKey = azcr_primaryAttributeName(entity);
+	if (!primaryKey || !value)
+		return nil;
+	
+	NSFetchRequest *request = [NSFetchRequest new];
+	request.entity = entity;
+	request.predicate = [NSPredicate predicateWithFormat: @"%K == %@", primaryKey, value];
+	request.affectedStores = [NSArray arrayWithObject: store];
+	request.fetchLimit = 1;
+	
+	NSError *error = nil;
+	NSArray *results = [context executeFetchRequest: request error: &error];
+	[AZCoreRecordManager handleError: error];
+	return results.lastObject;
+}
+
+- (NSManagedObject *) azcr_objectMatchingSourceObject: (NSManagedObject *) sourceObject translationTable: (NSDictionary *) translationTable inContext: (NSManagedObjectContext *) context store: (NSPersistentStore *) store
+{
+	NSManagedObjectID *objectID = [translationTable objectForKey: sourceObject.objectID];
+	if (objectID)
+		return [context existingObjectWithID: objectID error: NULL];
+	
+	NSString *primaryKey = azcr_primaryAttributeName(sourceObject.entity);
+	return primaryKey ? [self azcr_objectOfEntity: sourceObject.entity primaryValue: [sourceObject valueForKey: primaryKey] inContext: context store: store] : nil;
+}
+
+- (NSUInteger) replayChangesFromStoreAtURL: (NSURL *) sourceURL intoStore: (NSPersistentStore *) store pageSize: (NSUInteger) pageSize error: (NSError **) error
+{
+	NSParameterAssert(sourceURL);
+	NSParameterAssert(store);
+	
+	pageSize = MAX(pageSize, 1);
+	
+	__block NSDictionary *entries = nil;
+	dispatch_sync(_queue, ^{
+		entries = [[NSDictionary alloc] initWithDictionary: _entries copyItems: YES];
+	});
+	
+	if (!entries.count)
+		return 0;
+	
+	NSPersistentStoreCoordinator *coordinator = store.persistentStoreCoordinator;
+	NSManagedObjectModel *model = coordinator.managedObjectModel;
+	// A store added without a configuration reports a name of Core Data's
+	// own, which the model doesn't know
+	NSString *configuration = store.configurationName;
+	if (![model.configurations containsObject: configuration])
+		configuration = nil;
+	
+	NSPersistentStoreCoordinator *sourceCoordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: model];
+	NSDictionary *sourceOptions = [NSDictionary dictionaryWithObject: [NSNumber numberWithBool: YES] forKey: NSReadOnlyPersistentStoreOption];
+	if (![sourceCoordinator addPersistentStoreWithType: NSSQLiteStoreType configuration: configuration URL: sourceURL options: sourceOptions error: error])
+		return NSNotFound;
+	
+	// Both contexts stay on the calling thread for the whole replay
+	NSManagedObjectContext *sourceContext = [[NSManagedObjectContext alloc] init];
+	sourceContext.persistentStoreCoordinator = sourceCoordinator;
+	sourceContext.undoManager = nil;
+	
+	NSManagedObjectContext *targetContext = [[NSManagedObjectContext alloc] init];
+	targetContext.persistentStoreCoordinator = coordinator;
+	targetContext.undoManager = nil;
+	
+	NSArray *keys = entries.allKeys;
+	NSMutableDictionary *translationTable = [NSMutableDictionary dictionary];
+	NSMutableDictionary *keysBySourceID = [NSMutableDictionary dictionary];
+	NSMutableArray *copiedIDs = [NSMutableArray array];
+	NSUInteger applied = 0;
+	NSError *failure = nil;
+	
+	// Pass 1: attributes, inserts, and deletes. Entries copied by an earlier,
+	// interrupted replay only have their relationships left to do.
+	for (NSUInteger location = 0; !failure && location < keys.count; location += pageSize)
+	{
+		@autoreleasepool {
+			NSArray *page = [keys subarrayWithRange: NSMakeRange(location, MIN(pageSize, keys.count - location))];
+			NSMutableArray *sourceObjects = [NSMutableArray arrayWithCapacity: page.count];
+			NSMutableArray *targetObjects = [NSMutableArray arrayWithCapacity: page.count];
+			NSMutableArray *finishedKeys = [NSMutableArray array];
+			NSUInteger pageApplied = 0;
+			
+			for (NSString *key in page)
+			{
+				NSDictionary *entry = [entries objectForKey: key];
+				NSEntityDescription *entity = [model.entitiesByName objectForKey: [entry objectForKey: azcr_journalEntityKey]];
+				if (!entity)
+				{
+					[finishedKeys addObject: key];
+					continue;
+				}
+				
+				NSString *targetURI = [entry objectForKey: azcr_journalTargetKey];
+				if (targetURI)
+				{
+					NSManagedObjectID *sourceID = [sourceCoordinator managedObjectIDForURIRepresentation: [NSURL URLWithString: key]];
+					NSManagedObjectID *targetID = [coordinator managedObjectIDForURIRepresentation: [NSURL URLWithString: targetURI]];
+					if (sourceID && targetID)
+					{
+						[translationTable setObject: targetID forKey: sourceID];
+						[keysBySourceID setObject: key forKey: sourceID];
+						[copiedIDs addObject: sourceID];
+					}
+					else
+					{
+						[finishedKeys addObject: key];
+					}
+					continue;
+				}
+				
+				AZCoreRecordJournalOperation operation = [[entry objectForKey: azcr_journalOperationKey] unsignedIntegerValue];
+				id primaryValue = [entry objectForKey: azcr_journalPrimaryValueKey];
+				
+				if (operation == AZCoreRecordJournalDelete)
+				{
+					NSManagedObject *targetObject = [self azcr_objectOfEntity: entity primaryValue: primaryValue inContext: targetContext store: store];
+					if (targetObject)
+					{
+						[targetContext deleteObject: targetObject];
+						pageApplied++;
+					}
+					[finishedKeys addObject: key];
+					continue;
+				}
+				
+				NSManagedObjectID *sourceID = [sourceCoordinator managedObjectIDForURIRepresentation: [NSURL URLWithString: key]];
+				NSManagedObject *sourceObject = sourceID ? [sourceContext existingObjectWithID: sourceID error: NULL] : nil;
+				if (!sourceObject)
+				{
+					[finishedKeys addObject: key];
+					continue;
+				}
+				
+				NSString *primaryKey = azcr_primaryAttributeName(entity);
+				if (!primaryValue && primaryKey)
+					primaryValue = [sourceObject valueForKey: primaryKey];
+				
+				NSManagedObject *targetObject = [self azcr_objectOfEntity: entity primaryValue: primaryValue inContext: targetContext store: store];
+				if (!targetObject)
+				{
+					// An update can't be matched to anything without a primary attribute
+					if (operation == AZCoreRecordJournalUpdate && !primaryKey)
+					{
+						[finishedKeys addObject: key];
+						continue;
+					}
+					
+					targetObject = [[NSManagedObject alloc] initWithEntity: entity insertIntoManagedObjectContext: targetContext];
+					[targetContext assignObject: targetObject toPersistentStore: store];
+				}
+				
+				[targetObject setValuesForKeysWithDictionary: [sourceObject dictionaryWithValuesForKeys: azcr_persistentAttributeNames(entity)]];
+				[sourceObjects addObject: sourceObject];
+				[targetObjects addObject: targetObject];
+				pageApplied++;
+			}
+			
+			NSError *saveError = nil;
+			if ([targetContext obtainPermanentIDsForObjects: targetObjects error: &saveError] && (![targetContext hasChanges] || [targetContext save: &saveError]))
+			{
+				NSMutableDictionary *targets = [NSMutableDictionary dictionaryWithCapacity: sourceObjects.count];
+				[sourceObjects enumerateObjectsUsingBlock: ^(NSManagedObject *sourceObject, NSUInteger idx, BOOL *stop) {
+					NSManagedObjectID *targetID = [[targetObjects objectAtIndex: idx] objectID];
+					NSString *key = sourceObject.objectID.URIRepresentation.absoluteString;
+					[translationTable setObject: targetID forKey: sourceObject.objectID];
+					[keysBySourceID setObject: key forKey: sourceObject.objectID];
+					[copiedIDs addObject: sourceObject.objectID];
+					[targets setObject: targetID.URIRepresentation.absoluteString forKey: key];
+				}];
+				
+				[self azcr_recordTargets: targets finishedKeys: finishedKeys];
+				applied += pageApplied;
+			}
+			else
+			{
+				failure = saveError;
+			}
+			
+			[sourceContext reset];
+			[targetContext reset];
+		}
+	}
+	
+	// Pass 2: relationships of everything copied. Ones pointing at objects
+	// that can't be found on the other side are left as they were.
+	for (NSUInteger location = 0; !failure && location < copiedIDs.count; location += pageSize)
+	{
+		@autoreleasepool {
+			NSArray *page = [copiedIDs subarrayWithRange: NSMakeRange(location, MIN(pageSize, copiedIDs.count - location))];
+			
+			for (NSManagedObjectID *sourceID in page)
+			{
+				NSManagedObject *sourceObject = [sourceContext existingObjectWithID: sourceID error: NULL];
+				NSManagedObject *targetObject = [targetContext existingObjectWithID: [translationTable objectForKey: sourceID] error: NULL];
+				if (!sourceObject || !targetObject)
+					continue;
+				
+				for (NSRelationshipDescription *relationship in sourceObject.entity.relationshipsByName.allValues)
+				{
+					if (relationship.isTransient)
+						continue;
+					
+					id value = [sourceObject valueForKey: relationship.name];
+					
+					if (!relationship.isToMany)
+					{
+						NSManagedObject *destination = value ? [self azcr_objectMatchingSourceObject: value translationTable: translationTable inContext: targetContext store: store] : nil;
+						if (destination || !value)
+							[targetObject setValue: destination forKey: relationship.name];
+						continue;
+					}
+					
+					id destinations = [value isKindOfClass: [NSOrderedSet class]] ? [NSMutableOrderedSet orderedSet] : [NSMutableSet set];
+					BOOL complete = YES;
+					for (NSManagedObject *sourceDestination in value)
+					{
+						NSManagedObject *destination = [self azcr_objectMatchingSourceObject: sourceDestination translationTable: translationTable inContext: targetContext store: store];
+						if (!destination)
+						{
+							complete = NO;
+							break;
+						}
+						[destinations addObject: destination];
+					}
+					
+					if (complete)
+						[targetObject setValue: destinations forKey: relationship.name];
+				}
+			}
+			
+			NSError *saveError = nil;
+			if ([targetContext hasChanges] && ![targetContext save: &saveError])
+				failure = saveError;
+			else
+				[self azcr_recordTargets: nil finishedKeys: [keysBySourceID objectsForKeys: page notFoundMarker: [NSNull null]]];
+			
+			[sourceContext reset];
+			[targetContext reset];
+		}
+	}
+	
+	if (failure)
+	{
+		if (error)
+			*error = failure;
+		return NSNotFound;
+	}
+	
+	return applied;
+}
+
+@end
@@ -0,0 +1,78 @@
+//
+//  AZCoreRecordDeduplicator.h
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import <CoreData/CoreData.h>
+
+@class AZCoreRecordManager;
+
+extern NSString *const AZCoreRecordManagerDidDeduplicateNotification;
+
+extern NSString *const AZCoreRecordDeduplicationDeletedCountKey;
+extern NSString *const AZCoreRecordDeduplicationDeletedCountsByEntityKey;
+
+/** Entity user info key naming a date attribute that orders duplicates for
+ the keep-oldest and keep-newest policies. */
+extern NSString *const AZCoreRecordDeduplicationDateAttributeKey;
+
+enum {
+	AZCoreRecordDeduplicationKeepOldest = 0,
+	AZCoreRecordDeduplicationKeepNewest
+};
+typedef NSUInteger AZCoreRecordDeduplicationPolicy;
+
+/** Picks the object to keep out of a group sharing one primary value. The
+ others are deleted; move anything worth keeping onto the winner first. */
+typedef NSManagedObject *(^AZCoreRecordDeduplicationWinnerBlock)(NSString *entityName, NSArray *duplicates);
+
+/** Removes objects that share a primary value after seeding and ubiquitous
+ imports.
+
+ Only entities whose user info names a `primaryAttribute` (see
+ NSManagedObject+AZCoreRecordImport) take part. Each one costs a single
+ grouped fetch to find the duplicated values; the objects behind them are
+ then fetched, resolved, and deleted `batchSize` values at a time on a
+ private-queue context, which is saved and reset after every batch. The
+ deletions are merged into the manager's main context.
+
+ A pass triggered by the manager only looks at the entities named in the
+ AZCoreRecordDeduplicationEntityNamesKey of the triggering notification.
+ Stores added with NSReadOnlyPersistentStoreOption are left alone.
+ */
+@interface AZCoreRecordDeduplicator : NSObject
+{
+@private
+	__weak AZCoreRecordManager *_manager;
+	dispatch_queue_t _queue;
+	BOOL _enabled;
+	NSUInteger _batchSize;
+	AZCoreRecordDeduplicationPolicy _policy;
+	AZCoreRecordDeduplicationWinnerBlock _winnerBlock;
+}
+
+- (id) initWithManager: (AZCoreRecordManager *) manager;
+
+/** Automatic passes after imports are off until this is set. Defaults to NO. */
+@property (nonatomic, getter = isEnabled) BOOL enabled;
+
+/** Duplicated values resolved per fetch and save. Defaults to 500. */
+@property (nonatomic) NSUInteger batchSize;
+
+/** Used when there's no winnerBlock. Duplicates are ordered by the date
+ attribute named under AZCoreRecordDeduplicationDateAttributeKey in the
+ entity's user info, then by object ID; without a date attribute the choice
+ is arbitrary but stable. Defaults to keeping the oldest object. */
+@property (nonatomic) AZCoreRecordDeduplicationPolicy policy;
+
+@property (nonatomic, copy) AZCoreRecordDeduplicationWinnerBlock winnerBlock;
+
+/** Runs a pass now over the given entity names, or over every entity with
+ a primary attribute if `entityNames` is nil. The report is the user info
+ of AZCoreRecordManagerDidDeduplicateNotification. */
+- (void) deduplicateEntitiesNamed: (NSSet *) entityNames completion: (void (^)(NSDictionary *report)) completion;
+
+@end
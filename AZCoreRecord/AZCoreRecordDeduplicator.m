@@ -0,0 +1,266 @@
+//
+//  AZCoreRecordDeduplicator.m
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordDeduplicator.h"
+#import "AZCoreRecordManager.h"
+#import "NSManagedObject+AZCoreRecordImport.h"
+#import "NSManagedObjectContext+AZCoreRecord.h"
+
+NSString *const AZCoreRecordManagerDidDeduplicateNotification = @"AZCoreRecordManagerDidDeduplicateNotification";
+
+NSString *const AZCoreRecordDeduplicationDeletedCountKey = @"AZCoreRecordDeduplicationDeletedCount";
+NSString *const AZCoreRecordDeduplicationDeletedCountsByEntityKey = @"AZCoreRecordDeduplicationDeletedCountsByEntity";
+
+NSString *const AZCoreRecordDeduplicationDateAttributeKey = @"deduplicationDateAttribute";
+
+static NSString *const azcr_duplicateCountKey = @"azcr_duplicateCount";
+
+@implementation AZCoreRecordDeduplicator
+
+@synthesize batchSize = _batchSize, policy = _policy, winnerBlock = _winnerBlock;
+
+- (id) initWithManager: (AZCoreRecordManager *) manager
+{
+	NSParameterAssert(manager);
+	
+	if ((self = [super init]))
+	{
+		_manager = manager;
+		_queue = dispatch_queue_create("com.AZCoreRecord.deduplication", DISPATCH_QUEUE_SERIAL);
+		dispatch_set_target_queue(_queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+		_batchSize = 500;
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	dispatch_release(_queue);
+}
+
+#pragma mark - Scheduling
+
+- (BOOL) isEnabled
+{
+	return _enabled;
+}
+
+- (void) setEnabled: (BOOL) enabled
+{
+	_enabled = enabled;
+}
+
+- (void) deduplicateEntitiesNamed: (NSSet *) entityNames completion: (void (^)(NSDictionary *report)) completion
+{
+	entityNames = [entityNames copy];
+	
+	dispatch_async(_queue, ^{
+		NSDictionary *report = [self azcr_deduplicateEntitiesNamed: entityNames];
+		
+		if (completion)
+			dispatch_async(dispatch_get_main_queue(), ^{ completion(report); });
+	});
+}
+
+#pragma mark - Deduplication
+
+- (NSManagedObject *) azcr_winnerAmongDuplicates: (NSArray *) duplicates entityName: (NSString *) entityName
+{
+	AZCoreRecordDeduplicationWinnerBlock winnerBlock = self.winnerBlock;
+	if (winnerBlock)
+		return winnerBlock(entityName, duplicates);
+	
+	BOOL keepNewest = (self.policy == AZCoreRecordDeduplicationKeepNewest);
+	NSEntityDescription *entity = [(NSManagedObject *) duplicates.lastObject entity];
+	NSString *dateKey = [entity.userInfo objectForKey: AZCoreRecordDeduplicationDateAttributeKey];
+	
+	// Undated objects count as oldest. Ties fall back to the object IDs'
+	// URIs, which every pass over the same store orders the same way.
+	NSArray *sorted = [duplicates sortedArrayUsingComparator: ^NSComparisonResult(NSManagedObject *a, NSManagedObject *b) {
+		if (dateKey)
+		{
+			NSDate *dateA = [a valueForKey: dateKey], *dateB = [b valueForKey: dateKey];
+			if (dateA && dateB)
+			{
+				NSComparisonResult result = [dateA compare: dateB];
+				if (result != NSOrderedSame)
+					return result;
+			}
+			else if (dateA || dateB)
+			{
+				return dateA ? NSOrderedDescending : NSOrderedAscending;
+			}
+		}
+		
+		return [a.objectID.URIRepresentation.absoluteString compare: b.objectID.URIRepresentation.absoluteString options: NSNumericSearch];
+	}];
+	
+	return keepNewest ? sorted.lastObject : [sorted objectAtIndex: 0];
+}
+
+- (NSArray *) azcr_duplicatedValuesForEntity: (NSEntityDescription *) entity attribute: (NSAttributeDescription *) attribute stores: (NSArray *) stores inContext: (NSManagedObjectContext *) context
+{
+	NSExpressionDescription *countDescription = [NSExpressionDescription new];
+	countDescription.name = azcr_duplicateCountKey;
+	countDescription.expression = [NSExpression expressionForFunction: @"count:" arguments: [NSArray arrayWithObject: [NSExpression expressionForKeyPath: attribute.name]]];
+	countDescription.expressionResultType = NSInteger64AttributeType;
+	
+	NSFetchRequest *request = [NSFetchRequest new];
+	request.entity = entity;
+	request.includesSubentities = NO;
+	request.resultType = NSDictionaryResultType;
+	request.propertiesToFetch = [NSArray arrayWithObjects: attribute, countDescription, nil];
+	request.propertiesToGroupBy = [NSArray arrayWithObject: attribute];
+	request.affectedStores = stores;
+	
+	NSError *error = nil;
+	NSArray *groups = [context executeFetchRequest: request error: &error];
+	[AZCoreRecordManager handleError: error];
+	
+	// One row per distinct value; keep those seen more than once. Filtering
+	// here instead of with a having predicate keeps the SQL Core Data builds
+	// simple across OS versions.
+	NSMutableArray *values = [NSMutableArray array];
+	for (NSDictionary *group in groups)
+	{
+		id value = [group objectForKey: attribute.name];
+		if (value && [[group objectForKey: azcr_duplicateCountKey] longLongValue] > 1)
+			[values addObject: value];
+	}
+	
+	return values;
+}
+
+- (NSUInteger) azcr_resolveValues: (NSArray *) values forEntity: (NSEntityDescription *) entity attribute: (NSAttributeDescription *) attribute stores: (NSArray *) stores inContext: (NSManagedObjectContext *) context
+{
+	NSFetchRequest *request = [NSFetchRequest new];
+	request.entity = entity;
+	request.includesSubentities = NO;
+	request.affectedStores = stores;
+	request.predicate = [NSPredicate predicateWithFormat: @"%K IN %@", attribute.name, values];
+	request.returnsObjectsAsFaults = NO;
+	
+	NSError *error = nil;
+	NSArray *objects = [context executeFetchRequest: request error: &error];
+	[AZCoreRecordManager handleError: error];
+	
+	NSMutableDictionary *groups = [NSMutableDictionary dictionaryWithCapacity: values.count];
+	for (NSManagedObject *object in objects)
+	{
+		id value = [object valueForKey: attribute.name];
+		NSMutableArray *group = [groups objectForKey: value];
+		if (!group)
+		{
+			group = [NSMutableArray arrayWithCapacity: 2];
+			[groups setObject: group forKey: value];
+		}
+		[group addObject: object];
+	}
+	
+	__block NSUInteger deleted = 0;
+	[groups enumerateKeysAndObjectsUsingBlock: ^(id value, NSArray *duplicates, BOOL *stop) {
+		if (duplicates.count < 2)
+			return;
+		
+		NSManagedObject *winner = [self azcr_winnerAmongDuplicates: duplicates entityName: entity.name];
+		if (!winner)
+			return;
+		
+		for (NSManagedObject *object in duplicates)
+		{
+			if (object == winner)
+				continue;
+			
+			[context deleteObject: object];
+			deleted++;
+		}
+	}];
+	
+	return deleted;
+}
+
+- (NSDictionary *) azcr_deduplicateEntitiesNamed: (NSSet *) entityNames
+{
+	AZCoreRecordManager *manager = _manager;
+	if (!manager.isStackReady)
+		return nil;
+	
+	NSPersistentStoreCoordinator *coordinator = manager.persistentStoreCoordinator;
+	
+	// Only stores opened with NSReadOnlyPersistentStoreOption are off limits;
+	// the ubiquitous store is exactly where imports create duplicates.
+	NSIndexSet *writableIndexes = [coordinator.persistentStores indexesOfObjectsPassingTest: ^BOOL(NSPersistentStore *store, NSUInteger idx, BOOL *stop) {
+		return !store.isReadOnly;
+	}];
+	NSArray *stores = [coordinator.persistentStores objectsAtIndexes: writableIndexes];
+	if (!stores.count)
+		return nil;
+	
+	NSManagedObjectContext *mainContext = manager.managedObjectContext;
+	
+	NSManagedObjectContext *context = [[NSManagedObjectContext alloc] initWithConcurrencyType: NSPrivateQueueConcurrencyType];
+	context.persistentStoreCoordinator = coordinator;
+	context.undoManager = nil;
+	
+	id observer = [[NSNotificationCenter defaultCenter] addObserverForName: NSManagedObjectContextDidSaveNotification object: context queue: nil usingBlock: ^(NSNotification *note) {
+		[mainContext mergeChangesFromNotification: note];
+	}];
+	
+	NSUInteger batchSize = MAX(self.batchSize, 1);
+	NSMutableDictionary *deletedCounts = [NSMutableDictionary dictionary];
+	__block NSUInteger totalDeleted = 0;
+	
+	for (NSEntityDescription *entity in coordinator.managedObjectModel.entities)
+	{
+		if (entityNames && ![entityNames containsObject: entity.name])
+			continue;
+		
+		NSString *attributeKey = [entity.userInfo objectForKey: AZCoreRecordImportPrimaryAttributeKey];
+		NSAttributeDescription *attribute = attributeKey ? [entity.attributesByName objectForKey: attributeKey] : nil;
+		if (!attribute || attribute.isTransient)
+			continue;
+		
+		__block NSUInteger entityDeleted = 0;
+		[context performBlockAndWait: ^{
+			NSArray *values = [self azcr_duplicatedValuesForEntity: entity attribute: attribute stores: stores inContext: context];
+			
+			for (NSUInteger location = 0; location < values.count; location += batchSize)
+			{
+				@autoreleasepool {
+					NSArray *batch = [values subarrayWithRange: NSMakeRange(location, MIN(batchSize, values.count - location))];
+					NSUInteger deleted = [self azcr_resolveValues: batch forEntity: entity attribute: attribute stores: stores inContext: context];
+					
+					if (deleted && [context save])
+						entityDeleted += deleted;
+					
+					[context reset];
+				}
+			}
+		}];
+		
+		if (entityDeleted)
+		{
+			[deletedCounts setObject: [NSNumber numberWithUnsignedInteger: entityDeleted] forKey: entity.name];
+			totalDeleted += entityDeleted;
+		}
+	}
+	
+	[[NSNotificationCenter defaultCenter] removeObserver: observer];
+	
+	NSDictionary *report = [NSDictionary dictionaryWithObjectsAndKeys:
+							[NSNumber numberWithUnsignedInteger: totalDeleted], AZCoreRecordDeduplicationDeletedCountKey,
+							deletedCounts, AZCoreRecordDeduplicationDeletedCountsByEntityKey, nil];
+	
+	if (totalDeleted)
+		[[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordManagerDidDeduplicateNotification object: manager userInfo: report];
+	
+	return report;
+}
+
+@end
@@ -0,0 +1,58 @@
+//
+//  AZCoreRecordDeviceRegistry.h
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/** The set of devices syncing through one ubiquity container.
+
+ Each device owns a single record file named after its identifier, so
+ registering never rewrites anyone else's entry and checking membership is
+ one coordinated `stat` rather than a read of the whole list. Writes only
+ happen when the device's own record is missing.
+
+ Devices listed in the single plist that older versions kept next to the
+ directory (UbiquitousSyncingDevices.plist for the sentinel's folder) are
+ given records by importLegacyDevices, which the sentinel calls before it
+ registers or checks for this device. The plist is left in place for
+ devices that still read it.
+
+ The registry works on any directory. The ubiquity sentinel points it at
+ the container; tests can point it at a temporary folder.
+ */
+@interface AZCoreRecordDeviceRegistry : NSObject
+{
+@private
+	NSURL *_directoryURL;
+	__weak id <NSFilePresenter> _filePresenter;
+	dispatch_semaphore_t _semaphore;
+	NSMutableSet *_knownDevices;
+	BOOL _importedLegacyDevices;
+}
+
+/** `filePresenter` is handed to the file coordinators, so the presenter
+ isn't told about the registry's own writes. It may be nil. */
+- (id) initWithDirectoryURL: (NSURL *) directoryURL filePresenter: (id <NSFilePresenter>) filePresenter;
+
+@property (nonatomic, copy, readonly) NSURL *directoryURL;
+
+- (NSURL *) recordURLForDevice: (NSString *) deviceIdentifier;
+
+- (BOOL) containsDevice: (NSString *) deviceIdentifier;
+- (BOOL) registerDevice: (NSString *) deviceIdentifier error: (NSError **) error;
+
+/** Gives every device in the legacy list a record, once per registry.
+ refreshKnownDevices calls this as well. */
+- (void) importLegacyDevices;
+
+/** Every device seen so far. */
+@property (nonatomic, readonly) NSSet *knownDevices;
+
+/** Picks up records added since the last call and returns just those. */
+- (NSSet *) refreshKnownDevices;
+
+@end
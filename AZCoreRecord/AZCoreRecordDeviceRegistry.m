@@ -0,0 +1,186 @@
+//
+//  AZCoreRecordDeviceRegistry.m
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordDeviceRegistry.h"
+
+static NSString *const azcr_deviceRecordExtension = @"device";
+static NSString *const azcr_deviceRecordDateKey = @"registered";
+
+@implementation AZCoreRecordDeviceRegistry
+
+@synthesize directoryURL = _directoryURL;
+
+- (id) initWithDirectoryURL: (NSURL *) directoryURL filePresenter: (id <NSFilePresenter>) filePresenter
+{
+	NSParameterAssert(directoryURL);
+	
+	if ((self = [super init]))
+	{
+		_directoryURL = [directoryURL copy];
+		_filePresenter = filePresenter;
+		_semaphore = dispatch_semaphore_create(1);
+		_knownDevices = [NSMutableSet set];
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	dispatch_release(_semaphore);
+}
+
+#pragma mark - Records
+
+- (NSURL *) recordURLForDevice: (NSString *) deviceIdentifier
+{
+	NSParameterAssert(deviceIdentifier.length);
+	return [[self.directoryURL URLByAppendingPathComponent: deviceIdentifier] URLByAppendingPathExtension: azcr_deviceRecordExtension];
+}
+
+- (BOOL) containsDevice: (NSString *) deviceIdentifier
+{
+	if (!deviceIdentifier.length)
+		return NO;
+	
+	// Always ask the file system: a record that disappeared means the
+	// container was reset, and a cached answer would hide that.
+	__block BOOL exists = NO;
+	NSFileCoordinator *coordinator = [[NSFileCoordinator alloc] initWithFilePresenter: _filePresenter];
+	[coordinator coordinateReadingItemAtURL: [self recordURLForDevice: deviceIdentifier] options: NSFileCoordinatorReadingWithoutChanges error: NULL byAccessor: ^(NSURL *readURL) {
+		exists = [readURL checkResourceIsReachableAndReturnError: NULL];
+	}];
+	
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	if (exists)
+		[_knownDevices addObject: deviceIdentifier];
+	else
+		[_knownDevices removeObject: deviceIdentifier];
+	dispatch_semaphore_signal(_semaphore);
+	
+	return exists;
+}
+
+- (BOOL) registerDevice: (NSString *) deviceIdentifier error: (NSError **) error
+{
+	NSParameterAssert(deviceIdentifier.length);
+	
+	if ([self containsDevice: deviceIdentifier])
+		return YES;
+	
+	return [self azcr_writeRecordForDevice: deviceIdentifier error: error];
+}
+
+- (BOOL) azcr_writeRecordForDevice: (NSString *) deviceIdentifier error: (NSError **) error
+{
+	NSDictionary *record = [NSDictionary dictionaryWithObject: [NSDate date] forKey: azcr_deviceRecordDateKey];
+	NSData *data = [NSPropertyListSerialization dataWithPropertyList: record format: NSPropertyListBinaryFormat_v1_0 options: 0 error: error];
+	if (!data)
+		return NO;
+	
+	__block BOOL success = NO;
+	__block NSError *writeError = nil;
+	NSError *coordinationError = nil;
+	NSFileCoordinator *coordinator = [[NSFileCoordinator alloc] initWithFilePresenter: _filePresenter];
+	[coordinator coordinateWritingItemAtURL: [self recordURLForDevice: deviceIdentifier] options: 0 error: &coordinationError byAccessor: ^(NSURL *writeURL) {
+		NSFileManager *fm = [NSFileManager new];
+		success = [fm createDirectoryAtURL: writeURL.URLByDeletingLastPathComponent withIntermediateDirectories: YES attributes: nil error: &writeError] && [data writeToURL: writeURL options: NSDataWritingAtomic error: &writeError];
+	}];
+	
+	if (!success)
+	{
+		if (error)
+			*error = writeError ?: coordinationError;
+		return NO;
+	}
+	
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	[_knownDevices addObject: deviceIdentifier];
+	dispatch_semaphore_signal(_semaphore);
+	
+	return YES;
+}
+
+#pragma mark - Known devices
+
+- (NSSet *) knownDevices
+{
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	NSSet *devices = [_knownDevices copy];
+	dispatch_semaphore_signal(_semaphore);
+	return devices;
+}
+
+- (NSURL *) azcr_legacyDevicesListURL
+{
+	NSString *fileName = [self.directoryURL.lastPathComponent stringByAppendingPathExtension: @"plist"];
+	return [self.directoryURL.URLByDeletingLastPathComponent URLByAppendingPathComponent: fileName];
+}
+
+- (void) importLegacyDevices
+{
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	BOOL imported = _importedLegacyDevices;
+	_importedLegacyDevices = YES;
+	dispatch_semaphore_signal(_semaphore);
+	
+	if (imported)
+		return;
+	
+	__block NSArray *devices = nil;
+	NSFileCoordinator *coordinator = [[NSFileCoordinator alloc] initWithFilePresenter: _filePresenter];
+	[coordinator coordinateReadingItemAtURL: [self azcr_legacyDevicesListURL] options: NSFileCoordinatorReadingWithoutChanges error: NULL byAccessor: ^(NSURL *readURL) {
+		devices = [NSArray arrayWithContentsOfURL: readURL];
+	}];
+	
+	for (NSString *deviceIdentifier in devices)
+	{
+		if (![deviceIdentifier isKindOfClass: [NSString class]] || !deviceIdentifier.length)
+			continue;
+		
+		NSURL *recordURL = [self recordURLForDevice: deviceIdentifier];
+		if (![recordURL checkResourceIsReachableAndReturnError: NULL])
+			[self azcr_writeRecordForDevice: deviceIdentifier error: NULL];
+	}
+}
+
+- (NSSet *) refreshKnownDevices
+{
+	[self importLegacyDevices];
+	
+	// Only names are listed; records themselves are never opened
+	__block NSArray *recordURLs = nil;
+	NSFileCoordinator *coordinator = [[NSFileCoordinator alloc] initWithFilePresenter: _filePresenter];
+	[coordinator coordinateReadingItemAtURL: self.directoryURL options: NSFileCoordinatorReadingWithoutChanges error: NULL byAccessor: ^(NSURL *readURL) {
+		recordURLs = [[NSFileManager new] contentsOfDirectoryAtURL: readURL includingPropertiesForKeys: nil options: NSDirectoryEnumerationSkipsHiddenFiles error: NULL];
+	}];
+	
+	if (!recordURLs)
+		return [NSSet set];
+	
+	NSMutableSet *added = [NSMutableSet set];
+	
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	for (NSURL *recordURL in recordURLs)
+	{
+		if (![recordURL.pathExtension isEqualToString: azcr_deviceRecordExtension])
+			continue;
+		
+		NSString *deviceIdentifier = recordURL.lastPathComponent.stringByDeletingPathExtension;
+		if (![_knownDevices containsObject: deviceIdentifier])
+		{
+			[_knownDevices addObject: deviceIdentifier];
+			[added addObject: deviceIdentifier];
+		}
+	}
+	dispatch_semaphore_signal(_semaphore);
+	
+	return added;
+}
+
+@end
@@ -0,0 +1,56 @@
+//
+//  AZCoreRecordDownloadTracker.h
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/** Waits for files to become available without polling on a fixed tick.
+
+ A waiter wakes up when a file presenter for the item reports a change
+ or when its parent directory is written to. A backoff timer is only a
+ fallback for events that never come, and an overall timeout keeps a
+ stalled item from being tracked forever. Waiters on the same URL share
+ a single set of watchers.
+
+ An item moved by a coordinated write is followed to its new URL, and
+ completes when it becomes available there.
+
+ With usesUbiquitousItemState off, "available" simply means the file
+ exists. That makes the tracker usable, and testable, on a plain local
+ directory.
+ */
+@interface AZCoreRecordDownloadTracker : NSObject
+{
+@private
+	dispatch_queue_t _queue;
+	NSMutableDictionary *_waiters;
+	BOOL _usesUbiquitousItemState;
+	NSTimeInterval _initialInterval;
+	NSTimeInterval _maximumInterval;
+	NSTimeInterval _timeout;
+}
+
+/** Defaults to YES: check and start ubiquitous downloads. */
+@property (nonatomic) BOOL usesUbiquitousItemState;
+
+/** First fallback check; doubles after every quiet check. Defaults to 0.1 seconds. */
+@property (nonatomic) NSTimeInterval initialInterval;
+
+/** Longest gap between fallback checks. Defaults to 5 seconds. */
+@property (nonatomic) NSTimeInterval maximumInterval;
+
+/** How long to wait before giving up; 0 waits forever. Defaults to 10
+ minutes, long enough for a large store on a slow connection. */
+@property (nonatomic) NSTimeInterval timeout;
+
+/** Calls `completion` right away if the item is ready, otherwise from a
+ background queue once it is, fails, or times out. */
+- (void) waitForItemAtURL: (NSURL *) URL completion: (void (^)(BOOL success, NSError *error)) completion;
+
+@property (nonatomic, readonly) NSUInteger pendingItemCount;
+
+@end
@@ -0,0 +1,329 @@
+//
+//  AZCoreRecordDownloadTracker.m
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import <fcntl.h>
+
+#import "AZCoreRecordDownloadTracker.h"
+#import "AZCoreRecordManager.h"
+
+enum {
+	AZCoreRecordItemPending = 0,
+	AZCoreRecordItemReady,
+	AZCoreRecordItemFailed
+};
+typedef NSUInteger AZCoreRecordItemState;
+
+#pragma mark - Waiter
+
+@interface AZCoreRecordDownloadWaiter : NSObject <NSFilePresenter>
+
+// Read by the file coordinator on its own threads
+@property (copy) NSURL *presentedItemURL;
+@property (nonatomic, strong) NSOperationQueue *presentedItemOperationQueue;
+@property (nonatomic, copy) void (^changeHandler)(void);
+@property (nonatomic, copy) void (^moveHandler)(NSURL *newURL);
+
+// The key in the tracker's waiters; only touched on the tracker queue
+@property (nonatomic, copy) NSURL *trackedURL;
+@property (nonatomic, strong) NSMutableArray *completions;
+@property (nonatomic) dispatch_source_t directorySource;
+@property (nonatomic) dispatch_source_t timer;
+@property (nonatomic) NSTimeInterval interval;
+@property (nonatomic) CFAbsoluteTime deadline;
+
+@end
+
+@implementation AZCoreRecordDownloadWaiter
+
+@synthesize presentedItemURL = _presentedItemURL, presentedItemOperationQueue = _presentedItemOperationQueue, changeHandler = _changeHandler, moveHandler = _moveHandler, trackedURL = _trackedURL;
+@synthesize completions = _completions, directorySource = _directorySource, timer = _timer, interval = _interval, deadline = _deadline;
+
+- (void) presentedItemDidChange
+{
+	if (self.changeHandler)
+		self.changeHandler();
+}
+
+- (void) presentedItemDidMoveToURL: (NSURL *) newURL
+{
+	self.presentedItemURL = newURL;
+	
+	if (self.moveHandler)
+		self.moveHandler(newURL);
+}
+
+@end
+
+#pragma mark - Tracker
+
+@implementation AZCoreRecordDownloadTracker
+
+@synthesize usesUbiquitousItemState = _usesUbiquitousItemState, initialInterval = _initialInterval, maximumInterval = _maximumInterval, timeout = _timeout;
+
+- (id) init
+{
+	if ((self = [super init]))
+	{
+		_queue = dispatch_queue_create("com.AZCoreRecord.downloadTracker", DISPATCH_QUEUE_SERIAL);
+		_waiters = [NSMutableDictionary dictionary];
+		_usesUbiquitousItemState = YES;
+		_initialInterval = 0.1;
+		_maximumInterval = 5.0;
+		_timeout = 10.0 * 60.0;
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	for (AZCoreRecordDownloadWaiter *waiter in _waiters.allValues)
+		[self azcr_stopWatchingWithWaiter: waiter];
+	dispatch_release(_queue);
+}
+
+#pragma mark - Item state
+
+- (AZCoreRecordItemState) azcr_stateOfItemAtURL: (NSURL *) URL error: (NSError **) error
+{
+	if (!self.usesUbiquitousItemState)
+		return [URL checkResourceIsReachableAndReturnError: NULL] ? AZCoreRecordItemReady : AZCoreRecordItemPending;
+	
+	NSNumber *downloaded = nil;
+	if (![URL getResourceValue: &downloaded forKey: NSURLUbiquitousItemIsDownloadedKey error: NULL])
+		return AZCoreRecordItemReady; // Resource doesn't exist, so there's nothing to wait for
+	
+	if (downloaded.boolValue)
+		return AZCoreRecordItemReady;
+	
+	NSNumber *downloading = nil;
+	if (![URL getResourceValue: &downloading forKey: NSURLUbiquitousItemIsDownloadingKey error: error])
+		return AZCoreRecordItemFailed;
+	
+	if (!downloading.boolValue && ![[NSFileManager defaultManager] startDownloadingUbiquitousItemAtURL: URL error: error])
+		return AZCoreRecordItemFailed;
+	
+	return AZCoreRecordItemPending;
+}
+
+#pragma mark - Waiting
+
+- (void) waitForItemAtURL: (NSURL *) URL completion: (void (^)(BOOL success, NSError *error)) completion
+{
+	NSParameterAssert(URL);
+	NSParameterAssert(completion);
+	
+	NSError *error = nil;
+	AZCoreRecordItemState state = [self azcr_stateOfItemAtURL: URL error: &error];
+	if (state != AZCoreRecordItemPending)
+	{
+		completion(state == AZCoreRecordItemReady, error);
+		return;
+	}
+	
+	dispatch_async(_queue, ^{
+		AZCoreRecordDownloadWaiter *waiter = [_waiters objectForKey: URL];
+		BOOL isNew = !waiter;
+		
+		if (isNew)
+		{
+			waiter = [self azcr_startWatchingItemAtURL: URL];
+			[_waiters setObject: waiter forKey: URL];
+		}
+		
+		[waiter.completions addObject: [completion copy]];
+		
+		// The item may have landed between the first check and now
+		if (isNew)
+			[self azcr_checkWaiter: waiter];
+	});
+}
+
+- (NSUInteger) pendingItemCount
+{
+	__block NSUInteger count = 0;
+	dispatch_sync(_queue, ^{
+		count = _waiters.count;
+	});
+	return count;
+}
+
+- (AZCoreRecordDownloadWaiter *) azcr_startWatchingItemAtURL: (NSURL *) URL
+{
+	AZCoreRecordDownloadWaiter *waiter = [AZCoreRecordDownloadWaiter new];
+	waiter.presentedItemURL = URL;
+	waiter.trackedURL = URL;
+	waiter.completions = [NSMutableArray array];
+	waiter.interval = self.initialInterval;
+	waiter.deadline = self.timeout > 0 ? CFAbsoluteTimeGetCurrent() + self.timeout : 0;
+	
+	__weak AZCoreRecordDownloadTracker *weakSelf = self;
+	__weak AZCoreRecordDownloadWaiter *weakWaiter = waiter;
+	dispatch_queue_t queue = _queue;
+	
+	void (^check)(void) = ^{
+		[weakSelf azcr_checkWaiter: weakWaiter];
+	};
+	
+	// File presenter callbacks cover coordinated writes, including the
+	// ubiquity daemon finishing a download
+	NSOperationQueue *presenterQueue = [NSOperationQueue new];
+	presenterQueue.maxConcurrentOperationCount = 1;
+	waiter.presentedItemOperationQueue = presenterQueue;
+	waiter.changeHandler = ^{
+		dispatch_async(queue, check);
+	};
+	waiter.moveHandler = ^(NSURL *newURL) {
+		dispatch_async(queue, ^{
+			[weakSelf azcr_moveWaiter: weakWaiter toURL: newURL];
+		});
+	};
+	[NSFileCoordinator addFilePresenter: waiter];
+	[self azcr_watchDirectoryForWaiter: waiter];
+	
+	// Fallback for changes nobody announces, backing off while nothing happens
+	dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+	dispatch_source_set_event_handler(timer, ^{
+		AZCoreRecordDownloadTracker *strongSelf = weakSelf;
+		AZCoreRecordDownloadWaiter *strongWaiter = weakWaiter;
+		if (!strongSelf || !strongWaiter)
+			return;
+		
+		[strongSelf azcr_checkWaiter: strongWaiter];
+		
+		if (strongSelf->_waiters && [strongSelf->_waiters objectForKey: strongWaiter.trackedURL] == strongWaiter)
+		{
+			strongWaiter.interval = MIN(strongWaiter.interval * 2, strongSelf.maximumInterval);
+			[strongSelf azcr_scheduleTimerForWaiter: strongWaiter];
+		}
+	});
+	waiter.timer = timer;
+	[self azcr_scheduleTimerForWaiter: waiter];
+	dispatch_resume(timer);
+	
+	return waiter;
+}
+
+- (void) azcr_watchDirectoryForWaiter: (AZCoreRecordDownloadWaiter *) waiter
+{
+	if (waiter.directorySource)
+	{
+		dispatch_source_cancel(waiter.directorySource);
+		dispatch_release(waiter.directorySource);
+		waiter.directorySource = NULL;
+	}
+	
+	// Watching the parent directory catches the item appearing or being
+	// replaced, which is all a plain local directory will ever report
+	int fd = open(waiter.trackedURL.URLByDeletingLastPathComponent.path.fileSystemRepresentation, O_EVTONLY);
+	if (fd < 0)
+		return;
+	
+	__weak AZCoreRecordDownloadTracker *weakSelf = self;
+	__weak AZCoreRecordDownloadWaiter *weakWaiter = waiter;
+	
+	dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_VNODE, fd, DISPATCH_VNODE_WRITE | DISPATCH_VNODE_EXTEND | DISPATCH_VNODE_ATTRIB | DISPATCH_VNODE_LINK | DISPATCH_VNODE_RENAME, _queue);
+	dispatch_source_set_event_handler(source, ^{
+		[weakSelf azcr_checkWaiter: weakWaiter];
+	});
+	dispatch_source_set_cancel_handler(source, ^{
+		close(fd);
+	});
+	dispatch_resume(source);
+	waiter.directorySource = source;
+}
+
+- (void) azcr_moveWaiter: (AZCoreRecordDownloadWaiter *) waiter toURL: (NSURL *) newURL
+{
+	// Runs on the tracker queue
+	if (!waiter || !newURL || [_waiters objectForKey: waiter.trackedURL] != waiter || [waiter.trackedURL isEqual: newURL])
+		return;
+	
+	[_waiters removeObjectForKey: waiter.trackedURL];
+	
+	// Someone is already waiting at the destination; hand the completions over
+	AZCoreRecordDownloadWaiter *existing = [_waiters objectForKey: newURL];
+	if (existing)
+	{
+		[existing.completions addObjectsFromArray: waiter.completions];
+		[self azcr_stopWatchingWithWaiter: waiter];
+		[self azcr_checkWaiter: existing];
+		return;
+	}
+	
+	BOOL sameDirectory = [waiter.trackedURL.URLByDeletingLastPathComponent isEqual: newURL.URLByDeletingLastPathComponent];
+	waiter.trackedURL = newURL;
+	[_waiters setObject: waiter forKey: newURL];
+	
+	if (!sameDirectory)
+		[self azcr_watchDirectoryForWaiter: waiter];
+	
+	[self azcr_checkWaiter: waiter];
+}
+
+- (void) azcr_scheduleTimerForWaiter: (AZCoreRecordDownloadWaiter *) waiter
+{
+	NSTimeInterval delay = waiter.interval;
+	if (waiter.deadline)
+		delay = MAX(0, MIN(delay, waiter.deadline - CFAbsoluteTimeGetCurrent()));
+	
+	dispatch_source_set_timer(waiter.timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, (uint64_t)(delay * NSEC_PER_SEC / 10));
+}
+
+- (void) azcr_checkWaiter: (AZCoreRecordDownloadWaiter *) waiter
+{
+	// Runs on the tracker queue
+	if (!waiter || [_waiters objectForKey: waiter.trackedURL] != waiter)
+		return;
+	
+	NSError *error = nil;
+	AZCoreRecordItemState state = [self azcr_stateOfItemAtURL: waiter.trackedURL error: &error];
+	
+	if (state == AZCoreRecordItemPending && waiter.deadline && CFAbsoluteTimeGetCurrent() >= waiter.deadline)
+	{
+		NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys: @"Timed out waiting for the item to download.", NSLocalizedDescriptionKey, waiter.trackedURL, NSURLErrorKey, nil];
+		error = [NSError errorWithDomain: AZCoreRecordErrorDomain code: AZCoreRecordTimedOutError userInfo: userInfo];
+		state = AZCoreRecordItemFailed;
+	}
+	
+	if (state == AZCoreRecordItemPending)
+		return;
+	
+	[_waiters removeObjectForKey: waiter.trackedURL];
+	[self azcr_stopWatchingWithWaiter: waiter];
+	
+	BOOL success = (state == AZCoreRecordItemReady);
+	NSArray *completions = [waiter.completions copy];
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		for (void (^completion)(BOOL, NSError *) in completions)
+			completion(success, error);
+	});
+}
+
+- (void) azcr_stopWatchingWithWaiter: (AZCoreRecordDownloadWaiter *) waiter
+{
+	[NSFileCoordinator removeFilePresenter: waiter];
+	waiter.changeHandler = nil;
+	waiter.moveHandler = nil;
+	
+	if (waiter.directorySource)
+	{
+		dispatch_source_cancel(waiter.directorySource);
+		dispatch_release(waiter.directorySource);
+		waiter.directorySource = NULL;
+	}
+	
+	if (waiter.timer)
+	{
+		dispatch_source_cancel(waiter.timer);
+		dispatch_release(waiter.timer);
+		waiter.timer = NULL;
+	}
+}
+
+@end
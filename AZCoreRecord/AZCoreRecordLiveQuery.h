@@ -0,0 +1,86 @@
+//
+//  AZCoreRecordLiveQuery.h
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import <CoreData/CoreData.h>
+
+/** Indexes into the new objectIDs of rows that appeared, including rows
+ that moved. */
+extern NSString *const AZCoreRecordLiveQueryInsertedIndexesKey;
+
+/** Indexes into the previous objectIDs of rows that went away, including
+ rows that moved. */
+extern NSString *const AZCoreRecordLiveQueryDeletedIndexesKey;
+
+/** Indexes into the new objectIDs of rows that changed in place. */
+extern NSString *const AZCoreRecordLiveQueryUpdatedIndexesKey;
+
+extern NSString *const AZCoreRecordLiveQueryObjectIDsKey;
+
+@class AZCoreRecordLiveQuery;
+
+typedef void (^AZCoreRecordLiveQueryChangeBlock)(AZCoreRecordLiveQuery *query, NSDictionary *changes);
+
+/** A sorted, self-updating list of the object IDs matching a fetch request,
+ available on every platform.
+
+ After the initial fetch, saves to the coordinator and ubiquitous imports
+ are applied incrementally: the changed objects are fetched once, matched
+ against the request's predicate in memory, and moved to their new place
+ by binary search over the cached sort values. Changes arriving while a
+ pass is running are coalesced into the next one.
+
+ The change block is called on a private serial queue, never the main
+ queue, with the keys above; deletions apply to the previous list and
+ insertions to the new one, the same order a table view expects. Objects
+ tied on every sort descriptor are ordered by their object ID. The
+ request's fetch limit and offset are ignored.
+ */
+@interface AZCoreRecordLiveQuery : NSObject
+{
+@private
+	NSFetchRequest *_fetchRequest;
+	NSPersistentStoreCoordinator *_coordinator;
+	NSManagedObjectContext *_context;
+	NSArray *_sortKeyPaths;
+	NSArray *_valueDescriptors;
+	NSMutableArray *_objectIDs;
+	NSMutableDictionary *_sortValues;
+	NSArray *_publishedObjectIDs;
+	NSMutableSet *_pendingChanged;
+	NSMutableSet *_pendingDeleted;
+	BOOL _passScheduled;
+	BOOL _running;
+	dispatch_queue_t _queue;
+	dispatch_semaphore_t _semaphore;
+}
+
++ (AZCoreRecordLiveQuery *) liveQueryForRequest: (NSFetchRequest *) request;
++ (AZCoreRecordLiveQuery *) liveQueryForRequest: (NSFetchRequest *) request inContext: (NSManagedObjectContext *) context;
+
++ (AZCoreRecordLiveQuery *) liveQueryForEntity: (Class) entityClass sortedBy: (NSString *) sortTerm ascending: (BOOL) ascending predicate: (NSPredicate *) searchTerm;
++ (AZCoreRecordLiveQuery *) liveQueryForEntity: (Class) entityClass sortedBy: (NSString *) sortTerm ascending: (BOOL) ascending predicate: (NSPredicate *) searchTerm inContext: (NSManagedObjectContext *) context;
+
+/** The context is only used to find the coordinator; the query does its
+ own fetching on a private context. */
+- (id) initWithFetchRequest: (NSFetchRequest *) request inContext: (NSManagedObjectContext *) context;
+
+@property (nonatomic, readonly) NSFetchRequest *fetchRequest;
+
+@property (copy) AZCoreRecordLiveQueryChangeBlock changeBlock;
+
+/** The current results, as of the last change delivered. */
+@property (readonly) NSArray *objectIDs;
+
+/** Fetches synchronously and starts listening. The factories call this. */
+- (void) start;
+- (void) stop;
+
+/** Fetches everything again, reported as a full delete and insert. */
+- (void) refetch;
+
+@end
@@ -0,0 +1,496 @@
+//
+//  AZCoreRecordLiveQuery.m
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordLiveQuery.h"
+#import "AZCoreRecordManager.h"
+#import "NSManagedObject+AZCoreRecord.h"
+#import "NSManagedObjectContext+AZCoreRecord.h"
+
+NSString *const AZCoreRecordLiveQueryInsertedIndexesKey = @"AZCoreRecordLiveQueryInsertedIndexes";
+NSString *const AZCoreRecordLiveQueryDeletedIndexesKey = @"AZCoreRecordLiveQueryDeletedIndexes";
+NSString *const AZCoreRecordLiveQueryUpdatedIndexesKey = @"AZCoreRecordLiveQueryUpdatedIndexes";
+NSString *const AZCoreRecordLiveQueryObjectIDsKey = @"AZCoreRecordLiveQueryObjectIDs";
+
+static NSString *const azcr_objectIDKey = @"azcr_objectID";
+
+@implementation AZCoreRecordLiveQuery
+
+@synthesize fetchRequest = _fetchRequest, changeBlock = _changeBlock;
+
+#pragma mark - Factories
+
++ (AZCoreRecordLiveQuery *) liveQueryForRequest: (NSFetchRequest *) request
+{
+	return [self liveQueryForRequest: request inContext: nil];
+}
++ (AZCoreRecordLiveQuery *) liveQueryForRequest: (NSFetchRequest *) request inContext: (NSManagedObjectContext *) context
+{
+	AZCoreRecordLiveQuery *query = [[self alloc] initWithFetchRequest: request inContext: context];
+	[query start];
+	return query;
+}
+
++ (AZCoreRecordLiveQuery *) liveQueryForEntity: (Class) entityClass sortedBy: (NSString *) sortTerm ascending: (BOOL) ascending predicate: (NSPredicate *) searchTerm
+{
+	return [self liveQueryForEntity: entityClass sortedBy: sortTerm ascending: ascending predicate: searchTerm inContext: nil];
+}
++ (AZCoreRecordLiveQuery *) liveQueryForEntity: (Class) entityClass sortedBy: (NSString *) sortTerm ascending: (BOOL) ascending predicate: (NSPredicate *) searchTerm inContext: (NSManagedObjectContext *) context
+{
+	NSParameterAssert([entityClass isSubclassOfClass:[NSManagedObject class]]);
+	NSFetchRequest *request = [entityClass requestAllSortedBy: sortTerm ascending: ascending predicate: searchTerm inContext: context];
+	return [self liveQueryForRequest: request inContext: context];
+}
+
+#pragma mark - Lifecycle
+
+- (id) initWithFetchRequest: (NSFetchRequest *) request inContext: (NSManagedObjectContext *) context
+{
+	NSParameterAssert(request);
+	
+	if (!context)
+		context = [NSManagedObjectContext contextForCurrentThread];
+	
+	if ((self = [super init]))
+	{
+		_fetchRequest = [request copy];
+		if (!_fetchRequest.entity)
+			_fetchRequest.entity = [NSEntityDescription entityForName: request.entityName inManagedObjectContext: context];
+	
+		_coordinator = context.persistentStoreCoordinator;
+	
+		_context = [[NSManagedObjectContext alloc] initWithConcurrencyType: NSPrivateQueueConcurrencyType];
+		_context.persistentStoreCoordinator = _coordinator;
+		_context.undoManager = nil;
+		_context.stalenessInterval = 0;
+	
+		NSArray *sortDescriptors = _fetchRequest.sortDescriptors;
+		NSMutableArray *sortKeyPaths = [NSMutableArray arrayWithCapacity: sortDescriptors.count];
+		NSMutableArray *valueDescriptors = [NSMutableArray arrayWithCapacity: sortDescriptors.count];
+		for (NSSortDescriptor *descriptor in sortDescriptors)
+		{
+			// Cached values are compared directly, so each descriptor is
+			// rebuilt to look at the value itself rather than its key path.
+			[sortKeyPaths addObject: descriptor.key];
+			[valueDescriptors addObject: [NSSortDescriptor sortDescriptorWithKey: @"self" ascending: descriptor.ascending selector: descriptor.selector]];
+		}
+		_sortKeyPaths = sortKeyPaths;
+		_valueDescriptors = valueDescriptors;
+	
+		_objectIDs = [NSMutableArray array];
+		_sortValues = [NSMutableDictionary dictionary];
+		_publishedObjectIDs = [NSArray array];
+		_pendingChanged = [NSMutableSet set];
+		_pendingDeleted = [NSMutableSet set];
+	
+		_queue = dispatch_queue_create("com.AZCoreRecord.liveQuery", DISPATCH_QUEUE_SERIAL);
+		_semaphore = dispatch_semaphore_create(1);
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver: self];
+	
+	dispatch_release(_queue);
+	dispatch_release(_semaphore);
+}
+
+- (void) start
+{
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	BOOL running = _running;
+	_running = YES;
+	dispatch_semaphore_signal(_semaphore);
+	
+	if (running)
+		return;
+	
+	// Listen first so a save racing the initial fetch is applied after it
+	NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+	[center addObserver: self selector: @selector(azcr_contextDidSave:) name: NSManagedObjectContextDidSaveNotification object: nil];
+	[center addObserver: self selector: @selector(azcr_didImportUbiquitousChanges:) name: NSPersistentStoreDidImportUbiquitousContentChangesNotification object: _coordinator];
+	[center addObserver: self selector: @selector(azcr_didReattachUbiquitousStore:) name: AZCoreRecordManagerDidReattachUbiquitousStoreNotification object: nil];
+	
+	dispatch_sync(_queue, ^{
+		[self azcr_reloadObjectIDs];
+	});
+}
+
+- (void) stop
+{
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	_running = NO;
+	dispatch_semaphore_signal(_semaphore);
+	
+	[[NSNotificationCenter defaultCenter] removeObserver: self];
+}
+
+- (void) refetch
+{
+	dispatch_async(_queue, ^{
+		NSUInteger oldCount = _objectIDs.count;
+		[self azcr_reloadObjectIDs];
+	
+		NSIndexSet *deleted = [NSIndexSet indexSetWithIndexesInRange: NSMakeRange(0, oldCount)];
+		NSIndexSet *inserted = [NSIndexSet indexSetWithIndexesInRange: NSMakeRange(0, _objectIDs.count)];
+		[self azcr_deliverInserted: inserted deleted: deleted updated: [NSIndexSet indexSet]];
+	});
+}
+
+- (NSArray *) objectIDs
+{
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	NSArray *objectIDs = _publishedObjectIDs;
+	dispatch_semaphore_signal(_semaphore);
+	return objectIDs;
+}
+
+#pragma mark - Ordering
+
+- (NSComparisonResult) azcr_compareValues: (NSArray *) values objectID: (NSManagedObjectID *) objectID toValues: (NSArray *) otherValues objectID: (NSManagedObjectID *) otherID
+{
+	NSNull *null = [NSNull null];
+	
+	NSUInteger count = _valueDescriptors.count;
+	for (NSUInteger i = 0; i < count; i++)
+	{
+		NSSortDescriptor *descriptor = [_valueDescriptors objectAtIndex: i];
+		id value = [values objectAtIndex: i];
+		id otherValue = [otherValues objectAtIndex: i];
+	
+		// Like SQLite, nil sorts before everything else when ascending
+		NSComparisonResult result = NSOrderedSame;
+		if (value == null || otherValue == null)
+		{
+			if (value != otherValue)
+				result = ((value == null) == descriptor.ascending) ? NSOrderedAscending : NSOrderedDescending;
+		}
+		else
+		{
+			result = [descriptor compareObject: value toObject: otherValue];
+		}
+	
+		if (result != NSOrderedSame)
+			return result;
+	}
+	
+	if ([objectID isEqual: otherID])
+		return NSOrderedSame;
+	
+	return [objectID.URIRepresentation.absoluteString compare: otherID.URIRepresentation.absoluteString options: NSNumericSearch];
+}
+
+- (NSUInteger) azcr_indexForValues: (NSArray *) values objectID: (NSManagedObjectID *) objectID found: (BOOL *) found
+{
+	NSUInteger low = 0, high = _objectIDs.count;
+	
+	while (low < high)
+	{
+		NSUInteger middle = low + (high - low) / 2;
+		NSManagedObjectID *middleID = [_objectIDs objectAtIndex: middle];
+		NSComparisonResult result = [self azcr_compareValues: values objectID: objectID toValues: [_sortValues objectForKey: middleID] objectID: middleID];
+	
+		if (result == NSOrderedSame)
+		{
+			if (found)
+				*found = YES;
+			return middle;
+		}
+	
+		if (result == NSOrderedDescending)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	
+	if (found)
+		*found = NO;
+	return low;
+}
+
+- (void) azcr_sortObjectIDs
+{
+	[_objectIDs sortUsingComparator: ^NSComparisonResult(NSManagedObjectID *objectID, NSManagedObjectID *otherID) {
+		return [self azcr_compareValues: [_sortValues objectForKey: objectID] objectID: objectID toValues: [_sortValues objectForKey: otherID] objectID: otherID];
+	}];
+}
+
+- (NSArray *) azcr_sortValuesForObject: (id) object
+{
+	NSMutableArray *values = [NSMutableArray arrayWithCapacity: _sortKeyPaths.count];
+	for (NSString *keyPath in _sortKeyPaths)
+		[values addObject: [object valueForKeyPath: keyPath] ?: [NSNull null]];
+	return values;
+}
+
+#pragma mark - Fetching
+
+- (void) azcr_reloadObjectIDs
+{
+	NSExpressionDescription *objectIDDescription = [NSExpressionDescription new];
+	objectIDDescription.name = azcr_objectIDKey;
+	objectIDDescription.expression = [NSExpression expressionForEvaluatedObject];
+	objectIDDescription.expressionResultType = NSObjectIDAttributeType;
+	
+	NSFetchRequest *request = [NSFetchRequest new];
+	request.entity = _fetchRequest.entity;
+	request.predicate = _fetchRequest.predicate;
+	request.includesSubentities = _fetchRequest.includesSubentities;
+	request.resultType = NSDictionaryResultType;
+	request.propertiesToFetch = [[NSArray arrayWithObject: objectIDDescription] arrayByAddingObjectsFromArray: _sortKeyPaths];
+	
+	__block NSArray *rows = nil;
+	[_context performBlockAndWait: ^{
+		NSError *error = nil;
+		rows = [_context executeFetchRequest: request error: &error];
+		[AZCoreRecordManager handleError: error];
+	}];
+	
+	[_objectIDs removeAllObjects];
+	[_sortValues removeAllObjects];
+	
+	// Rows only carry values, so a missing key is a nil attribute
+	NSNull *null = [NSNull null];
+	for (NSDictionary *row in rows)
+	{
+		NSManagedObjectID *objectID = [row objectForKey: azcr_objectIDKey];
+		NSMutableArray *values = [NSMutableArray arrayWithCapacity: _sortKeyPaths.count];
+		for (NSString *keyPath in _sortKeyPaths)
+			[values addObject: [row objectForKey: keyPath] ?: null];
+	
+		[_objectIDs addObject: objectID];
+		[_sortValues setObject: values forKey: objectID];
+	}
+	
+	// Re-sort so ties land in the same order binary search expects
+	[self azcr_sortObjectIDs];
+	
+	NSArray *objectIDs = [_objectIDs copy];
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	_publishedObjectIDs = objectIDs;
+	dispatch_semaphore_signal(_semaphore);
+}
+
+- (NSDictionary *) azcr_sortValuesForMatchingObjectIDs: (NSSet *) objectIDs
+{
+	if (!objectIDs.count)
+		return [NSDictionary dictionary];
+	
+	NSMutableDictionary *matches = [NSMutableDictionary dictionaryWithCapacity: objectIDs.count];
+	NSPredicate *predicate = _fetchRequest.predicate;
+	
+	[_context performBlockAndWait: ^{
+		NSFetchRequest *request = [NSFetchRequest new];
+		request.entity = _fetchRequest.entity;
+		request.predicate = [NSPredicate predicateWithFormat: @"self IN %@", objectIDs];
+		request.returnsObjectsAsFaults = NO;
+	
+		NSError *error = nil;
+		NSArray *objects = [_context executeFetchRequest: request error: &error];
+		[AZCoreRecordManager handleError: error];
+	
+		for (NSManagedObject *object in objects)
+		{
+			if (predicate && ![predicate evaluateWithObject: object])
+				continue;
+	
+			[matches setObject: [self azcr_sortValuesForObject: object] forKey: object.objectID];
+		}
+	
+		[_context reset];
+	}];
+	
+	return matches;
+}
+
+#pragma mark - Incremental Updates
+
+- (BOOL) azcr_tracksEntity: (NSEntityDescription *) entity
+{
+	NSEntityDescription *trackedEntity = _fetchRequest.entity;
+	if (_fetchRequest.includesSubentities)
+		return [entity isKindOfEntity: trackedEntity];
+	
+	return [entity.name isEqualToString: trackedEntity.name];
+}
+
+- (void) azcr_enqueueChanges: (NSDictionary *) userInfo
+{
+	NSMutableSet *changed = [NSMutableSet set];
+	NSMutableSet *deleted = [NSMutableSet set];
+	
+	// Saves list objects and imports list IDs; only the IDs leave this thread
+	void (^collect)(NSString *, NSMutableSet *) = ^(NSString *key, NSMutableSet *objectIDs) {
+		for (id object in [userInfo objectForKey: key])
+		{
+			NSManagedObjectID *objectID = [object isKindOfClass: [NSManagedObjectID class]] ? object : [object objectID];
+			if ([self azcr_tracksEntity: objectID.entity])
+				[objectIDs addObject: objectID];
+		}
+	};
+	
+	collect(NSInsertedObjectsKey, changed);
+	collect(NSUpdatedObjectsKey, changed);
+	collect(NSDeletedObjectsKey, deleted);
+	collect(NSInvalidatedObjectsKey, deleted);
+	
+	if (!changed.count && !deleted.count)
+		return;
+	
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	
+	BOOL schedule = _running && !_passScheduled;
+	if (_running)
+	{
+		[_pendingChanged unionSet: changed];
+		[_pendingDeleted unionSet: deleted];
+		_passScheduled = YES;
+	}
+	
+	dispatch_semaphore_signal(_semaphore);
+	
+	if (schedule)
+		dispatch_async(_queue, ^{
+			[self azcr_applyPendingChanges];
+		});
+}
+
+- (void) azcr_applyPendingChanges
+{
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	NSMutableSet *changed = _pendingChanged;
+	NSSet *deleted = _pendingDeleted;
+	_pendingChanged = [NSMutableSet set];
+	_pendingDeleted = [NSMutableSet set];
+	_passScheduled = NO;
+	dispatch_semaphore_signal(_semaphore);
+	
+	[changed minusSet: deleted];
+	
+	// One round trip for everything that changed in this batch
+	NSDictionary *newValues = [self azcr_sortValuesForMatchingObjectIDs: changed];
+	
+	NSMutableSet *candidates = [changed mutableCopy];
+	[candidates unionSet: deleted];
+	
+	NSMutableIndexSet *deletedIndexes = [NSMutableIndexSet indexSet];
+	NSMutableArray *reinserted = [NSMutableArray array];
+	NSMutableArray *updatedInPlace = [NSMutableArray array];
+	
+	for (NSManagedObjectID *objectID in candidates)
+	{
+		NSArray *oldValues = [_sortValues objectForKey: objectID];
+		NSArray *values = [newValues objectForKey: objectID];
+	
+		if (oldValues)
+		{
+			if (values && [values isEqualToArray: oldValues])
+			{
+				[updatedInPlace addObject: objectID];
+				continue;
+			}
+	
+			BOOL found = NO;
+			NSUInteger index = [self azcr_indexForValues: oldValues objectID: objectID found: &found];
+			if (found)
+				[deletedIndexes addIndex: index];
+		}
+	
+		if (values)
+			[reinserted addObject: objectID];
+	}
+	
+	[_sortValues removeObjectsForKeys: [_objectIDs objectsAtIndexes: deletedIndexes]];
+	[_objectIDs removeObjectsAtIndexes: deletedIndexes];
+	
+	for (NSManagedObjectID *objectID in reinserted)
+		[_sortValues setObject: [newValues objectForKey: objectID] forKey: objectID];
+	
+	// Each insertion shifts the tail of the array; past a point one sort
+	// of the whole list is cheaper than many binary-searched insertions.
+	if (reinserted.count * 16 > _objectIDs.count)
+	{
+		[_objectIDs addObjectsFromArray: reinserted];
+		[self azcr_sortObjectIDs];
+	}
+	else
+	{
+		for (NSManagedObjectID *objectID in reinserted)
+		{
+			NSUInteger index = [self azcr_indexForValues: [_sortValues objectForKey: objectID] objectID: objectID found: NULL];
+			[_objectIDs insertObject: objectID atIndex: index];
+		}
+	}
+	
+	// Final positions are only known once every insertion has landed
+	NSMutableIndexSet *insertedIndexes = [NSMutableIndexSet indexSet];
+	for (NSManagedObjectID *objectID in reinserted)
+		[insertedIndexes addIndex: [self azcr_indexForValues: [_sortValues objectForKey: objectID] objectID: objectID found: NULL]];
+	
+	NSMutableIndexSet *updatedIndexes = [NSMutableIndexSet indexSet];
+	for (NSManagedObjectID *objectID in updatedInPlace)
+		[updatedIndexes addIndex: [self azcr_indexForValues: [_sortValues objectForKey: objectID] objectID: objectID found: NULL]];
+	
+	if (!insertedIndexes.count && !deletedIndexes.count && !updatedIndexes.count)
+		return;
+	
+	[self azcr_deliverInserted: insertedIndexes deleted: deletedIndexes updated: updatedIndexes];
+}
+
+- (void) azcr_deliverInserted: (NSIndexSet *) inserted deleted: (NSIndexSet *) deleted updated: (NSIndexSet *) updated
+{
+	NSArray *objectIDs = [_objectIDs copy];
+	
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	_publishedObjectIDs = objectIDs;
+	dispatch_semaphore_signal(_semaphore);
+	
+	AZCoreRecordLiveQueryChangeBlock changeBlock = self.changeBlock;
+	if (!changeBlock)
+		return;
+	
+	NSDictionary *changes = [NSDictionary dictionaryWithObjectsAndKeys:
+							 inserted, AZCoreRecordLiveQueryInsertedIndexesKey,
+							 deleted, AZCoreRecordLiveQueryDeletedIndexesKey,
+							 updated, AZCoreRecordLiveQueryUpdatedIndexesKey,
+							 objectIDs, AZCoreRecordLiveQueryObjectIDsKey, nil];
+	changeBlock(self, changes);
+}
+
+#pragma mark - Notifications
+
+- (void) azcr_contextDidSave: (NSNotification *) note
+{
+	// Only saves that reach the store; a child's save shows up again when
+	// its parent saves.
+	NSManagedObjectContext *context = note.object;
+	if (context == _context || context.parentContext || context.persistentStoreCoordinator != _coordinator)
+		return;
+	
+	[self azcr_enqueueChanges: note.userInfo];
+}
+
+- (void) azcr_didImportUbiquitousChanges: (NSNotification *) note
+{
+	[self azcr_enqueueChanges: note.userInfo];
+}
+
+- (void) azcr_didReattachUbiquitousStore: (NSNotification *) note
+{
+	AZCoreRecordManager *manager = note.object;
+	if (manager.persistentStoreCoordinator != _coordinator)
+		return;
+	
+	NSSet *entityNames = [note.userInfo objectForKey: AZCoreRecordInvalidatedEntityNamesKey];
+	if (!entityNames || [entityNames containsObject: _fetchRequest.entity.name])
+		[self refetch];
+}
+
+@end
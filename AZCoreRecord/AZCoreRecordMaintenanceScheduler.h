@@ -0,0 +1,88 @@
+//
+//  AZCoreRecordMaintenanceScheduler.h
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import <CoreData/CoreData.h>
+
+@class AZCoreRecordManager;
+
+extern NSString *const AZCoreRecordManagerDidMaintainStoresNotification;
+
+extern NSString *const AZCoreRecordMaintenanceStoresKey;
+extern NSString *const AZCoreRecordMaintenanceStoreURLKey;
+extern NSString *const AZCoreRecordMaintenanceReclaimedBytesKey;
+extern NSString *const AZCoreRecordMaintenanceDurationKey;
+
+/** Keeps the SQLite files behind a manager's stack in shape.
+
+ Each pass opens a store on a private coordinator with `ANALYZE`, a
+ truncating WAL checkpoint, and an incremental vacuum, then closes it again.
+ Passes run on a background-priority queue once the stack has gone
+ `idleDelay` seconds without a save, and only for stores that are due. The
+ checkpoint only truncates the log when no other connection is reading it,
+ so reclaimed bytes are measured rather than assumed.
+
+ Full vacuums rewrite the whole file, which mustn't happen behind the live
+ coordinator's back; they run as the manager attaches a store that is due.
+ Each store's history is kept under the manager's stack name and the
+ store's path relative to the store directory.
+
+ Incremental vacuum only frees pages in stores created (or fully vacuumed)
+ with `auto_vacuum` set to incremental; see AZCoreRecordSQLiteOptions.
+ The ubiquitous store is left alone, since its file belongs to the
+ ubiquity system.
+ */
+@interface AZCoreRecordMaintenanceScheduler : NSObject
+{
+@private
+	__weak AZCoreRecordManager *_manager;
+	__weak NSPersistentStoreCoordinator *_coordinator;
+	dispatch_queue_t _queue;
+	dispatch_source_t _idleTimer;
+	BOOL _enabled;
+	NSTimeInterval _idleDelay;
+	NSTimeInterval _minimumInterval;
+	NSTimeInterval _fullVacuumInterval;
+	unsigned long long _checkpointThreshold;
+	NSUInteger _incrementalVacuumPageCount;
+	BOOL _analyzesStatistics;
+}
+
+- (id) initWithManager: (AZCoreRecordManager *) manager;
+
+/** Automatic passes are off until this is set. Defaults to NO. */
+@property (nonatomic, getter = isEnabled) BOOL enabled;
+
+/** Quiet time after the last save before a pass may start. Defaults to 30 seconds. */
+@property (nonatomic) NSTimeInterval idleDelay;
+
+/** Minimum time between passes over one store. Defaults to one day. */
+@property (nonatomic) NSTimeInterval minimumInterval;
+
+/** Minimum time between full vacuums; 0 never runs one. A store found due
+ is vacuumed the next time the manager attaches it. Defaults to 0. */
+@property (nonatomic) NSTimeInterval fullVacuumInterval;
+
+/** A write-ahead log larger than this makes a store due regardless of
+ minimumInterval. Defaults to 4 MiB. */
+@property (nonatomic) unsigned long long checkpointThreshold;
+
+/** Free pages returned per pass. Defaults to 1024. */
+@property (nonatomic) NSUInteger incrementalVacuumPageCount;
+
+/** Defaults to YES. */
+@property (nonatomic) BOOL analyzesStatistics;
+
+/** Runs a pass over every store now, due or not. The report is the user
+ info of AZCoreRecordManagerDidMaintainStoresNotification. */
+- (void) runMaintenanceWithCompletion: (void (^)(NSDictionary *report)) completion;
+
+/** The options to attach a store with, with a full vacuum added when one is
+ due. The manager calls this for each SQLite store it owns. */
+- (NSDictionary *) storeOptions: (NSDictionary *) options forAttachingStoreAtURL: (NSURL *) URL;
+
+@end
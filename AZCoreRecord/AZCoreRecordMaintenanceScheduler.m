@@ -0,0 +1,311 @@
+//
+//  AZCoreRecordMaintenanceScheduler.m
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordMaintenanceScheduler.h"
+#import "AZCoreRecordManager.h"
+
+NSString *const AZCoreRecordManagerDidMaintainStoresNotification = @"AZCoreRecordManagerDidMaintainStoresNotification";
+
+NSString *const AZCoreRecordMaintenanceStoresKey = @"AZCoreRecordMaintenanceStores";
+NSString *const AZCoreRecordMaintenanceStoreURLKey = @"AZCoreRecordMaintenanceStoreURL";
+NSString *const AZCoreRecordMaintenanceReclaimedBytesKey = @"AZCoreRecordMaintenanceReclaimedBytes";
+NSString *const AZCoreRecordMaintenanceDurationKey = @"AZCoreRecordMaintenanceDuration";
+
+static NSString *const AZCoreRecordMaintenanceHistoryDefaultsKey = @"AZCoreRecordMaintenanceHistory";
+static NSString *const AZCoreRecordMaintenanceLastPassKey = @"lastPass";
+static NSString *const AZCoreRecordMaintenanceLastFullVacuumKey = @"lastFullVacuum";
+
+static void *azcr_maintenanceQueueKey = &azcr_maintenanceQueueKey;
+
+static unsigned long long azcr_fileSize(NSString *path)
+{
+	return [[[[NSFileManager new] attributesOfItemAtPath: path error: NULL] objectForKey: NSFileSize] unsignedLongLongValue];
+}
+
+@interface AZCoreRecordMaintenanceScheduler ()
+
+- (void) azcr_contextDidSave: (NSNotification *) note;
+- (void) azcr_stackDidChange: (NSNotification *) note;
+- (void) azcr_runPassForcingAll: (BOOL) force completion: (void (^)(NSDictionary *report)) completion;
+
+@end
+
+@implementation AZCoreRecordMaintenanceScheduler
+
+@synthesize idleDelay = _idleDelay, minimumInterval = _minimumInterval, fullVacuumInterval = _fullVacuumInterval;
+@synthesize checkpointThreshold = _checkpointThreshold, incrementalVacuumPageCount = _incrementalVacuumPageCount, analyzesStatistics = _analyzesStatistics;
+
+- (id) initWithManager: (AZCoreRecordManager *) manager
+{
+	NSParameterAssert(manager);
+	
+	if ((self = [super init]))
+	{
+		_manager = manager;
+		_queue = dispatch_queue_create("com.AZCoreRecord.maintenance", DISPATCH_QUEUE_SERIAL);
+		dispatch_set_target_queue(_queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+		dispatch_queue_set_specific(_queue, azcr_maintenanceQueueKey, (__bridge void *) self, NULL);
+		
+		_idleDelay = 30.0;
+		_minimumInterval = 24.0 * 60.0 * 60.0;
+		_checkpointThreshold = 4 * 1024 * 1024;
+		_incrementalVacuumPageCount = 1024;
+		_analyzesStatistics = YES;
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver: self];
+	if (_idleTimer)
+	{
+		dispatch_source_cancel(_idleTimer);
+		dispatch_release(_idleTimer);
+	}
+	dispatch_release(_queue);
+}
+
+#pragma mark - Scheduling
+
+- (void) azcr_performSync: (dispatch_block_t) block
+{
+	// Callbacks and notifications from a pass arrive on the queue already
+	if (dispatch_get_specific(azcr_maintenanceQueueKey) == (__bridge void *) self)
+		block();
+	else
+		dispatch_sync(_queue, block);
+}
+
+- (BOOL) isEnabled
+{
+	return _enabled;
+}
+
+- (void) setEnabled: (BOOL) enabled
+{
+	[self azcr_performSync: ^{
+		if (_enabled == enabled)
+			return;
+		
+		_enabled = enabled;
+		
+		if (enabled)
+		{
+			_idleTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+			dispatch_source_set_timer(_idleTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_idleDelay * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, NSEC_PER_SEC);
+			
+			__weak AZCoreRecordMaintenanceScheduler *weakSelf = self;
+			dispatch_source_set_event_handler(_idleTimer, ^{
+				[weakSelf azcr_runPassForcingAll: NO completion: nil];
+			});
+			dispatch_resume(_idleTimer);
+			
+			// Saves are matched against the coordinator captured here and
+			// after each load, never by asking the manager, which would
+			// build its stack.
+			AZCoreRecordManager *manager = _manager;
+			_coordinator = manager.isStackReady ? manager.persistentStoreCoordinator : nil;
+			
+			NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+			[nc addObserver: self selector: @selector(azcr_contextDidSave:) name: NSManagedObjectContextDidSaveNotification object: nil];
+			[nc addObserver: self selector: @selector(azcr_stackDidChange:) name: AZCoreRecordManagerDidFinishAdddingPersistentStoresNotification object: manager];
+			[nc addObserver: self selector: @selector(azcr_stackDidChange:) name: AZCoreRecordManagerDidReplaceStackNotification object: manager];
+		}
+		else
+		{
+			[[NSNotificationCenter defaultCenter] removeObserver: self];
+			dispatch_source_cancel(_idleTimer);
+			dispatch_release(_idleTimer);
+			_idleTimer = NULL;
+			_coordinator = nil;
+		}
+	}];
+}
+
+- (void) azcr_contextDidSave: (NSNotification *) note
+{
+	NSManagedObjectContext *context = note.object;
+	if (context.parentContext)
+		return;
+	
+	// Every write to disk pushes the next pass back by the idle delay
+	NSPersistentStoreCoordinator *coordinator = context.persistentStoreCoordinator;
+	dispatch_async(_queue, ^{
+		if (_idleTimer && coordinator == _coordinator)
+			dispatch_source_set_timer(_idleTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_idleDelay * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, NSEC_PER_SEC);
+	});
+}
+
+- (void) azcr_stackDidChange: (NSNotification *) note
+{
+	// Both are posted once the manager's coordinator exists, so this never
+	// builds the stack.
+	NSPersistentStoreCoordinator *coordinator = _manager.persistentStoreCoordinator;
+	dispatch_async(_queue, ^{
+		if (_idleTimer)
+			_coordinator = coordinator;
+	});
+}
+
+- (void) runMaintenanceWithCompletion: (void (^)(NSDictionary *report)) completion
+{
+	dispatch_async(_queue, ^{
+		[self azcr_runPassForcingAll: YES completion: completion];
+	});
+}
+
+#pragma mark - History
+
+- (NSString *) azcr_historyKeyForStoreURL: (NSURL *) URL
+{
+	// Relative to the store directory, so the history survives the
+	// container moving between launches or devices, and under the stack's
+	// name, since every stack has a LocalStore.sqlite of its own.
+	AZCoreRecordManager *manager = _manager;
+	NSString *directory = [[manager.localStoreURL.URLByDeletingLastPathComponent URLByResolvingSymlinksInPath] path];
+	NSString *path = [[URL URLByResolvingSymlinksInPath] path];
+	
+	if (directory.length && [path hasPrefix: [directory stringByAppendingString: @"/"]])
+		path = [path substringFromIndex: directory.length + 1];
+	
+	return [NSString stringWithFormat: @"%@:%@", manager.stackName, path];
+}
+
+- (NSDictionary *) storeOptions: (NSDictionary *) options forAttachingStoreAtURL: (NSURL *) URL
+{
+	if (self.fullVacuumInterval <= 0 || !URL)
+		return options;
+	
+	__block NSDictionary *result = options;
+	
+	[self azcr_performSync: ^{
+		NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+		NSMutableDictionary *history = [NSMutableDictionary dictionaryWithDictionary: [defaults dictionaryForKey: AZCoreRecordMaintenanceHistoryDefaultsKey]];
+		NSString *key = [self azcr_historyKeyForStoreURL: URL];
+		NSMutableDictionary *entry = [NSMutableDictionary dictionaryWithDictionary: [history objectForKey: key]];
+		NSDate *lastFullVacuum = [entry objectForKey: AZCoreRecordMaintenanceLastFullVacuumKey];
+		NSDate *now = [NSDate date];
+		
+		if (lastFullVacuum && [now timeIntervalSinceDate: lastFullVacuum] < self.fullVacuumInterval)
+			return;
+		
+		// A new store has nothing to vacuum; start its clock instead
+		if (lastFullVacuum || [[NSFileManager new] fileExistsAtPath: URL.path])
+		{
+			NSMutableDictionary *vacuumOptions = [NSMutableDictionary dictionaryWithDictionary: options];
+			[vacuumOptions setObject: (__bridge id) kCFBooleanTrue forKey: NSSQLiteManualVacuumOption];
+			result = vacuumOptions;
+		}
+		
+		[entry setObject: now forKey: AZCoreRecordMaintenanceLastFullVacuumKey];
+		[history setObject: entry forKey: key];
+		[defaults setObject: history forKey: AZCoreRecordMaintenanceHistoryDefaultsKey];
+	}];
+	
+	return result;
+}
+
+#pragma mark - Maintenance
+
+- (NSDictionary *) azcr_maintainStore: (NSPersistentStore *) store
+{
+	NSString *path = store.URL.path;
+	NSString *walPath = [path stringByAppendingString: @"-wal"];
+	unsigned long long sizeBefore = azcr_fileSize(path) + azcr_fileSize(walPath);
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	
+	// Keep the store's own pragmas (a differing journal mode would fail
+	// while the live coordinator has the file open) and add the work.
+	NSMutableDictionary *pragmas = [NSMutableDictionary dictionaryWithDictionary: [store.options objectForKey: NSSQLitePragmasOption]];
+	[pragmas setObject: @"TRUNCATE" forKey: @"wal_checkpoint"];
+	if (self.incrementalVacuumPageCount)
+		[pragmas setObject: [NSString stringWithFormat: @"%lu", (unsigned long) self.incrementalVacuumPageCount] forKey: @"incremental_vacuum"];
+	
+	NSMutableDictionary *options = [NSMutableDictionary dictionaryWithObject: pragmas forKey: NSSQLitePragmasOption];
+	if (self.analyzesStatistics)
+		[options setObject: (__bridge id) kCFBooleanTrue forKey: NSSQLiteAnalyzeOption];
+	
+	@autoreleasepool {
+		NSPersistentStoreCoordinator *coordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: store.persistentStoreCoordinator.managedObjectModel];
+		NSError *error = nil;
+		NSPersistentStore *maintainedStore = [coordinator addPersistentStoreWithType: NSSQLiteStoreType configuration: store.configurationName URL: store.URL options: options error: &error];
+		[AZCoreRecordManager handleError: error];
+		
+		if (maintainedStore)
+			[coordinator removePersistentStore: maintainedStore error: NULL];
+	}
+	
+	unsigned long long sizeAfter = azcr_fileSize(path) + azcr_fileSize(walPath);
+	unsigned long long reclaimed = sizeBefore > sizeAfter ? sizeBefore - sizeAfter : 0;
+	
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+			store.URL, AZCoreRecordMaintenanceStoreURLKey,
+			[NSNumber numberWithUnsignedLongLong: reclaimed], AZCoreRecordMaintenanceReclaimedBytesKey,
+			[NSNumber numberWithDouble: CFAbsoluteTimeGetCurrent() - start], AZCoreRecordMaintenanceDurationKey, nil];
+}
+
+- (void) azcr_runPassForcingAll: (BOOL) force completion: (void (^)(NSDictionary *report)) completion
+{
+	AZCoreRecordManager *manager = _manager;
+	if (!manager.isStackReady)
+	{
+		if (completion)
+			dispatch_async(dispatch_get_main_queue(), ^{ completion(nil); });
+		return;
+	}
+	
+	NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+	NSMutableDictionary *history = [NSMutableDictionary dictionaryWithDictionary: [defaults dictionaryForKey: AZCoreRecordMaintenanceHistoryDefaultsKey]];
+	NSDate *now = [NSDate date];
+	
+	NSMutableArray *storeReports = [NSMutableArray array];
+	unsigned long long totalReclaimed = 0;
+	NSTimeInterval totalDuration = 0;
+	
+	for (NSPersistentStore *store in manager.persistentStoreCoordinator.persistentStores)
+	{
+		if (![store.type isEqualToString: NSSQLiteStoreType] || !store.URL || store.isReadOnly || [store.options objectForKey: NSPersistentStoreUbiquitousContentNameKey])
+			continue;
+		
+		NSString *path = store.URL.path;
+		NSString *key = [self azcr_historyKeyForStoreURL: store.URL];
+		NSMutableDictionary *entry = [NSMutableDictionary dictionaryWithDictionary: [history objectForKey: key]];
+		NSDate *lastPass = [entry objectForKey: AZCoreRecordMaintenanceLastPassKey];
+		
+		BOOL due = force || !lastPass || [now timeIntervalSinceDate: lastPass] >= self.minimumInterval;
+		if (!due && self.checkpointThreshold)
+			due = azcr_fileSize([path stringByAppendingString: @"-wal"]) >= self.checkpointThreshold;
+		if (!due)
+			continue;
+		
+		NSDictionary *report = [self azcr_maintainStore: store];
+		[storeReports addObject: report];
+		totalReclaimed += [[report objectForKey: AZCoreRecordMaintenanceReclaimedBytesKey] unsignedLongLongValue];
+		totalDuration += [[report objectForKey: AZCoreRecordMaintenanceDurationKey] doubleValue];
+		
+		[entry setObject: now forKey: AZCoreRecordMaintenanceLastPassKey];
+		[history setObject: entry forKey: key];
+	}
+	
+	[defaults setObject: history forKey: AZCoreRecordMaintenanceHistoryDefaultsKey];
+	
+	NSDictionary *report = [NSDictionary dictionaryWithObjectsAndKeys:
+							storeReports, AZCoreRecordMaintenanceStoresKey,
+							[NSNumber numberWithUnsignedLongLong: totalReclaimed], AZCoreRecordMaintenanceReclaimedBytesKey,
+							[NSNumber numberWithDouble: totalDuration], AZCoreRecordMaintenanceDurationKey, nil];
+	
+	if (storeReports.count)
+		[[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordManagerDidMaintainStoresNotification object: manager userInfo: report];
+	
+	if (completion)
+		dispatch_async(dispatch_get_main_queue(), ^{ completion(report); });
+}
+
+@end
@@ -9,12 +9,51 @@
 
 #import <CoreData/CoreData.h>
 
+@class AZCoreRecordSQLiteOptions, AZCoreRecordStoreShard, AZCoreRecordMaintenanceScheduler, AZCoreRecordDeduplicator, AZCoreRecordChangeJournal;
+
 extern NSString *const AZCoreRecordManagerWillAddUbiquitousStoreNotification;
 extern NSString *const AZCoreRecordManagerDidAddUbiquitousStoreNotification;
 extern NSString *const AZCoreRecordManagerDidAddFallbackStoreNotification;
 extern NSString *const AZCoreRecordManagerDidFinishAdddingPersistentStoresNotification;
 extern NSString *const AZCoreRecordManagerShouldRunDeduplicationNotification;
+extern NSString *const AZCoreRecordDeduplicationEntityNamesKey;
 extern NSString *const AZCoreRecordDidFinishSeedingPersistentStoreNotification;
+extern NSString *const AZCoreRecordManagerDidReplaceStackNotification;
+extern NSString *const AZCoreRecordManagerDidReattachUbiquitousStoreNotification;
+extern NSString *const AZCoreRecordInvalidatedEntityNamesKey;
+extern NSString *const AZCoreRecordManagerWillMigrateStoresNotification;
+extern NSString *const AZCoreRecordManagerMigrationProgressNotification;
+extern NSString *const AZCoreRecordManagerDidMigrateStoresNotification;
+
+extern NSString *const AZCoreRecordMigrationProgressKey;
+
+extern NSString *const AZCoreRecordManagerDidSeedLocalStoreNotification;
+
+/** @"clone" when the file system made a copy-on-write clone, @"copy" when
+ the data had to be copied. */
+extern NSString *const AZCoreRecordSeedMethodKey;
+extern NSString *const AZCoreRecordSeedCopyDurationKey;
+extern NSString *const AZCoreRecordSeedAttachDurationKey;
+extern NSString *const AZCoreRecordSeedIntegrityCheckDurationKey;
+
+/** Whether `PRAGMA quick_check` found the seeded store intact and its
+ metadata matches the model. The check runs on its own read-only
+ connection after the store is attached. */
+extern NSString *const AZCoreRecordSeedIntegrityCheckPassedKey;
+
+/** The rows `PRAGMA quick_check` returned, joined by newlines; @"ok" when
+ the store is intact. */
+extern NSString *const AZCoreRecordSeedIntegrityCheckResultKey;
+
+extern NSString *const AZCoreRecordErrorDomain;
+
+enum {
+	AZCoreRecordInvalidConfigurationError = 1,
+	AZCoreRecordTimedOutError = 2,
+	/** Objects with unsaved edits whose store was swapped out from under
+	 them; they're listed under NSAffectedObjectsErrorKey, edits intact. */
+	AZCoreRecordUnsavedChangesError = 3
+};
 
 extern NSString *const AZCoreRecordLocalStoreConfigurationNameKey;
 extern NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey;
@@ -37,14 +76,51 @@ extern NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey;
 	BOOL _stackShouldAutoMigrate;
 	BOOL _stackShouldUseUbiquity;
 	BOOL _stackShouldUseInMemoryStore;
+	BOOL _stackShouldMigrateInBackground;
 	NSString *_stackName;
 	NSString *_stackModelName;
 	NSURL *_stackModelURL;
 	NSDictionary *_stackModelConfigurations;
+	AZCoreRecordSQLiteOptions *_stackSQLiteOptions;
+	NSArray *_stackStoreShards;
 	
 	NSManagedObjectContext *_managedObjectContext;
 	NSPersistentStoreCoordinator *_persistentStoreCoordinator;
+	NSPersistentStoreCoordinator *_pendingPersistentStoreCoordinator;
+	NSPersistentStore *_syncedStore;
 	NSString *_ubiquityToken;
+	
+	NSMutableSet *_threadContexts;
+	NSUInteger _threadContextObjectLimit;
+	NSTimeInterval _threadContextIdleInterval;
+	volatile int64_t _reclaimedObjectCount;
+	dispatch_source_t _idleTimer;
+	dispatch_source_t _memoryPressureSource;
+	NSSet *_invalidatedEntityNames;
+	NSUInteger _invalidationGeneration;
+	
+	char _queueContextKey;
+	
+	dispatch_semaphore_t _stackSemaphore;
+	dispatch_queue_t _readyQueue;
+	volatile int32_t _stackReady;
+	
+	NSUInteger _stackReadReplicaCount;
+	NSTimeInterval _stackReadReplicaStaleness;
+	BOOL _stackShouldRouteBackgroundReads;
+	NSArray *_readReplicaContexts;
+	NSSet *_readReplicaEntityNames;
+	NSUInteger _nextReadReplica;
+	
+	dispatch_semaphore_t _layoutSemaphore;
+	NSURL *_stackStoreURL;
+	NSURL *_ubiquitousStoreDirectoryURL;
+	NSURL *_ubiquityContainerURL;
+	BOOL _ubiquityContainerResolved;
+	
+	AZCoreRecordMaintenanceScheduler *_maintenanceScheduler;
+	AZCoreRecordDeduplicator *_deduplicator;
+	AZCoreRecordChangeJournal *_changeJournal;
 }
 
 - (id)initWithStackName: (NSString *) name;
@@ -56,15 +132,73 @@ extern NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey;
 @property (nonatomic, strong, readonly) NSManagedObjectContext *managedObjectContext;
 @property (nonatomic, strong, readonly) NSPersistentStoreCoordinator *persistentStoreCoordinator;
 @property (nonatomic, strong, readonly) NSString *ubiquityToken;
-
+@property (nonatomic, readonly, getter = isStackReady) BOOL stackReady;
+
+/** Builds the stack on a background queue. Until it is built, touching
+ managedObjectContext or persistentStoreCoordinator from any thread,
+ the main thread included, blocks until the local stores are attached; wait
+ for the completion (or whenReady:) before touching the stack from the main
+ thread. */
+- (void)loadStackWithCompletion: (void (^)(void)) completion;
+- (void)whenReady: (void (^)(void)) block;
+
+/** A private-queue child of the main context, one per thread; use it
+ through performBlock: or performBlockAndWait:. */
 - (NSManagedObjectContext *)contextForCurrentThread;
 
+/** Returns nil for global queues, which can't own a context. */
+- (NSManagedObjectContext *)contextForQueue: (dispatch_queue_t) queue;
+
+/** Runs the block synchronously in the context of `queue`, which must be a
+ serial queue; a global queue raises an exception. */
+- (void)performWithContextForQueue: (dispatch_queue_t) queue block: (void (^)(NSManagedObjectContext *context)) block;
+
+/** Same as above for the queue the caller is running on. */
+- (void)performWithQueueContext: (void (^)(NSManagedObjectContext *context)) block;
+
+#pragma mark - Thread context memory
+
+@property (nonatomic) NSUInteger threadContextObjectLimit;
+/** A thread context left alone this long is reset on its own queue, even
+ if its thread never asks for it again; one with unsaved changes only has
+ its unchanged objects turned back into faults. */
+@property (nonatomic) NSTimeInterval threadContextIdleInterval;
+@property (nonatomic, readonly) NSUInteger reclaimedObjectCount;
+
+/** Turns the unchanged objects of every thread context back into faults.
+ Called on memory warnings on iOS and on VM pressure on OS X. */
+- (void) reclaimThreadContextMemory;
+
+#pragma mark - Read replicas
+
+@property (nonatomic) NSUInteger stackReadReplicaCount;
+@property (nonatomic) NSTimeInterval stackReadReplicaStaleness;
+@property (nonatomic) BOOL stackShouldRouteBackgroundReads;
+
+- (NSManagedObjectContext *)readReplicaContext;
+
+/** Return nil and NSNotFound respectively unless routing is on, the caller
+ is off the main thread, and the request's entity lives only in stores the
+ replicas mirror. */
+- (NSArray *)objectIDsForFetchRequestOnReadReplica: (NSFetchRequest *) request;
+- (NSUInteger)countForFetchRequestOnReadReplica: (NSFetchRequest *) request;
+
+#pragma mark - Store maintenance
+
+@property (nonatomic, strong, readonly) AZCoreRecordMaintenanceScheduler *maintenanceScheduler;
+
+#pragma mark - Deduplication
+
+@property (nonatomic, strong, readonly) AZCoreRecordDeduplicator *deduplicator;
+
 #pragma mark - Helpers
 
 @property (nonatomic, readonly) NSURL *ubiquitousStoreURL;
 @property (nonatomic, readonly) NSURL *fallbackStoreURL;
 @property (nonatomic, readonly) NSURL *localStoreURL;
 
+- (NSURL *)storeURLForShard: (AZCoreRecordStoreShard *) shard;
+
 @property (nonatomic, readonly, getter = isReadOnly) BOOL readOnly;
 
 #pragma mark - Options
@@ -72,9 +206,21 @@ extern NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey;
 @property (nonatomic) BOOL stackShouldAutoMigrateStore;
 @property (nonatomic) BOOL stackShouldUseInMemoryStore;
 @property (nonatomic) BOOL stackShouldUseUbiquity;
+/** Migrates outdated stores step by step on whichever thread loads the
+ stack, posting progress as it goes; load with loadStackWithCompletion: to
+ keep the migration off the main thread. */
+@property (nonatomic) BOOL stackShouldMigrateInBackground;
+/** Changing a stack setting once the stack is built loads a replacement
+ beside it. Work already queued on the old contexts finishes there; the new
+ stack is swapped in on the main queue, after which
+ AZCoreRecordManagerDidReplaceStackNotification is posted. */
 @property (nonatomic, copy) NSString *stackModelName;
 @property (nonatomic, copy) NSURL *stackModelURL;
 @property (nonatomic, copy) NSDictionary *stackModelConfigurations;
+@property (nonatomic, copy) AZCoreRecordSQLiteOptions *stackSQLiteOptions;
+/** Shards whose file or configuration is already taken, by another shard
+ or by the local or synced store, are rejected and reported. */
+@property (nonatomic, copy) NSArray *stackStoreShards;
 
 - (void) configureWithManagedDocument: (id) managedObject NS_AVAILABLE(10_4, 5_0);
 
@@ -91,9 +237,12 @@ extern NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey;
 + (void) setDefaultStackShouldAutoMigrateStore: (BOOL) shouldMigrate;
 + (void) setDefaultStackShouldUseInMemoryStore: (BOOL) inMemory;
 + (void) setDefaultStackShouldUseUbiquity: (BOOL) usesUbiquity;
++ (void) setDefaultStackShouldMigrateInBackground: (BOOL) inBackground;
 + (void) setDefaultStackModelName: (NSString *) name;
 + (void) setDefaultStackModelURL: (NSURL *) name;
 + (void) setDefaultStackModelConfigurations: (NSDictionary *) dictionary;
++ (void) setDefaultStackSQLiteOptions: (AZCoreRecordSQLiteOptions *) options;
++ (void) setDefaultStackStoreShards: (NSArray *) shards;
 
 + (void) setUpDefaultStackWithManagedDocument: (id) managedObject NS_AVAILABLE(10_4, 5_0);
 
@@ -114,4 +263,6 @@ extern NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey;
 - (void) saveDataInBackgroundWithBlock: (void (^)(NSManagedObjectContext *context)) block;
 - (void) saveDataInBackgroundWithBlock: (void (^)(NSManagedObjectContext *context)) block completion: (void (^)(void)) callback;
 
+- (void) saveDataToPersistentStoreWithBlock: (void (^)(NSManagedObjectContext *context)) block completion: (void (^)(BOOL success)) callback;
+
 @end
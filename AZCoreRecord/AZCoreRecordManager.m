@@ -8,6 +8,14 @@
 //
 
 #import <objc/runtime.h>
+#import <libkern/OSAtomic.h>
+#import <copyfile.h>
+#import <sqlite3.h>
+#import <sys/stat.h>
+
+#ifndef COPYFILE_CLONE_FORCE
+	#define COPYFILE_CLONE_FORCE (1 << 25)
+#endif
 
 #ifdef __IPHONE_OS_VERSION_MIN_REQUIRED
 	#import <UIKit/UIApplication.h>
@@ -16,6 +24,12 @@
 #endif
 
 #import "AZCoreRecordManager.h"
+#import "AZCoreRecordChangeJournal.h"
+#import "AZCoreRecordDeduplicator.h"
+#import "AZCoreRecordMaintenanceScheduler.h"
+#import "AZCoreRecordMigrator.h"
+#import "AZCoreRecordSQLiteOptions.h"
+#import "AZCoreRecordStoreShard.h"
 #import "AZCoreRecordUbiquitySentinel.h"
 #import "NSPersistentStoreCoordinator+AZCoreRecord.h"
 #import "NSManagedObjectContext+AZCoreRecord.h"
@@ -26,11 +40,167 @@ NSString *const AZCoreRecordManagerDidAddUbiquitousStoreNotification = @"AZCoreR
 NSString *const AZCoreRecordManagerDidAddFallbackStoreNotification = @"AZCoreRecordManagerDidAddFallbackStoreNotification";
 NSString *const AZCoreRecordManagerDidFinishAdddingPersistentStoresNotification = @"AZCoreRecordManagerDidFinishAdddingPersistentStoresNotification";
 NSString *const AZCoreRecordManagerShouldRunDeduplicationNotification = @"AZCoreRecordManagerShouldRunDeduplicationNotification";
+NSString *const AZCoreRecordDeduplicationEntityNamesKey = @"AZCoreRecordDeduplicationEntityNames";
 NSString *const AZCoreRecordDidFinishSeedingPersistentStoreNotification = @"AZCoreRecordDidFinishSeedingPersistentStoreNotification";
+NSString *const AZCoreRecordManagerDidReplaceStackNotification = @"AZCoreRecordManagerDidReplaceStackNotification";
+NSString *const AZCoreRecordManagerDidReattachUbiquitousStoreNotification = @"AZCoreRecordManagerDidReattachUbiquitousStoreNotification";
+NSString *const AZCoreRecordInvalidatedEntityNamesKey = @"AZCoreRecordInvalidatedEntityNames";
+NSString *const AZCoreRecordManagerWillMigrateStoresNotification = @"AZCoreRecordManagerWillMigrateStoresNotification";
+NSString *const AZCoreRecordManagerMigrationProgressNotification = @"AZCoreRecordManagerMigrationProgressNotification";
+NSString *const AZCoreRecordManagerDidMigrateStoresNotification = @"AZCoreRecordManagerDidMigrateStoresNotification";
+
+NSString *const AZCoreRecordMigrationProgressKey = @"AZCoreRecordMigrationProgress";
+
+NSString *const AZCoreRecordManagerDidSeedLocalStoreNotification = @"AZCoreRecordManagerDidSeedLocalStoreNotification";
+NSString *const AZCoreRecordSeedMethodKey = @"AZCoreRecordSeedMethod";
+NSString *const AZCoreRecordSeedCopyDurationKey = @"AZCoreRecordSeedCopyDuration";
+NSString *const AZCoreRecordSeedAttachDurationKey = @"AZCoreRecordSeedAttachDuration";
+NSString *const AZCoreRecordSeedIntegrityCheckDurationKey = @"AZCoreRecordSeedIntegrityCheckDuration";
+NSString *const AZCoreRecordSeedIntegrityCheckPassedKey = @"AZCoreRecordSeedIntegrityCheckPassed";
+NSString *const AZCoreRecordSeedIntegrityCheckResultKey = @"AZCoreRecordSeedIntegrityCheckResult";
+
+NSString *const AZCoreRecordErrorDomain = @"AZCoreRecordErrorDomain";
 
 NSString *const AZCoreRecordLocalStoreConfigurationNameKey = @"LocalStore";
 NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousStore";
 
+static void *azcr_lastAccessKey = &azcr_lastAccessKey;
+static void *azcr_replicaRefreshKey = &azcr_replicaRefreshKey;
+static void *azcr_invalidationGenerationKey = &azcr_invalidationGenerationKey;
+static const NSTimeInterval azcr_threadContextCheckInterval = 1.0;
+
+static NSString *const azcr_migrationURLKey = @"URL";
+static NSString *const azcr_migrationTypeKey = @"type";
+static NSString *const azcr_migrationConfigurationKey = @"configuration";
+
+static void azcr_releaseQueueContext(void *context)
+{
+	NSManagedObjectContext *queueContext = (__bridge_transfer NSManagedObjectContext *) context;
+	[queueContext drainReusableChildContexts];
+}
+
+static NSString *azcr_cloneOrCopyFile(NSURL *sourceURL, NSURL *destinationURL, NSError **error)
+{
+	const char *sourcePath = sourceURL.fileSystemRepresentation;
+	const char *destinationPath = destinationURL.fileSystemRepresentation;
+	
+	// Forced cloning fails instead of quietly copying where the file system
+	// can't clone. A copyfile() that predates the flag ignores it and copies
+	// nothing, so only a destination of the right size counts as a clone.
+	if (copyfile(sourcePath, destinationPath, NULL, COPYFILE_CLONE_FORCE) == 0)
+	{
+		struct stat sourceInfo, destinationInfo;
+		if (stat(sourcePath, &sourceInfo) == 0 && stat(destinationPath, &destinationInfo) == 0 && sourceInfo.st_size == destinationInfo.st_size)
+			return @"clone";
+	}
+	
+	unlink(destinationPath);
+	
+	// Data-only copy done in the kernel, skipping the metadata and extended
+	// attributes that -copyItemAtURL:toURL:error: also carries over
+	if (copyfile(sourcePath, destinationPath, NULL, COPYFILE_DATA) == 0)
+		return @"copy";
+	
+	if (error)
+		*error = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: [NSDictionary dictionaryWithObject: destinationURL forKey: NSURLErrorKey]];
+	
+	return nil;
+}
+
+static NSString *azcr_quickCheckStore(NSURL *storeURL, NSError **error)
+{
+	// A read-only connection of its own, so the check never holds Core Data's
+	// connection while it walks the file
+	sqlite3 *database = NULL;
+	int result = sqlite3_open_v2(storeURL.fileSystemRepresentation, &database, SQLITE_OPEN_READONLY, NULL);
+	
+	sqlite3_stmt *statement = NULL;
+	if (result == SQLITE_OK)
+	{
+		sqlite3_busy_timeout(database, 5000);
+		result = sqlite3_prepare_v2(database, "PRAGMA quick_check", -1, &statement, NULL);
+	}
+	
+	NSMutableArray *rows = [NSMutableArray array];
+	if (result == SQLITE_OK)
+	{
+		while ((result = sqlite3_step(statement)) == SQLITE_ROW)
+		{
+			const unsigned char *text = sqlite3_column_text(statement, 0);
+			if (text)
+				[rows addObject: [NSString stringWithUTF8String: (const char *) text]];
+		}
+		
+		if (result == SQLITE_DONE)
+			result = SQLITE_OK;
+	}
+	
+	if (result != SQLITE_OK && error)
+	{
+		NSString *message = database ? [NSString stringWithUTF8String: sqlite3_errmsg(database)] : @"The store could not be opened.";
+		NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys: message, NSLocalizedDescriptionKey, storeURL, NSURLErrorKey, nil];
+		*error = [NSError errorWithDomain: NSSQLiteErrorDomain code: result userInfo: userInfo];
+	}
+	
+	sqlite3_finalize(statement);
+	sqlite3_close(database);
+	
+	return result == SQLITE_OK ? [rows componentsJoinedByString: @"\n"] : nil;
+}
+
+static void azcr_removeStores(NSArray *stores, NSPersistentStoreCoordinator *coordinator)
+{
+	for (NSPersistentStore *store in stores)
+	{
+		NSError *error = nil;
+		if (![coordinator removePersistentStore: store error: &error])
+			[AZCoreRecordManager handleError: error];
+	}
+}
+
+static void azcr_invalidateEntities(NSManagedObjectContext *context, NSSet *entityNames)
+{
+	NSMutableArray *editedObjects = [NSMutableArray array];
+	
+	for (NSManagedObject *object in context.registeredObjects)
+	{
+		// Unsaved inserts aren't tied to the old store yet; they're the
+		// user's pending work and get saved into whichever store is attached.
+		if (object.isInserted || ![entityNames containsObject: object.entity.name])
+			continue;
+		
+		// Refreshing would throw away the user's edits, so leave them be and
+		// let the app decide what to carry over.
+		if (object.isUpdated || object.isDeleted)
+		{
+			[editedObjects addObject: object];
+			continue;
+		}
+		
+		[context refreshObject: object mergeChanges: NO];
+	}
+	
+	if (editedObjects.count)
+	{
+		NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys: @"Objects with unsaved changes belong to a store that was replaced.", NSLocalizedDescriptionKey, editedObjects, NSAffectedObjectsErrorKey, nil];
+		[AZCoreRecordManager handleError: [NSError errorWithDomain: AZCoreRecordErrorDomain code: AZCoreRecordUnsavedChangesError userInfo: userInfo]];
+	}
+}
+
+static NSUInteger azcr_faultUnmodifiedObjects(NSManagedObjectContext *context)
+{
+	NSUInteger count = 0;
+	for (NSManagedObject *object in context.registeredObjects)
+	{
+		if (object.isFault || object.isInserted || object.isUpdated || object.isDeleted)
+			continue;
+		
+		[context refreshObject: object mergeChanges: NO];
+		count++;
+	}
+	return count;
+}
+
 @interface AZCoreRecordManager ()
 
 @property (nonatomic, weak) id <AZCoreRecordErrorHandler> errorDelegate;
@@ -47,10 +217,31 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 @property (nonatomic, readonly) NSURL *stackStoreURL;
 
 - (NSDictionary *) azcr_lightweightMigrationOptions;
-- (void) azcr_loadPersistentStores;
+- (NSPersistentStoreCoordinator *) azcr_newPersistentStoreCoordinator;
+- (void) azcr_loadPersistentStoresIntoCoordinator: (NSPersistentStoreCoordinator *) coordinator;
+- (void) azcr_migrateAndAddPersistentStoresToCoordinator: (NSPersistentStoreCoordinator *) coordinator;
+- (void) azcr_addPersistentStoresToCoordinator: (NSPersistentStoreCoordinator *) coordinator;
+- (void) azcr_attachSyncedStoreToCoordinator: (NSPersistentStoreCoordinator *) coordinator options: (NSDictionary *) options sqliteOptions: (NSDictionary *) sqliteOptions completion: (void (^)(void)) completion;
+- (void) azcr_reattachSyncedStore;
+- (BOOL) azcr_validateStoreShards: (NSArray *) shards configurations: (NSDictionary *) configurations error: (NSError **) error;
+- (void) azcr_addStoreShards: (NSArray *) shards toCoordinator: (NSPersistentStoreCoordinator *) coordinator options: (NSDictionary *) options;
+- (AZCoreRecordChangeJournal *) azcr_changeJournalForStoreURL: (NSURL *) storeURL;
+- (void) azcr_replayChangeJournal: (AZCoreRecordChangeJournal *) journal fromStoreAtURL: (NSURL *) sourceURL intoStore: (NSPersistentStore *) store;
+- (void) azcr_didLoadPersistentStoresIntoCoordinator: (NSPersistentStoreCoordinator *) coordinator;
+- (void) azcr_rebuildStack;
+- (void) azcr_detachStores: (NSArray *) stores fromCoordinator: (NSPersistentStoreCoordinator *) coordinator;
+- (void) azcr_retireCoordinator: (NSPersistentStoreCoordinator *) coordinator mainContext: (NSManagedObjectContext *) mainContext threadContexts: (NSArray *) threadContexts;
 - (void) azcr_resetStack;
 - (void) azcr_didChangeUbiquityIdentityNotification:(NSNotification *)note;
 - (void) azcr_didRecieveDeduplicationNotification:(NSNotification *)note;
+- (void) azcr_maintainThreadContext: (NSManagedObjectContext *) context;
+- (void) azcr_reclaimThreadContext: (NSManagedObjectContext *) context resetting: (BOOL) resetting;
+- (void) azcr_sweepIdleThreadContexts;
+- (void) azcr_markStackReady;
+- (void) azcr_markStackNotReady;
+- (NSManagedObjectContext *) azcr_routedReadReplicaContextForRequest: (NSFetchRequest *) request;
+- (NSURL *) azcr_ubiquityContainerURL;
+- (void) azcr_invalidateStoreLayout;
 
 @end
 
@@ -67,11 +258,21 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 @synthesize stackShouldAutoMigrateStore = _stackShouldAutoMigrate;
 @synthesize stackShouldUseInMemoryStore = _stackShouldUseInMemoryStore;
 @synthesize stackShouldUseUbiquity = _stackShouldUseUbiquity;
+@synthesize stackShouldMigrateInBackground = _stackShouldMigrateInBackground;
 @synthesize stackName = _stackName;
 @synthesize stackModelName = _stackModelName;
 @synthesize stackModelURL = _stackModelURL;
 @synthesize stackModelConfigurations = _stackModelConfigurations;
 @synthesize ubiquityEnabled = _ubiquityEnabled;
+@synthesize stackSQLiteOptions = _stackSQLiteOptions;
+@synthesize stackStoreShards = _stackStoreShards;
+@synthesize stackReadReplicaCount = _stackReadReplicaCount;
+@synthesize maintenanceScheduler = _maintenanceScheduler;
+@synthesize deduplicator = _deduplicator;
+@synthesize stackReadReplicaStaleness = _stackReadReplicaStaleness;
+@synthesize stackShouldRouteBackgroundReads = _stackShouldRouteBackgroundReads;
+@synthesize threadContextObjectLimit = _threadContextObjectLimit;
+@synthesize threadContextIdleInterval = _threadContextIdleInterval;
 
 #pragma mark - Setup and teardown
 
@@ -83,14 +284,35 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 		_stackName = [name copy];
 		_semaphore = dispatch_semaphore_create(1);
         _loadSemaphore = dispatch_semaphore_create(1);
+		_stackSemaphore = dispatch_semaphore_create(1);
+		_layoutSemaphore = dispatch_semaphore_create(1);
+		_readyQueue = dispatch_queue_create("com.AZCoreRecord.manager.ready", DISPATCH_QUEUE_SERIAL);
+		dispatch_suspend(_readyQueue);
         self.fileManager = [NSFileManager new];
 		self.ubiquityToken = [[AZCoreRecordUbiquitySentinel sharedSentinel] ubiquityIdentityToken];
+		_threadContexts = [NSMutableSet set];
+		_maintenanceScheduler = [[AZCoreRecordMaintenanceScheduler alloc] initWithManager: self];
+		_deduplicator = [[AZCoreRecordDeduplicator alloc] initWithManager: self];
 		
 		//subscribe to the account change notification
 		[[NSNotificationCenter defaultCenter] addObserver: self
 												 selector: @selector(azcr_didChangeUbiquityIdentityNotification:)
 													 name: AZUbiquityIdentityDidChangeNotification
 												   object: nil];
+		
+#ifdef __IPHONE_OS_VERSION_MIN_REQUIRED
+		[[NSNotificationCenter defaultCenter] addObserver: self
+												 selector: @selector(reclaimThreadContextMemory)
+													 name: UIApplicationDidReceiveMemoryWarningNotification
+												   object: nil];
+#elif defined(__MAC_OS_X_VERSION_MIN_REQUIRED)
+		__weak AZCoreRecordManager *weakSelf = self;
+		_memoryPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_VM, 0, DISPATCH_VM_PRESSURE, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+		dispatch_source_set_event_handler(_memoryPressureSource, ^{
+			[weakSelf reclaimThreadContextMemory];
+		});
+		dispatch_resume(_memoryPressureSource);
+#endif
 	}
 	
 	return self;
@@ -106,6 +328,21 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 - (void) dealloc
 {
 	[[NSNotificationCenter defaultCenter] removeObserver: self];
+	if (_idleTimer)
+	{
+		dispatch_source_cancel(_idleTimer);
+		dispatch_release(_idleTimer);
+	}
+	if (_memoryPressureSource)
+	{
+		dispatch_source_cancel(_memoryPressureSource);
+		dispatch_release(_memoryPressureSource);
+	}
+	if (!_stackReady)
+		dispatch_resume(_readyQueue);
+	dispatch_release(_readyQueue);
+	dispatch_release(_stackSemaphore);
+	dispatch_release(_layoutSemaphore);
 	dispatch_release(_semaphore);
 	dispatch_release(_loadSemaphore);
 }
@@ -136,8 +373,11 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 	
 	[[NSNotificationCenter defaultCenter] removeObserver: _managedObjectContext name: key object: nil];
 	
-	if (isUbiquitous && _managedObjectContext)
-		[_managedObjectContext stopObservingUbiquitousChanges];
+	// The ubiquity flag may already describe a replacement stack, so don't
+	// rely on it to decide whether the outgoing context was observing.
+	[_managedObjectContext stopObservingUbiquitousChanges];
+	
+	[_managedObjectContext drainReusableChildContexts];
 	
 	_managedObjectContext = managedObjectContext;
     
@@ -151,37 +391,234 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 
 - (NSPersistentStoreCoordinator *) persistentStoreCoordinator
 {
+	if (_persistentStoreCoordinator)
+		return _persistentStoreCoordinator;
+	
+	// Whoever gets here first builds the stack; anyone else waits for it
+	// rather than building a second coordinator.
+	dispatch_semaphore_wait(_stackSemaphore, DISPATCH_TIME_FOREVER);
+	
 	if (!_persistentStoreCoordinator)
 	{
-		NSManagedObjectModel *model = nil;
-		NSURL *modelURL = self.stackModelURL;
-		NSString *modelName = self.stackModelName;
-			
-		if (!modelURL && modelName) {
-			model = [NSManagedObjectModel modelWithName: modelName];
-		} else if (modelURL) {
-			model = [[NSManagedObjectModel alloc] initWithContentsOfURL: modelURL];
-		} else {
-			model = [NSManagedObjectModel mergedModelFromBundles: nil];
-		}
-		
-		_persistentStoreCoordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: model];
-        
-        NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
-        [nc addObserver: self selector: @selector(azcr_didRecieveDeduplicationNotification:) name: AZCoreRecordDidFinishSeedingPersistentStoreNotification object: _persistentStoreCoordinator];
-        [nc addObserver: self selector: @selector(azcr_didRecieveDeduplicationNotification:) name: NSPersistentStoreDidImportUbiquitousContentChangesNotification object: _persistentStoreCoordinator];
-        
-		[self azcr_loadPersistentStores];
+		_persistentStoreCoordinator = [self azcr_newPersistentStoreCoordinator];
+		[self azcr_loadPersistentStoresIntoCoordinator: _persistentStoreCoordinator];
 	}
 	
+	dispatch_semaphore_signal(_stackSemaphore);
+	
 	return _persistentStoreCoordinator;
 }
 
+- (NSPersistentStoreCoordinator *) azcr_newPersistentStoreCoordinator
+{
+	NSManagedObjectModel *model = nil;
+	NSURL *modelURL = self.stackModelURL;
+	NSString *modelName = self.stackModelName;
+	
+	if (!modelURL && modelName) {
+		model = [NSManagedObjectModel cachedModelWithName: modelName];
+	} else if (modelURL) {
+		model = [NSManagedObjectModel cachedModelWithContentsOfURL: modelURL];
+	} else {
+		model = [NSManagedObjectModel mergedModelFromBundles: nil];
+	}
+	
+	NSPersistentStoreCoordinator *coordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: model];
+	
+	NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+	[nc addObserver: self selector: @selector(azcr_didRecieveDeduplicationNotification:) name: AZCoreRecordDidFinishSeedingPersistentStoreNotification object: coordinator];
+	[nc addObserver: self selector: @selector(azcr_didRecieveDeduplicationNotification:) name: NSPersistentStoreDidImportUbiquitousContentChangesNotification object: coordinator];
+	
+	return coordinator;
+}
+
+#pragma mark - Stack replacement
+
+- (void) azcr_rebuildStack
+{
+	// Build the replacement off the main thread, beside the live stack,
+	// which keeps serving until the swap.
+	dispatch_queue_t globalQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	
+	// Called with the stack semaphore held; nothing built yet means the
+	// first access picks up the new settings.
+	NSPersistentStoreCoordinator *(^beginRebuild)(void) = ^NSPersistentStoreCoordinator *{
+		NSPersistentStoreCoordinator *coordinator = nil;
+		if (_persistentStoreCoordinator)
+			coordinator = _pendingPersistentStoreCoordinator = [self azcr_newPersistentStoreCoordinator];
+		
+		dispatch_semaphore_signal(_stackSemaphore);
+		return coordinator;
+	};
+	
+	// Decide now, so a setter called just before first use doesn't go on to
+	// rebuild the stack that use builds with the new settings.
+	if (!dispatch_semaphore_wait(_stackSemaphore, DISPATCH_TIME_NOW))
+	{
+		NSPersistentStoreCoordinator *coordinator = beginRebuild();
+		if (coordinator)
+			dispatch_async(globalQueue, ^{
+				[self azcr_loadPersistentStoresIntoCoordinator: coordinator];
+			});
+		return;
+	}
+	
+	// A build under way may have read the old settings; wait it out off
+	// this thread and replace what it produces.
+	dispatch_async(globalQueue, ^{
+		dispatch_semaphore_wait(_stackSemaphore, DISPATCH_TIME_FOREVER);
+		
+		NSPersistentStoreCoordinator *coordinator = beginRebuild();
+		if (coordinator)
+			[self azcr_loadPersistentStoresIntoCoordinator: coordinator];
+	});
+}
+
+- (void) azcr_detachStores: (NSArray *) stores fromCoordinator: (NSPersistentStoreCoordinator *) coordinator
+{
+	// Work already queued on the main context finishes against the stores first
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	NSManagedObjectContext *context = (_managedObjectContext.persistentStoreCoordinator == coordinator) ? _managedObjectContext : nil;
+	dispatch_semaphore_signal(self.semaphore);
+	
+	void (^detach)(void) = ^{
+		azcr_removeStores(stores, coordinator);
+	};
+	
+	if (context)
+		[context performBlockAndWait: detach];
+	else
+		detach();
+}
+
+- (void) azcr_retireCoordinator: (NSPersistentStoreCoordinator *) coordinator mainContext: (NSManagedObjectContext *) mainContext threadContexts: (NSArray *) threadContexts
+{
+	// Work already queued on the old stack finishes there: the thread
+	// contexts first, since their saves land in the main context, then the
+	// main context. Only then are the old stores closed.
+	dispatch_group_t group = dispatch_group_create();
+	for (NSManagedObjectContext *context in threadContexts)
+	{
+		dispatch_group_enter(group);
+		[context performBlock: ^{
+			dispatch_group_leave(group);
+		}];
+	}
+	
+	dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+		void (^detach)(void) = ^{
+			dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+				azcr_removeStores(coordinator.persistentStores, coordinator);
+			});
+		};
+		
+		if (mainContext)
+			[mainContext performBlock: detach];
+		else
+			detach();
+	});
+	
+	dispatch_release(group);
+}
+
+- (void) azcr_didLoadPersistentStoresIntoCoordinator: (NSPersistentStoreCoordinator *) coordinator
+{
+	if (coordinator == _persistentStoreCoordinator)
+	{
+		[self azcr_markStackReady];
+		return;
+	}
+	
+	// The main context is bound to the main queue, so the swap happens
+	// there, between two main-queue blocks rather than during one.
+	dispatch_async(dispatch_get_main_queue(), ^{
+		NSManagedObjectContext *context = [[NSManagedObjectContext alloc] initWithConcurrencyType: NSMainQueueConcurrencyType];
+		context.persistentStoreCoordinator = coordinator;
+		
+		dispatch_semaphore_wait(_stackSemaphore, DISPATCH_TIME_FOREVER);
+		BOOL isCurrent = (coordinator == _pendingPersistentStoreCoordinator);
+		if (isCurrent)
+			_pendingPersistentStoreCoordinator = nil;
+		dispatch_semaphore_signal(_stackSemaphore);
+		
+		// A later rebuild superseded this one; nothing ever used its stores
+		if (!isCurrent)
+		{
+			[[NSNotificationCenter defaultCenter] removeObserver: self name: nil object: coordinator];
+			[self azcr_retireCoordinator: coordinator mainContext: nil threadContexts: nil];
+			return;
+		}
+		
+		dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+		
+		NSPersistentStoreCoordinator *oldCoordinator = _persistentStoreCoordinator;
+		NSManagedObjectContext *oldContext = _managedObjectContext;
+		NSArray *oldThreadContexts = _threadContexts.allObjects;
+		
+		_persistentStoreCoordinator = coordinator;
+		self.managedObjectContext = context;
+		_readReplicaContexts = nil;
+		
+		// Thread and queue contexts notice their parent is gone and are
+		// replaced on next use; new work goes to the new stack.
+		[_threadContexts makeObjectsPerformSelector: @selector(drainReusableChildContexts)];
+		[_threadContexts removeAllObjects];
+		
+		dispatch_semaphore_signal(self.semaphore);
+		
+		[[NSNotificationCenter defaultCenter] removeObserver: self name: nil object: oldCoordinator];
+		[[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordManagerDidReplaceStackNotification object: self];
+		
+		[self azcr_markStackReady];
+		[self azcr_retireCoordinator: oldCoordinator mainContext: oldContext threadContexts: oldThreadContexts];
+	});
+}
+
+#pragma mark - Stack readiness
+
+- (BOOL) isStackReady
+{
+	OSMemoryBarrier();
+	return !!_stackReady;
+}
+
+- (void) azcr_markStackReady
+{
+	if (OSAtomicCompareAndSwap32Barrier(0, 1, &_stackReady))
+		dispatch_resume(_readyQueue);
+}
+
+- (void) azcr_markStackNotReady
+{
+	if (OSAtomicCompareAndSwap32Barrier(1, 0, &_stackReady))
+		dispatch_suspend(_readyQueue);
+}
+
+- (void) whenReady: (void (^)(void)) block
+{
+	NSParameterAssert(block);
+	
+	dispatch_async(_readyQueue, ^{
+		dispatch_async(dispatch_get_main_queue(), block);
+	});
+}
+
+- (void) loadStackWithCompletion: (void (^)(void)) completion
+{
+	if (completion)
+		[self whenReady: completion];
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+		[self persistentStoreCoordinator];
+	});
+}
+
 - (NSManagedObjectContext *)contextForCurrentThread {
 	if ([NSThread isMainThread])
         return self.managedObjectContext;
 	
 	NSManagedObjectContext *context = nil;
+	NSManagedObjectContext *mainContext = self.managedObjectContext;
 	
 	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
     
@@ -189,62 +626,528 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 	NSMutableDictionary *dict = [thread threadDictionary];
     NSString *key = self.stackName;
 	context = [dict objectForKey: self.stackName];
+	BOOL isNewThread = !context;
+	
+	if (context && context.parentContext != mainContext)
+	{
+		// Left over from before the stack was replaced
+		[context drainReusableChildContexts];
+		[_threadContexts removeObject: context];
+		context = nil;
+	}
+	
 	if (!context)
 	{
-		context = [self.managedObjectContext newChildContext];
+		// Private-queue, so idle sweeps and memory pressure can reclaim it
+		// without waiting for its thread to come back.
+		context = [[NSManagedObjectContext alloc] initWithConcurrencyType: NSPrivateQueueConcurrencyType];
+		context.mergePolicy = NSMergeByPropertyObjectTrumpMergePolicy;
+		context.parentContext = mainContext;
 		[dict setObject: context forKey: key];
-        
+		[_threadContexts addObject: context];
+	}
+	
+	if (isNewThread)
+	{
+        __weak AZCoreRecordManager *weakSelf = self;
         __block id token = nil;
         token = [[NSNotificationCenter defaultCenter] addObserverForName: NSThreadWillExitNotification object: thread queue: nil usingBlock:^(NSNotification *note) {
             NSThread *thread = [note object];
             NSManagedObjectContext *context = [thread.threadDictionary objectForKey: key];
-            [context reset];
+            AZCoreRecordManager *strongSelf = weakSelf;
+            if (strongSelf && context) {
+                dispatch_semaphore_wait(strongSelf.semaphore, DISPATCH_TIME_FOREVER);
+                [strongSelf->_threadContexts removeObject: context];
+                dispatch_semaphore_signal(strongSelf.semaphore);
+            }
+            [context drainReusableChildContexts];
+            [context performBlock: ^{
+                [context reset];
+            }];
             [[NSNotificationCenter defaultCenter] removeObserver: token];
         }];
 	}
 	
-	dispatch_semaphore_signal(self.semaphore);
+	dispatch_semaphore_signal(self.semaphore);
+	
+	[self azcr_maintainThreadContext: context];
+	
+	return context;
+}
+
+- (NSManagedObjectContext *)contextForQueue:(dispatch_queue_t)queue {
+	NSParameterAssert(queue);
+	
+	if (queue == dispatch_get_main_queue())
+		return self.managedObjectContext;
+	
+	void *key = &_queueContextKey;
+	NSManagedObjectContext *mainContext = self.managedObjectContext;
+	
+	// The queue owns its context and replacing the specific data releases
+	// it, so only read it under the lock, into a strong reference.
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	
+	NSManagedObjectContext *context = (__bridge NSManagedObjectContext *) dispatch_queue_get_specific(queue, key);
+	BOOL isExisting = (context.parentContext == mainContext);
+	
+	// A context whose parent is gone predates a stack swap; replacing the
+	// specific data lets the queue release it.
+	if (!isExisting)
+	{
+		context = [[NSManagedObjectContext alloc] initWithConcurrencyType: NSPrivateQueueConcurrencyType];
+		context.mergePolicy = NSMergeByPropertyObjectTrumpMergePolicy;
+		context.parentContext = mainContext;
+		
+		// The queue owns the context from here on and releases it when it
+		// goes away, so live contexts track live queues.
+		dispatch_queue_set_specific(queue, key, (__bridge_retained void *) context, azcr_releaseQueueContext);
+		
+		if (!dispatch_queue_get_specific(queue, key))
+		{
+			// Global queues ignore specific data; undo the hand-off.
+			CFRelease((__bridge CFTypeRef) context);
+			context = nil;
+		}
+	}
+	
+	dispatch_semaphore_signal(self.semaphore);
+	
+	if (isExisting)
+		[self azcr_applyInvalidationToContext: context];
+	
+	return context;
+}
+
+- (void)performWithContextForQueue:(dispatch_queue_t)queue block:(void (^)(NSManagedObjectContext *))block {
+	NSParameterAssert(block);
+	
+	NSManagedObjectContext *context = [self contextForQueue: queue];
+	if (!context)
+		[NSException raise: NSInvalidArgumentException format: @"-performWithContextForQueue:block: requires a serial queue."];
+	
+	[context performBlockAndWait: ^{
+		block(context);
+	}];
+}
+
+- (void)performWithQueueContext:(void (^)(NSManagedObjectContext *))block {
+	// Called from the queue whose context it wants
+	[self performWithContextForQueue: dispatch_get_current_queue() block: block];
+}
+
+#pragma mark - Thread context memory
+
+- (void) azcr_applyInvalidationToContext: (NSManagedObjectContext *) context
+{
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	NSUInteger generation = _invalidationGeneration;
+	NSSet *entityNames = _invalidatedEntityNames;
+	dispatch_semaphore_signal(self.semaphore);
+	
+	if ([objc_getAssociatedObject(context, azcr_invalidationGenerationKey) unsignedIntegerValue] == generation)
+		return;
+	
+	objc_setAssociatedObject(context, azcr_invalidationGenerationKey, [NSNumber numberWithUnsignedInteger: generation], OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+	
+	if (context.concurrencyType == NSConfinementConcurrencyType)
+		azcr_invalidateEntities(context, entityNames);
+	else
+		[context performBlockAndWait: ^{
+			azcr_invalidateEntities(context, entityNames);
+		}];
+}
+
+- (void) azcr_maintainThreadContext: (NSManagedObjectContext *) context
+{
+	[self azcr_applyInvalidationToContext: context];
+	
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+	
+	// The sweeper reads this from another thread
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	CFAbsoluteTime lastAccess = [objc_getAssociatedObject(context, azcr_lastAccessKey) doubleValue];
+	objc_setAssociatedObject(context, azcr_lastAccessKey, [NSNumber numberWithDouble: now], OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+	dispatch_semaphore_signal(self.semaphore);
+	
+	// Counting registered objects isn't free; only look once in a while.
+	if (!_threadContextObjectLimit || (now - lastAccess) < azcr_threadContextCheckInterval)
+		return;
+	
+	NSUInteger limit = _threadContextObjectLimit;
+	[context performBlockAndWait: ^{
+		if (context.registeredObjects.count > limit)
+			OSAtomicAdd64Barrier(azcr_faultUnmodifiedObjects(context), &_reclaimedObjectCount);
+	}];
+}
+
+- (void) azcr_reclaimThreadContext: (NSManagedObjectContext *) context resetting: (BOOL) resetting
+{
+	[context performBlock: ^{
+		NSUInteger count = 0;
+		
+		// Unsaved changes are the thread's pending work; only fault around them.
+		if (resetting && !context.hasChanges)
+		{
+			count = context.registeredObjects.count;
+			[context reset];
+		}
+		else
+		{
+			count = azcr_faultUnmodifiedObjects(context);
+		}
+		
+		OSAtomicAdd64Barrier(count, &_reclaimedObjectCount);
+	}];
+}
+
+- (void) azcr_sweepIdleThreadContexts
+{
+	NSTimeInterval idleInterval = self.threadContextIdleInterval;
+	if (idleInterval <= 0)
+		return;
+	
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+	NSMutableArray *idleContexts = [NSMutableArray array];
+	
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	
+	for (NSManagedObjectContext *context in _threadContexts)
+	{
+		CFAbsoluteTime lastAccess = [objc_getAssociatedObject(context, azcr_lastAccessKey) doubleValue];
+		if ((now - lastAccess) >= idleInterval)
+			[idleContexts addObject: context];
+	}
+	
+	dispatch_semaphore_signal(self.semaphore);
+	
+	for (NSManagedObjectContext *context in idleContexts)
+		[self azcr_reclaimThreadContext: context resetting: YES];
+}
+
+- (void) reclaimThreadContextMemory
+{
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	NSArray *contexts = _threadContexts.allObjects;
+	dispatch_semaphore_signal(self.semaphore);
+	
+	for (NSManagedObjectContext *context in contexts)
+		[self azcr_reclaimThreadContext: context resetting: NO];
+	
+	[self azcr_sweepIdleThreadContexts];
+}
+
+- (NSUInteger) reclaimedObjectCount
+{
+	OSMemoryBarrier();
+	return (NSUInteger) _reclaimedObjectCount;
+}
+
+- (void) setThreadContextIdleInterval: (NSTimeInterval) threadContextIdleInterval
+{
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	
+	_threadContextIdleInterval = threadContextIdleInterval;
+	
+	if (_idleTimer)
+	{
+		dispatch_source_cancel(_idleTimer);
+		dispatch_release(_idleTimer);
+		_idleTimer = NULL;
+	}
+	
+	if (threadContextIdleInterval > 0)
+	{
+		__weak AZCoreRecordManager *weakSelf = self;
+		uint64_t interval = (uint64_t)(threadContextIdleInterval * NSEC_PER_SEC);
+		_idleTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+		dispatch_source_set_timer(_idleTimer, dispatch_time(DISPATCH_TIME_NOW, interval), interval, interval / 10);
+		dispatch_source_set_event_handler(_idleTimer, ^{
+			[weakSelf azcr_sweepIdleThreadContexts];
+		});
+		dispatch_resume(_idleTimer);
+	}
+	
+	dispatch_semaphore_signal(self.semaphore);
+}
+
+#pragma mark - Read replicas
+
+- (NSArray *) azcr_newReadReplicaContextsForCoordinator: (NSPersistentStoreCoordinator *) coordinator count: (NSUInteger) count staleness: (NSTimeInterval) staleness entityNames: (NSSet **) outEntityNames
+{
+	NSManagedObjectModel *model = coordinator.managedObjectModel;
+	NSMutableArray *stores = [NSMutableArray array];
+	NSMutableSet *replicatedNames = [NSMutableSet set];
+	NSMutableSet *otherNames = [NSMutableSet set];
+	
+	for (NSPersistentStore *store in coordinator.persistentStores)
+	{
+		BOOL replicated = [store.type isEqualToString: NSSQLiteStoreType] && ![store.options objectForKey: NSPersistentStoreUbiquitousContentNameKey];
+		NSString *configuration = store.configurationName;
+		NSArray *entities = [model.configurations containsObject: configuration] ? [model entitiesForConfiguration: configuration] : model.entities;
+		
+		if (replicated)
+			[stores addObject: store];
+		
+		[replicated ? replicatedNames : otherNames addObjectsFromArray: [entities valueForKey: @"name"]];
+	}
+	
+	// An entity that also lives in a store the replicas can't see has to be
+	// read from the real stack.
+	[replicatedNames minusSet: otherNames];
+	*outEntityNames = replicatedNames;
+	
+	if (!stores.count)
+		return nil;
+	
+	NSMutableArray *contexts = [NSMutableArray arrayWithCapacity: count];
+	
+	for (NSUInteger i = 0; i < count; i++)
+	{
+		NSPersistentStoreCoordinator *replica = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: model];
+		
+		for (NSPersistentStore *store in stores)
+		{
+			NSMutableDictionary *options = [NSMutableDictionary dictionaryWithObject: (__bridge id) kCFBooleanTrue forKey: NSReadOnlyPersistentStoreOption];
+			id pragmas = [store.options objectForKey: NSSQLitePragmasOption];
+			if (pragmas)
+				[options setObject: pragmas forKey: NSSQLitePragmasOption];
+			
+			[replica addStoreAtURL: store.URL configuration: store.configurationName options: options];
+		}
+		
+		NSManagedObjectContext *context = [[NSManagedObjectContext alloc] initWithConcurrencyType: NSPrivateQueueConcurrencyType];
+		context.persistentStoreCoordinator = replica;
+		context.stalenessInterval = staleness;
+		context.undoManager = nil;
+		[contexts addObject: context];
+	}
+	
+	return [contexts copy];
+}
+
+- (NSManagedObjectContext *) azcr_readReplicaContextForEntityName: (NSString *) entityName
+{
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	NSArray *contexts = _readReplicaContexts;
+	NSPersistentStoreCoordinator *coordinator = _persistentStoreCoordinator;
+	NSUInteger count = _stackReadReplicaCount;
+	NSTimeInterval staleness = _stackReadReplicaStaleness;
+	dispatch_semaphore_signal(self.semaphore);
+	
+	// Opening the replica stores is slow, so it happens outside the lock;
+	// whatever changed meanwhile wins over this build.
+	if (!contexts && count && coordinator && self.isStackReady)
+	{
+		NSSet *entityNames = nil;
+		NSArray *builtContexts = [self azcr_newReadReplicaContextsForCoordinator: coordinator count: count staleness: staleness entityNames: &entityNames];
+		
+		dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+		if (!_readReplicaContexts && coordinator == _persistentStoreCoordinator && count == _stackReadReplicaCount && staleness == _stackReadReplicaStaleness)
+		{
+			_readReplicaContexts = builtContexts;
+			_readReplicaEntityNames = entityNames;
+		}
+		dispatch_semaphore_signal(self.semaphore);
+	}
+	
+	NSManagedObjectContext *context = nil;
+	
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	contexts = _readReplicaContexts;
+	if (contexts.count && (!entityName || [_readReplicaEntityNames containsObject: entityName]))
+		context = [contexts objectAtIndex: _nextReadReplica++ % contexts.count];
+	dispatch_semaphore_signal(self.semaphore);
+	
+	return context;
+}
+
+- (NSManagedObjectContext *) readReplicaContext
+{
+	return [self azcr_readReplicaContextForEntityName: nil];
+}
+
+- (NSManagedObjectContext *) azcr_routedReadReplicaContextForRequest: (NSFetchRequest *) request
+{
+	if (!self.stackShouldRouteBackgroundReads || [NSThread isMainThread])
+		return nil;
+	
+	return [self azcr_readReplicaContextForEntityName: request.entityName ?: request.entity.name];
+}
+
+- (void) azcr_refreshReadReplicaIfStale: (NSManagedObjectContext *) replica
+{
+	// Called on the replica's queue
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+	CFAbsoluteTime lastRefresh = [objc_getAssociatedObject(replica, azcr_replicaRefreshKey) doubleValue];
+	if ((now - lastRefresh) <= self.stackReadReplicaStaleness)
+		return;
+	
+	[replica reset];
+	objc_setAssociatedObject(replica, azcr_replicaRefreshKey, [NSNumber numberWithDouble: now], OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+}
+
+- (NSArray *) objectIDsForFetchRequestOnReadReplica: (NSFetchRequest *) request
+{
+	NSManagedObjectContext *replica = [self azcr_routedReadReplicaContextForRequest: request];
+	if (!replica)
+		return nil;
+	
+	NSFetchRequest *replicaRequest = [request copy];
+	replicaRequest.resultType = NSManagedObjectIDResultType;
+	
+	NSPersistentStoreCoordinator *coordinator = self.persistentStoreCoordinator;
+	__block NSArray *objectIDs = nil;
+	
+	[replica performBlockAndWait: ^{
+		[self azcr_refreshReadReplicaIfStale: replica];
+		
+		NSError *error = nil;
+		NSArray *replicaIDs = [replica executeFetchRequest: replicaRequest error: &error];
+		[AZCoreRecordManager handleError: error];
+		if (!replicaIDs)
+			return;
+		
+		// IDs belong to the replica's stores; map them back by URI
+		NSMutableArray *translatedIDs = [NSMutableArray arrayWithCapacity: replicaIDs.count];
+		for (NSManagedObjectID *objectID in replicaIDs)
+		{
+			NSManagedObjectID *translatedID = [coordinator managedObjectIDForURIRepresentation: objectID.URIRepresentation];
+			if (translatedID)
+				[translatedIDs addObject: translatedID];
+		}
+		objectIDs = translatedIDs;
+	}];
+	
+	return objectIDs;
+}
+
+- (NSUInteger) countForFetchRequestOnReadReplica: (NSFetchRequest *) request
+{
+	NSManagedObjectContext *replica = [self azcr_routedReadReplicaContextForRequest: request];
+	if (!replica)
+		return NSNotFound;
+	
+	__block NSUInteger count = NSNotFound;
+	
+	[replica performBlockAndWait: ^{
+		[self azcr_refreshReadReplicaIfStale: replica];
+		
+		NSError *error = nil;
+		count = [replica countForFetchRequest: request error: &error];
+		[AZCoreRecordManager handleError: error];
+	}];
+	
+	return count;
+}
+
+- (void) setStackReadReplicaCount: (NSUInteger) stackReadReplicaCount
+{
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	
+	_stackReadReplicaCount = stackReadReplicaCount;
+	_readReplicaContexts = nil;
+	
+	dispatch_semaphore_signal(self.semaphore);
+}
+
+- (void) setStackReadReplicaStaleness: (NSTimeInterval) stackReadReplicaStaleness
+{
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	
+	_stackReadReplicaStaleness = stackReadReplicaStaleness;
+	_readReplicaContexts = nil;
+	
+	dispatch_semaphore_signal(self.semaphore);
+}
+
+#pragma mark - Helpers
+
+- (NSURL *) azcr_ensureDirectoryAtURL: (NSURL *) directoryURL
+{
+	// Creating an existing directory is a no-op, so skip the separate existence check
+	NSError *error = nil;
+	if (![self.fileManager createDirectoryAtURL: directoryURL withIntermediateDirectories: YES attributes: nil error: &error])
+		[AZCoreRecordManager handleError: error];
+	return directoryURL;
+}
+
+- (NSURL *)stackStoreURL {
+	dispatch_semaphore_wait(_layoutSemaphore, DISPATCH_TIME_FOREVER);
+	
+	if (!_stackStoreURL) {
+		NSURL *appSupportRoot = [[self.fileManager URLsForDirectory:NSApplicationSupportDirectory inDomains:NSUserDomainMask] lastObject];
+		NSString *applicationName = [[[NSBundle mainBundle] infoDictionary] valueForKey:(NSString *)kCFBundleNameKey];
+		NSURL *appSupportURL = [appSupportRoot URLByAppendingPathComponent: applicationName isDirectory: YES];
+		
+		NSString *storeName = self.stackName.lastPathComponent;
+		NSURL *storeDirectory = [storeName isEqualToString: appSupportURL.lastPathComponent] ? appSupportURL : [appSupportURL URLByAppendingPathComponent: storeName isDirectory: YES];
+		
+		_stackStoreURL = [self azcr_ensureDirectoryAtURL: storeDirectory];
+	}
+	
+	NSURL *storeDirectory = _stackStoreURL;
+	
+	dispatch_semaphore_signal(_layoutSemaphore);
+	
+	return storeDirectory;
+}
+
+- (NSURL *)ubiquitousStoreURL
+{
+	NSString *ubiquityToken = self.ubiquityToken;
+	if (!ubiquityToken.length)
+		return nil;
+	
+	NSURL *stackStoreURL = self.stackStoreURL;
+	
+	dispatch_semaphore_wait(_layoutSemaphore, DISPATCH_TIME_FOREVER);
+	
+	if (!_ubiquitousStoreDirectoryURL)
+		_ubiquitousStoreDirectoryURL = [self azcr_ensureDirectoryAtURL: [stackStoreURL URLByAppendingPathComponent: ubiquityToken isDirectory: YES]];
+	
+	NSURL *iCloudStoreURL = _ubiquitousStoreDirectoryURL;
+	
+	dispatch_semaphore_signal(_layoutSemaphore);
+	
+	return [iCloudStoreURL URLByAppendingPathComponent: @"UbiquitousStore.sqlite"];
+}
+
+- (NSURL *) azcr_ubiquityContainerURL
+{
+	dispatch_semaphore_wait(_layoutSemaphore, DISPATCH_TIME_FOREVER);
+	
+	if (!_ubiquityContainerResolved) {
+		_ubiquityContainerURL = [self.fileManager URLForUbiquityContainerIdentifier: nil];
+		_ubiquityContainerResolved = YES;
+	}
+	
+	NSURL *containerURL = _ubiquityContainerURL;
 	
-	return context;
+	dispatch_semaphore_signal(_layoutSemaphore);
+	
+	return containerURL;
 }
 
-#pragma mark - Helpers
-
-- (NSURL *)stackStoreURL {
-	static dispatch_once_t onceToken;
-	static NSURL *appSupportURL = nil;
-	dispatch_once(&onceToken, ^{
-		NSURL *appSupportRoot = [[self.fileManager URLsForDirectory:NSApplicationSupportDirectory inDomains:NSUserDomainMask] lastObject];
-        NSString *applicationName = [[[NSBundle mainBundle] infoDictionary] valueForKey:(NSString *)kCFBundleNameKey];
-        appSupportURL = [appSupportRoot URLByAppendingPathComponent: applicationName isDirectory: YES];
-	});
-    
-	NSString *storeName = self.stackName.lastPathComponent;
-	NSURL *storeDirectory = [storeName isEqualToString: appSupportURL.lastPathComponent] ? appSupportURL : [appSupportURL URLByAppendingPathComponent: storeName isDirectory: YES];
-    
-    if (![self.fileManager fileExistsAtPath: storeDirectory.path]) {
-        NSError *error = nil;
-        [self.fileManager createDirectoryAtURL: storeDirectory withIntermediateDirectories: YES attributes: nil error: &error];
-        [AZCoreRecordManager handleError: error];
-    }
-    
-	return storeDirectory;
+- (void) azcr_invalidateStoreLayout
+{
+	dispatch_semaphore_wait(_layoutSemaphore, DISPATCH_TIME_FOREVER);
+	
+	_stackStoreURL = nil;
+	_ubiquitousStoreDirectoryURL = nil;
+	_ubiquityContainerURL = nil;
+	_ubiquityContainerResolved = NO;
+	
+	dispatch_semaphore_signal(_layoutSemaphore);
 }
 
-- (NSURL *)ubiquitousStoreURL
+- (void) setUbiquityToken: (NSString *) ubiquityToken
 {
-    if (!self.ubiquityToken.length)
-        return nil;
-    
-    NSURL *iCloudStoreURL = [self.stackStoreURL URLByAppendingPathComponent: self.ubiquityToken];
-    
-    if (![self.fileManager fileExistsAtPath: iCloudStoreURL.path]) {
-        NSError *error = nil;
-        [self.fileManager createDirectoryAtURL: iCloudStoreURL withIntermediateDirectories: YES attributes: nil error: &error];
-        [AZCoreRecordManager handleError: error];
-    }
-    
-    return [iCloudStoreURL URLByAppendingPathComponent: @"UbiquitousStore.sqlite"];
+	if (_ubiquityToken == ubiquityToken || [_ubiquityToken isEqualToString: ubiquityToken])
+		return;
+	
+	_ubiquityToken = [ubiquityToken copy];
+	[self azcr_invalidateStoreLayout];
 }
 
 - (NSURL *)fallbackStoreURL
@@ -257,11 +1160,19 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 	return [self.stackStoreURL URLByAppendingPathComponent: @"LocalStore.sqlite"];
 }
 
+- (NSURL *)storeURLForShard: (AZCoreRecordStoreShard *) shard
+{
+	if ([shard.storeType isEqualToString: NSInMemoryStoreType])
+		return nil;
+	
+	return [self.stackStoreURL URLByAppendingPathComponent: shard.fileName];
+}
+
 - (BOOL)isReadOnly {
 	if (!self.stackShouldUseUbiquity)
 		return NO;
     
-	return self.ubiquityToken.length && !![self.fileManager URLForUbiquityContainerIdentifier: nil];
+	return self.ubiquityToken.length && !![self azcr_ubiquityContainerURL];
 }
 
 #pragma mark - Persistent stores
@@ -278,59 +1189,246 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 	return lightweightMigrationOptions;
 }
 
-- (void)azcr_loadPersistentStores {
+- (NSDictionary *) azcr_storeOptions
+{
+	return (self.stackShouldUseUbiquity || self.stackShouldAutoMigrateStore) ? [self azcr_lightweightMigrationOptions] : [NSDictionary dictionary];
+}
+
+- (NSDictionary *) azcr_SQLiteStoreOptionsWithOptions: (NSDictionary *) options
+{
+	NSDictionary *pragmas = self.stackSQLiteOptions.pragmas;
+	if (!pragmas.count)
+		return options;
+	
+	NSMutableDictionary *tunedOptions = [options mutableCopy];
+	[tunedOptions setObject: pragmas forKey: NSSQLitePragmasOption];
+	return tunedOptions;
+}
+
+- (AZCoreRecordMigrator *) azcr_migratorForModel: (NSManagedObjectModel *) model
+{
+	NSURL *modelURL = self.stackModelURL;
+	if ([modelURL.URLByDeletingLastPathComponent.pathExtension isEqualToString: @"momd"])
+		modelURL = modelURL.URLByDeletingLastPathComponent;
+	
+	NSArray *modelURLs = modelURL ? [NSManagedObjectModel modelVersionURLsAtURL: modelURL] : [NSManagedObjectModel modelVersionURLsInBundle: [NSBundle mainBundle]];
+	
+	return [[AZCoreRecordMigrator alloc] initWithDestinationModel: model modelURLs: modelURLs bundles: nil];
+}
+
+- (NSArray *) azcr_storesRequiringMigrationWithMigrator: (AZCoreRecordMigrator *) migrator
+{
+	NSString *localConfiguration = [self.stackModelConfigurations objectForKey: AZCoreRecordLocalStoreConfigurationNameKey];
+	NSString *ubiquitousConfiguration = [self.stackModelConfigurations objectForKey: AZCoreRecordUbiquitousStoreConfigurationNameKey];
+	NSMutableArray *stores = [NSMutableArray array];
+	
+	// A nil configuration simply ends the dictionary early
+	if (localConfiguration.length)
+		[stores addObject: [NSDictionary dictionaryWithObjectsAndKeys: self.localStoreURL, azcr_migrationURLKey, NSSQLiteStoreType, azcr_migrationTypeKey, localConfiguration, azcr_migrationConfigurationKey, nil]];
+	
+	if (!self.stackShouldUseInMemoryStore)
+		[stores addObject: [NSDictionary dictionaryWithObjectsAndKeys: self.fallbackStoreURL, azcr_migrationURLKey, NSSQLiteStoreType, azcr_migrationTypeKey, ubiquitousConfiguration, azcr_migrationConfigurationKey, nil]];
+	
+	for (AZCoreRecordStoreShard *shard in self.stackStoreShards)
+	{
+		NSURL *URL = [self storeURLForShard: shard];
+		if (URL)
+			[stores addObject: [NSDictionary dictionaryWithObjectsAndKeys: URL, azcr_migrationURLKey, shard.storeType, azcr_migrationTypeKey, shard.configurationName, azcr_migrationConfigurationKey, nil]];
+	}
+	
+	NSIndexSet *indexes = [stores indexesOfObjectsPassingTest: ^BOOL(NSDictionary *store, NSUInteger idx, BOOL *stop) {
+		return [migrator storeRequiresMigrationAtURL: [store objectForKey: azcr_migrationURLKey] type: [store objectForKey: azcr_migrationTypeKey] configuration: [store objectForKey: azcr_migrationConfigurationKey]];
+	}];
+	
+	return [stores objectsAtIndexes: indexes];
+}
+
+- (void)azcr_migrateStores: (NSArray *) stores withMigrator: (AZCoreRecordMigrator *) migrator {
+    NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+    NSUInteger storeCount = stores.count;
+    
+    [stores enumerateObjectsUsingBlock: ^(NSDictionary *store, NSUInteger idx, BOOL *stop) {
+        NSError *error = nil;
+        [migrator migrateStoreAtURL: [store objectForKey: azcr_migrationURLKey] type: [store objectForKey: azcr_migrationTypeKey] configuration: [store objectForKey: azcr_migrationConfigurationKey] progress: ^(float progress) {
+            NSNumber *overall = [NSNumber numberWithFloat: (idx + progress) / storeCount];
+            [nc postNotificationName: AZCoreRecordManagerMigrationProgressNotification object: self userInfo: [NSDictionary dictionaryWithObject: overall forKey: AZCoreRecordMigrationProgressKey]];
+        } error: &error];
+        [AZCoreRecordManager handleError: error];
+    }];
+    
+    [nc postNotificationName: AZCoreRecordManagerDidMigrateStoresNotification object: self];
+}
+
+- (NSMutableDictionary *)azcr_seedStoreAtURL: (NSURL *) storeURL fromBundledStoreAtURL: (NSURL *) bundleURL error: (NSError **) error {
+    // Copy beside the destination and rename, so a copy cut short never
+    // looks like an existing store on the next launch
+    NSURL *partialURL = [storeURL.URLByDeletingLastPathComponent URLByAppendingPathComponent: [NSString stringWithFormat: @".%@.seeding", storeURL.lastPathComponent]];
+    [self.fileManager removeItemAtURL: partialURL error: NULL];
+    
+    CFAbsoluteTime copyStart = CFAbsoluteTimeGetCurrent();
+    NSString *method = azcr_cloneOrCopyFile(bundleURL, partialURL, error);
+    if (!method) {
+        [self.fileManager removeItemAtURL: partialURL error: NULL];
+        return nil;
+    }
+    
+    if (![self.fileManager moveItemAtURL: partialURL toURL: storeURL error: error]) {
+        [self.fileManager removeItemAtURL: partialURL error: NULL];
+        return nil;
+    }
+    
+    NSMutableDictionary *seedInfo = [NSMutableDictionary dictionaryWithCapacity: 5];
+    [seedInfo setObject: method forKey: AZCoreRecordSeedMethodKey];
+    [seedInfo setObject: [NSNumber numberWithDouble: CFAbsoluteTimeGetCurrent() - copyStart] forKey: AZCoreRecordSeedCopyDurationKey];
+    return seedInfo;
+}
+
+- (void)azcr_checkSeededStoreAtURL: (NSURL *) storeURL configuration: (NSString *) configuration model: (NSManagedObjectModel *) model seedInfo: (NSMutableDictionary *) seedInfo {
+    // The store is already attached, so the integrity check runs off the
+    // startup path; it only reads, so it doesn't block the stack.
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        CFAbsoluteTime checkStart = CFAbsoluteTimeGetCurrent();
+        
+        NSError *error = nil;
+        NSString *result = azcr_quickCheckStore(storeURL, &error);
+        NSDictionary *metadata = [NSPersistentStoreCoordinator metadataForPersistentStoreOfType: NSSQLiteStoreType URL: storeURL error: NULL];
+        BOOL passed = [result isEqualToString: @"ok"] && metadata && [model isConfiguration: configuration compatibleWithStoreMetadata: metadata];
+        
+        [seedInfo setObject: [NSNumber numberWithDouble: CFAbsoluteTimeGetCurrent() - checkStart] forKey: AZCoreRecordSeedIntegrityCheckDurationKey];
+        [seedInfo setObject: [NSNumber numberWithBool: passed] forKey: AZCoreRecordSeedIntegrityCheckPassedKey];
+        if (result)
+            [seedInfo setObject: result forKey: AZCoreRecordSeedIntegrityCheckResultKey];
+        
+        if (!passed) {
+            if (!error) {
+                NSString *reason = result.length ? [NSString stringWithFormat: @"The seeded local store failed its integrity check: %@", result] : @"The seeded local store does not match the model.";
+                NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys: reason, NSLocalizedDescriptionKey, storeURL, NSURLErrorKey, nil];
+                error = [NSError errorWithDomain: AZCoreRecordErrorDomain code: AZCoreRecordInvalidConfigurationError userInfo: userInfo];
+            }
+            [AZCoreRecordManager handleError: error];
+        }
+        
+        [[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordManagerDidSeedLocalStoreNotification object: self userInfo: [seedInfo copy]];
+    });
+}
+
+- (void)azcr_loadPersistentStoresIntoCoordinator: (NSPersistentStoreCoordinator *) coordinator {
     dispatch_semaphore_wait(self.loadSemaphore, DISPATCH_TIME_FOREVER);
     
+    // A rebuilt stack opens the same files beside the live one, which keeps
+    // serving until the swap; SQLite locks between the two as it does for
+    // the read replicas and maintenance connections. A different model may
+    // migrate the files in place, though, so then the live stores are let
+    // go of first and the stack isn't ready until the swap.
+    NSPersistentStoreCoordinator *liveCoordinator = _persistentStoreCoordinator;
+    if (liveCoordinator && liveCoordinator != coordinator && ![liveCoordinator.managedObjectModel isEqual: coordinator.managedObjectModel]) {
+        [self azcr_markStackNotReady];
+        [self azcr_detachStores: liveCoordinator.persistentStores fromCoordinator: liveCoordinator];
+    }
+    
+    [self azcr_migrateAndAddPersistentStoresToCoordinator: coordinator];
+}
+
+- (void)azcr_migrateAndAddPersistentStoresToCoordinator: (NSPersistentStoreCoordinator *) coordinator {
+    // Called with the load semaphore held
+    AZCoreRecordMigrator *migrator = self.stackShouldMigrateInBackground ? [self azcr_migratorForModel: coordinator.managedObjectModel] : nil;
+    NSArray *pendingMigrations = migrator ? [self azcr_storesRequiringMigrationWithMigrator: migrator] : nil;
+    
+    if (!pendingMigrations.count) {
+        [self azcr_addPersistentStoresToCoordinator: coordinator];
+        return;
+    }
+    
+    // Stores are added once every outdated file has been walked up to the
+    // current model. This runs on the loading thread, so the coordinator is
+    // never handed out without its stores; loadStackWithCompletion: keeps
+    // it off the main thread.
+    [[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordManagerWillMigrateStoresNotification object: self];
+    
+    [self azcr_migrateStores: pendingMigrations withMigrator: migrator];
+    [self azcr_addPersistentStoresToCoordinator: coordinator];
+}
+
+- (void)azcr_addPersistentStoresToCoordinator: (NSPersistentStoreCoordinator *) coordinator {
+    // Called with the load semaphore held; finishing releases it
     NSString *localConfiguration = [self.stackModelConfigurations objectForKey: AZCoreRecordLocalStoreConfigurationNameKey];
-    NSString *ubiquitousConfiguration = [self.stackModelConfigurations objectForKey: AZCoreRecordUbiquitousStoreConfigurationNameKey];
     NSURL *localURL = self.localStoreURL;
-    NSURL *fallbackURL = self.fallbackStoreURL;
-    NSURL *ubiquityURL = self.ubiquitousStoreURL;
-    NSURL *ubiquityContainer = [self.fileManager URLForUbiquityContainerIdentifier:nil];
     
-    NSDictionary *options = (self.stackShouldUseUbiquity || self.stackShouldAutoMigrateStore) ? [self azcr_lightweightMigrationOptions] : [NSDictionary dictionary];
+    NSDictionary *options = [self azcr_storeOptions];
+    NSDictionary *sqliteOptions = [self azcr_SQLiteStoreOptionsWithOptions: options];
     
     if (localConfiguration.length) {
+        NSMutableDictionary *seedInfo = nil;
+        NSURL *bundleURL = nil;
+        
         if (![self.fileManager fileExistsAtPath: localURL.path]) {
-            NSURL *bundleURL = [[NSBundle mainBundle] URLForResource: localURL.lastPathComponent.stringByDeletingPathExtension withExtension: localURL.pathExtension];
+            bundleURL = [[NSBundle mainBundle] URLForResource: localURL.lastPathComponent.stringByDeletingPathExtension withExtension: localURL.pathExtension];
             if (bundleURL) {
                 NSError *error = nil;
-                if (![self.fileManager copyItemAtURL: bundleURL toURL: localURL error: &error]) {
+                seedInfo = [self azcr_seedStoreAtURL: localURL fromBundledStoreAtURL: bundleURL error: &error];
+                
+                // Report it and carry on with an empty local store, so the
+                // stack still becomes ready.
+                if (!seedInfo)
                     [AZCoreRecordManager handleError: error];
-                    return;
-                }
             }
         }
         
-        [self.persistentStoreCoordinator addStoreAtURL: localURL configuration: localConfiguration options: options];
+        CFAbsoluteTime attachStart = CFAbsoluteTimeGetCurrent();
+        [coordinator addStoreAtURL: localURL configuration: localConfiguration options: [self.maintenanceScheduler storeOptions: sqliteOptions forAttachingStoreAtURL: localURL]];
+        
+        if (seedInfo) {
+            [seedInfo setObject: [NSNumber numberWithDouble: CFAbsoluteTimeGetCurrent() - attachStart] forKey: AZCoreRecordSeedAttachDurationKey];
+            [self azcr_checkSeededStoreAtURL: localURL configuration: localConfiguration model: coordinator.managedObjectModel seedInfo: seedInfo];
+        }
     }
     
+    if (self.stackStoreShards.count)
+        [self azcr_addStoreShards: self.stackStoreShards toCoordinator: coordinator options: options];
+    
+    [self azcr_attachSyncedStoreToCoordinator: coordinator options: options sqliteOptions: sqliteOptions completion: ^{
+        [[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordManagerDidFinishAdddingPersistentStoresNotification object: self];
+        [self azcr_didLoadPersistentStoresIntoCoordinator: coordinator];
+        dispatch_semaphore_signal(self.loadSemaphore);
+    }];
+}
+
+- (void)azcr_attachSyncedStoreToCoordinator: (NSPersistentStoreCoordinator *) coordinator options: (NSDictionary *) options sqliteOptions: (NSDictionary *) sqliteOptions completion: (void (^)(void)) completion {
+    // The ubiquitous store, or the fallback standing in for it. Called with
+    // the load semaphore held; whichever is added is remembered, so a
+    // reattach can find it without going by configuration name.
+    NSString *ubiquitousConfiguration = [self.stackModelConfigurations objectForKey: AZCoreRecordUbiquitousStoreConfigurationNameKey];
+    NSURL *fallbackURL = self.fallbackStoreURL;
+    NSURL *ubiquityURL = self.ubiquitousStoreURL;
+    NSURL *ubiquityContainer = [self azcr_ubiquityContainerURL];
+    
     NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+    AZCoreRecordChangeJournal *journal = self.stackShouldUseInMemoryStore ? nil : [self azcr_changeJournalForStoreURL: fallbackURL];
+    [journal stopRecording];
 
     void (^addFallback)(void) = ^{
         
-        NSMutableDictionary *storeOptions = [options mutableCopy];
-        
-        if (self.stackShouldUseInMemoryStore)
-            [self.persistentStoreCoordinator addInMemoryStoreWithConfiguration: ubiquitousConfiguration options: storeOptions];
-        else
-            [self.persistentStoreCoordinator addStoreAtURL: fallbackURL configuration: ubiquitousConfiguration options: storeOptions];
+        if (self.stackShouldUseInMemoryStore) {
+            _syncedStore = [coordinator addInMemoryStoreWithConfiguration: ubiquitousConfiguration options: options];
+        } else {
+            NSPersistentStore *fallbackStore = _syncedStore = [coordinator addStoreAtURL: fallbackURL configuration: ubiquitousConfiguration options: [self.maintenanceScheduler storeOptions: sqliteOptions forAttachingStoreAtURL: fallbackURL]];
+            
+            // Remember what changes offline so only that has to be carried
+            // over once the ubiquitous store is reachable.
+            if (fallbackStore && self.stackShouldUseUbiquity)
+                [journal startRecordingChangesToStore: fallbackStore];
+        }
         
         [nc postNotificationName: AZCoreRecordManagerDidAddFallbackStoreNotification object: self];
         _ubiquityEnabled = NO;
     };
     
-    void (^finish)(void) = ^{
-        [nc postNotificationName: AZCoreRecordManagerDidFinishAdddingPersistentStoresNotification object: self];
-        dispatch_semaphore_signal(self.loadSemaphore);
-    };
-    
     if (self.stackShouldUseUbiquity && ubiquityURL) {
         [nc postNotificationName: AZCoreRecordManagerWillAddUbiquitousStoreNotification object: self];
         
         dispatch_queue_t globalQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
         dispatch_async(globalQueue, ^{
-            NSMutableDictionary *storeOptions = [options mutableCopy];
+            NSMutableDictionary *storeOptions = [sqliteOptions mutableCopy];
             BOOL fallback = NO;
             
             if (ubiquityContainer) {
@@ -341,7 +1439,18 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
                 fallback = YES;
             }
             
-            if ([self.persistentStoreCoordinator addStoreAtURL: ubiquityURL configuration: ubiquitousConfiguration options: storeOptions]) {
+            // Core Data's ubiquity support expects one coordinator per
+            // ubiquitous store in a process, so this is the one file a
+            // rebuilt stack takes over rather than sharing; until the swap,
+            // the old stack has no synced store.
+            NSPersistentStoreCoordinator *liveCoordinator = _persistentStoreCoordinator;
+            NSPersistentStore *liveStore = (ubiquityContainer && liveCoordinator != coordinator) ? [liveCoordinator persistentStoreForURL: ubiquityURL] : nil;
+            if (liveStore)
+                [self azcr_detachStores: [NSArray arrayWithObject: liveStore] fromCoordinator: liveCoordinator];
+            
+            NSPersistentStore *ubiquitousStore = [coordinator addStoreAtURL: ubiquityURL configuration: ubiquitousConfiguration options: storeOptions];
+            if (ubiquitousStore) {
+                _syncedStore = ubiquitousStore;
                 [nc postNotificationName: AZCoreRecordManagerDidAddUbiquitousStoreNotification object: self];
                 _ubiquityEnabled = YES;
             } else {
@@ -351,16 +1460,202 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
             if (fallback)
                 addFallback();
             
-            finish();
+            completion();
+            
+            if (!fallback && journal.changeCount) {
+                // A replacement stack is swapped in on the main queue; replay
+                // once that has happened so the merge reaches its context.
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    dispatch_async(globalQueue, ^{
+                        [self azcr_replayChangeJournal: journal fromStoreAtURL: fallbackURL intoStore: ubiquitousStore];
+                    });
+                });
+            }
         });
     } else {
         addFallback();
-        finish();
+        completion();
     }
 }
 
+- (AZCoreRecordChangeJournal *) azcr_changeJournalForStoreURL: (NSURL *) storeURL
+{
+	// Called with the load semaphore held
+	NSURL *journalURL = [[storeURL URLByDeletingPathExtension] URLByAppendingPathExtension: @"changes"];
+	
+	if (![_changeJournal.URL isEqual: journalURL])
+	{
+		[_changeJournal stopRecording];
+		_changeJournal = [[AZCoreRecordChangeJournal alloc] initWithURL: journalURL];
+	}
+	
+	return _changeJournal;
+}
+
+- (void) azcr_replayChangeJournal: (AZCoreRecordChangeJournal *) journal fromStoreAtURL: (NSURL *) sourceURL intoStore: (NSPersistentStore *) store
+{
+	NSPersistentStoreCoordinator *coordinator = store.persistentStoreCoordinator;
+	if (!coordinator || coordinator != self.persistentStoreCoordinator || ![self.fileManager fileExistsAtPath: sourceURL.path])
+		return;
+	
+	// The replay saves on this thread; pass those saves on to the main context
+	NSThread *replayThread = [NSThread currentThread];
+	NSManagedObjectContext *mainContext = self.managedObjectContext;
+	id observer = [[NSNotificationCenter defaultCenter] addObserverForName: NSManagedObjectContextDidSaveNotification object: nil queue: nil usingBlock: ^(NSNotification *note) {
+		NSManagedObjectContext *context = note.object;
+		if ([NSThread currentThread] == replayThread && context != mainContext && context.persistentStoreCoordinator == coordinator)
+			[mainContext mergeChangesFromNotification: note];
+	}];
+	
+	NSError *error = nil;
+	NSUInteger count = [journal replayChangesFromStoreAtURL: sourceURL intoStore: store pageSize: 500 error: &error];
+	
+	[[NSNotificationCenter defaultCenter] removeObserver: observer];
+	
+	if (count == NSNotFound)
+	{
+		[AZCoreRecordManager handleError: error];
+		return;
+	}
+	
+	[journal discard];
+	
+	NSDictionary *userInfo = [NSDictionary dictionaryWithObject: [NSNumber numberWithUnsignedInteger: count] forKey: AZCoreRecordReplayedChangeCountKey];
+	[[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordManagerDidReplayFallbackChangesNotification object: self userInfo: userInfo];
+}
+
+- (BOOL) azcr_validateStoreShards: (NSArray *) shards configurations: (NSDictionary *) configurations error: (NSError **) error
+{
+	// Shards share the store directory and the model with the local and
+	// synced stores, so none may reuse their files or configurations.
+	NSMutableSet *fileNames = [NSMutableSet setWithObjects: self.localStoreURL.lastPathComponent.lowercaseString, self.fallbackStoreURL.lastPathComponent.lowercaseString, nil];
+	NSMutableSet *configurationNames = [NSMutableSet set];
+	
+	NSString *localConfiguration = [configurations objectForKey: AZCoreRecordLocalStoreConfigurationNameKey];
+	NSString *ubiquitousConfiguration = [configurations objectForKey: AZCoreRecordUbiquitousStoreConfigurationNameKey];
+	if (localConfiguration.length)
+		[configurationNames addObject: localConfiguration];
+	if (ubiquitousConfiguration.length)
+		[configurationNames addObject: ubiquitousConfiguration];
+	
+	for (AZCoreRecordStoreShard *shard in shards)
+	{
+		if (![shard validate: error])
+			return NO;
+		
+		// File names compare the way a case-insensitive volume does
+		NSString *fileName = [self storeURLForShard: shard] ? shard.fileName.lowercaseString : nil;
+		NSString *reason = nil;
+		
+		if (fileName && [fileNames containsObject: fileName])
+			reason = [NSString stringWithFormat: @"The store shard file \"%@\" is already used by another store.", shard.fileName];
+		else if ([configurationNames containsObject: shard.configurationName])
+			reason = [NSString stringWithFormat: @"The configuration \"%@\" is already backed by another store.", shard.configurationName];
+		
+		if (reason)
+		{
+			if (error)
+				*error = [NSError errorWithDomain: AZCoreRecordErrorDomain code: AZCoreRecordInvalidConfigurationError userInfo: [NSDictionary dictionaryWithObject: reason forKey: NSLocalizedDescriptionKey]];
+			return NO;
+		}
+		
+		if (fileName)
+			[fileNames addObject: fileName];
+		[configurationNames addObject: shard.configurationName];
+	}
+	
+	return YES;
+}
+
+- (void) azcr_addStoreShards: (NSArray *) shards toCoordinator: (NSPersistentStoreCoordinator *) coordinator options: (NSDictionary *) options
+{
+	// The configurations may have changed since the shards were set
+	NSError *validationError = nil;
+	if (![self azcr_validateStoreShards: shards configurations: self.stackModelConfigurations error: &validationError])
+	{
+		[AZCoreRecordManager handleError: validationError];
+		return;
+	}
+	
+
+	NSManagedObjectModel *model = coordinator.managedObjectModel;
+	NSMutableArray *URLs = [NSMutableArray arrayWithCapacity: shards.count];
+	NSMutableArray *shardOptions = [NSMutableArray arrayWithCapacity: shards.count];
+	
+	for (AZCoreRecordStoreShard *shard in shards)
+	{
+		NSURL *URL = [self storeURLForShard: shard];
+		[URLs addObject: URL ?: (id)[NSNull null]];
+		
+		NSDictionary *pragmas = (shard.sqliteOptions ?: self.stackSQLiteOptions).pragmas;
+		if ([shard.storeType isEqualToString: NSSQLiteStoreType] && pragmas.count)
+		{
+			NSMutableDictionary *tunedOptions = [options mutableCopy];
+			[tunedOptions setObject: pragmas forKey: NSSQLitePragmasOption];
+			[shardOptions addObject: tunedOptions];
+		}
+		else
+		{
+			[shardOptions addObject: options];
+		}
+	}
+	
+	// Migration is the slow part of opening a store, and each shard is its own
+	// file, so bring outdated shards up to date concurrently on throwaway
+	// coordinators before adding them to the real one.
+	if ([[options objectForKey: NSMigratePersistentStoresAutomaticallyOption] boolValue])
+	{
+		dispatch_apply(shards.count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t idx) {
+			AZCoreRecordStoreShard *shard = [shards objectAtIndex: idx];
+			NSURL *URL = [URLs objectAtIndex: idx];
+			if ([URL isEqual: [NSNull null]])
+				return;
+			
+			NSDictionary *metadata = [NSPersistentStoreCoordinator metadataForPersistentStoreOfType: shard.storeType URL: URL error: NULL];
+			if (!metadata || [model isConfiguration: shard.configurationName compatibleWithStoreMetadata: metadata])
+				return;
+			
+			NSPersistentStoreCoordinator *migrator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: model];
+			NSError *error = nil;
+			NSPersistentStore *store = [migrator addPersistentStoreWithType: shard.storeType configuration: shard.configurationName URL: URL options: [shardOptions objectAtIndex: idx] error: &error];
+			[AZCoreRecordManager handleError: error];
+			
+			if (store)
+				[migrator removePersistentStore: store error: NULL];
+		});
+	}
+	
+	[shards enumerateObjectsUsingBlock: ^(AZCoreRecordStoreShard *shard, NSUInteger idx, BOOL *stop) {
+		NSError *error = nil;
+		
+		if (![model.configurations containsObject: shard.configurationName])
+		{
+			NSString *reason = [NSString stringWithFormat: @"The model has no configuration named \"%@\".", shard.configurationName];
+			error = [NSError errorWithDomain: AZCoreRecordErrorDomain code: AZCoreRecordInvalidConfigurationError userInfo: [NSDictionary dictionaryWithObject: reason forKey: NSLocalizedDescriptionKey]];
+			[AZCoreRecordManager handleError: error];
+			return;
+		}
+		
+		NSURL *URL = [URLs objectAtIndex: idx];
+		if ([URL isEqual: [NSNull null]])
+			URL = nil;
+		
+		NSDictionary *storeOptions = [shardOptions objectAtIndex: idx];
+		if ([shard.storeType isEqualToString: NSSQLiteStoreType])
+			storeOptions = [self.maintenanceScheduler storeOptions: storeOptions forAttachingStoreAtURL: URL];
+		
+		[coordinator addPersistentStoreWithType: shard.storeType configuration: shard.configurationName URL: URL options: storeOptions error: &error];
+		[AZCoreRecordManager handleError: error];
+	}];
+}
+
 - (void) azcr_resetStack
 {
+	[self azcr_markStackNotReady];
+	
+	_readReplicaContexts = nil;
+	[self azcr_invalidateStoreLayout];
+	
 	if (_managedObjectContext) {
         [self.managedObjectContext performBlockAndWait:^{
             [self.managedObjectContext reset];
@@ -381,20 +1676,88 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
     dispatch_queue_t globalQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
     dispatch_async(globalQueue, ^{
 		dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
-        
-        [self azcr_resetStack];
-        
         self.ubiquityToken = [[AZCoreRecordUbiquitySentinel sharedSentinel] ubiquityIdentityToken];
+		dispatch_semaphore_signal(self.semaphore);
         
-        [self azcr_loadPersistentStores];
-        
-        dispatch_semaphore_signal(self.semaphore);
+        [self azcr_reattachSyncedStore];
     });
 }
 
+- (void) azcr_reattachSyncedStore
+{
+	dispatch_semaphore_wait(_stackSemaphore, DISPATCH_TIME_FOREVER);
+	NSPersistentStoreCoordinator *coordinator = _persistentStoreCoordinator;
+	BOOL rebuilding = (_pendingPersistentStoreCoordinator != nil);
+	dispatch_semaphore_signal(_stackSemaphore);
+	
+	// Nothing built yet, or a full rebuild is already picking up the new
+	// identity; either way there's nothing to patch in place.
+	if (!coordinator || rebuilding)
+	{
+		[self azcr_rebuildStack];
+		return;
+	}
+	
+	dispatch_semaphore_wait(self.loadSemaphore, DISPATCH_TIME_FOREVER);
+	
+	// Only the synced store depends on the account; the local store and
+	// any shards stay attached and warm.
+	NSString *ubiquitousConfiguration = [self.stackModelConfigurations objectForKey: AZCoreRecordUbiquitousStoreConfigurationNameKey];
+	NSPersistentStore *syncedStore = (_syncedStore.persistentStoreCoordinator == coordinator) ? _syncedStore : nil;
+	
+	NSManagedObjectModel *model = coordinator.managedObjectModel;
+	NSArray *entities = ubiquitousConfiguration ? [model entitiesForConfiguration: ubiquitousConfiguration] : model.entities;
+	NSSet *entityNames = [NSSet setWithArray: [entities valueForKey: @"name"]];
+	
+	// Thread and queue contexts drop the affected objects the next time
+	// they're handed out, on their own thread or queue.
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	_invalidatedEntityNames = entityNames;
+	_invalidationGeneration++;
+	_readReplicaContexts = nil;
+	dispatch_semaphore_signal(self.semaphore);
+	
+	void (^attach)(void) = ^{
+		NSDictionary *options = [self azcr_storeOptions];
+		[self azcr_attachSyncedStoreToCoordinator: coordinator options: options sqliteOptions: [self azcr_SQLiteStoreOptionsWithOptions: options] completion: ^{
+			NSDictionary *userInfo = [NSDictionary dictionaryWithObject: entityNames forKey: AZCoreRecordInvalidatedEntityNamesKey];
+			[[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordManagerDidReattachUbiquitousStoreNotification object: self userInfo: userInfo];
+			dispatch_semaphore_signal(self.loadSemaphore);
+		}];
+	};
+	
+	// Detach in a main-queue block so the main context never sees a
+	// half-removed store between two of its own blocks. It's queued rather
+	// than waited on; the new store is opened back off the main queue.
+	NSManagedObjectContext *mainContext = self.managedObjectContext;
+	[mainContext performBlock: ^{
+		azcr_invalidateEntities(mainContext, entityNames);
+		
+		if (syncedStore)
+			azcr_removeStores([NSArray arrayWithObject: syncedStore], coordinator);
+		
+		dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), attach);
+	}];
+}
+
 - (void)azcr_didRecieveDeduplicationNotification:(NSNotification *)note
 {
-    [[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordManagerShouldRunDeduplicationNotification object: self];
+	// Seeding names its entities outright; ubiquitous imports list object IDs
+	NSSet *entityNames = [note.userInfo objectForKey: AZCoreRecordDeduplicationEntityNamesKey];
+	if (!entityNames && note.userInfo)
+	{
+		NSMutableSet *names = [NSMutableSet set];
+		for (NSString *key in [NSArray arrayWithObjects: NSInsertedObjectsKey, NSUpdatedObjectsKey, nil])
+			for (NSManagedObjectID *objectID in [note.userInfo objectForKey: key])
+				[names addObject: objectID.entity.name];
+		entityNames = names;
+	}
+	
+	NSDictionary *userInfo = entityNames ? [NSDictionary dictionaryWithObject: entityNames forKey: AZCoreRecordDeduplicationEntityNamesKey] : nil;
+    [[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordManagerShouldRunDeduplicationNotification object: self userInfo: userInfo];
+	
+	if (self.deduplicator.isEnabled && (!entityNames || entityNames.count))
+		[self.deduplicator deduplicateEntitiesNamed: entityNames completion: nil];
 }
 
 #pragma mark - Stack Settings
@@ -411,67 +1774,96 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 	NSAssert(documentClass, @"Not available on this OS.");
 	NSParameterAssert([managedDocument isKindOfClass:documentClass]);
 	
+	dispatch_semaphore_wait(_stackSemaphore, DISPATCH_TIME_FOREVER);
+	_pendingPersistentStoreCoordinator = nil;
+	dispatch_semaphore_signal(_stackSemaphore);
+	
 	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
 	
 	[self azcr_resetStack];
 	self.persistentStoreCoordinator = [[managedDocument managedObjectContext] persistentStoreCoordinator];
 	self.managedObjectContext = [managedDocument managedObjectContext];
+	[self azcr_markStackReady];
 	
 	dispatch_semaphore_signal(self.semaphore);
 }
 - (void) setStackModelName: (NSString *) stackModelName
 {
 	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
-	
-	[self azcr_resetStack];
 	_stackModelName = [stackModelName copy];
-	
 	dispatch_semaphore_signal(self.semaphore);
+	
+	[self azcr_rebuildStack];
 }
 - (void) setStackModelURL: (NSURL *) stackModelURL
 {
 	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
-	
-	[self azcr_resetStack];
 	_stackModelURL = [stackModelURL copy];
-	
 	dispatch_semaphore_signal(self.semaphore);
+	
+	[self azcr_rebuildStack];
 }
 - (void) setStackModelConfigurations:(NSDictionary *)stackModelConfigurations
 {
 	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
-	
-	[self azcr_resetStack];
 	_stackModelConfigurations = [stackModelConfigurations copy];
-	
 	dispatch_semaphore_signal(self.semaphore);
+	
+	[self azcr_rebuildStack];
 }
 - (void) setStackShouldAutoMigrateStore: (BOOL) stackShouldAutoMigrateStore
 {
 	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
-	
-	[self azcr_resetStack];
 	_stackShouldAutoMigrate = stackShouldAutoMigrateStore;
-	
 	dispatch_semaphore_signal(self.semaphore);
+	
+	[self azcr_rebuildStack];
 }
 - (void) setStackShouldUseInMemoryStore: (BOOL) stackShouldUseInMemoryStore
 {
 	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
-	
-	[self azcr_resetStack];
 	_stackShouldUseInMemoryStore = stackShouldUseInMemoryStore;
+	dispatch_semaphore_signal(self.semaphore);
+	
+	[self azcr_rebuildStack];
+}
+- (void) setStackSQLiteOptions: (AZCoreRecordSQLiteOptions *) stackSQLiteOptions
+{
+	NSError *error = nil;
+	if (stackSQLiteOptions && ![stackSQLiteOptions validate: &error])
+	{
+		[AZCoreRecordManager handleError: error];
+		return;
+	}
 	
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	_stackSQLiteOptions = [stackSQLiteOptions copy];
 	dispatch_semaphore_signal(self.semaphore);
+	
+	[self azcr_rebuildStack];
 }
-- (void) setStackShouldUseUbiquity: (BOOL) stackShouldUseUbiquity
+- (void) setStackStoreShards: (NSArray *) stackStoreShards
 {
+	NSError *error = nil;
+	if (![self azcr_validateStoreShards: stackStoreShards configurations: self.stackModelConfigurations error: &error])
+	{
+		[AZCoreRecordManager handleError: error];
+		return;
+	}
+	
 	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
+	_stackStoreShards = [[NSArray alloc] initWithArray: stackStoreShards copyItems: YES];
+	dispatch_semaphore_signal(self.semaphore);
 	
-	[self azcr_resetStack];
+	[self azcr_rebuildStack];
+}
+- (void) setStackShouldUseUbiquity: (BOOL) stackShouldUseUbiquity
+{
+	dispatch_semaphore_wait(self.semaphore, DISPATCH_TIME_FOREVER);
 	_stackShouldUseUbiquity = stackShouldUseUbiquity;
-	
 	dispatch_semaphore_signal(self.semaphore);
+	
+	[self azcr_rebuildStack];
 }
 
 #pragma mark - Ubiquity Support
@@ -516,6 +1908,10 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 {
 	[[self sharedManager] setStackShouldUseUbiquity: usesUbiquity];
 }
++ (void) setDefaultStackShouldMigrateInBackground: (BOOL) inBackground
+{
+	[[self sharedManager] setStackShouldMigrateInBackground: inBackground];
+}
 + (void) setDefaultStackModelName: (NSString *) name
 {
 	[[self sharedManager] setStackModelName: name];
@@ -528,6 +1924,14 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 {
 	[[self sharedManager] setStackModelConfigurations: dictionary];
 }
++ (void) setDefaultStackSQLiteOptions: (AZCoreRecordSQLiteOptions *) options
+{
+	[[self sharedManager] setStackSQLiteOptions: options];
+}
++ (void) setDefaultStackStoreShards: (NSArray *) shards
+{
+	[[self sharedManager] setStackStoreShards: shards];
+}
 
 + (void) setUpDefaultStackWithManagedDocument: (id) managedObject NS_AVAILABLE(10_4, 5_0)
 {
@@ -596,5 +2000,9 @@ NSString *const AZCoreRecordUbiquitousStoreConfigurationNameKey = @"UbiquitousSt
 {
 	[[self contextForCurrentThread] saveDataInBackgroundWithBlock: block completion: callback];
 }
+- (void) saveDataToPersistentStoreWithBlock: (void (^)(NSManagedObjectContext *context)) block completion: (void (^)(BOOL success)) callback
+{
+	[[self contextForCurrentThread] saveDataToPersistentStoreWithBlock: block completion: callback];
+}
 
 @end
@@ -0,0 +1,32 @@
+//
+//  AZCoreRecordMigrator.h
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import <CoreData/CoreData.h>
+
+/** Walks a store through a chain of model versions, one step at a time.
+
+ Each step uses a mapping model from the given bundles when one exists,
+ and otherwise an inferred mapping straight to the destination model.
+ Steps are written to a sibling file and swapped into place, so an
+ interrupted migration leaves the original store untouched. Each step is an
+ ordinary NSMigrationManager pass, which holds the whole store in memory, so
+ peak memory is that of the largest step.
+ */
+@interface AZCoreRecordMigrator : NSObject
+
+- (id) initWithDestinationModel: (NSManagedObjectModel *) destinationModel modelURLs: (NSArray *) modelURLs bundles: (NSArray *) bundles;
+
+@property (nonatomic, strong, readonly) NSManagedObjectModel *destinationModel;
+
+- (BOOL) storeRequiresMigrationAtURL: (NSURL *) URL type: (NSString *) storeType configuration: (NSString *) configuration;
+
+/** Runs every step synchronously. `progress` is called on the calling
+ thread with the fraction of the whole chain completed. */
+- (BOOL) migrateStoreAtURL: (NSURL *) URL type: (NSString *) storeType configuration: (NSString *) configuration progress: (void (^)(float progress)) progress error: (NSError **) error;
+
+@end
@@ -0,0 +1,236 @@
+//
+//  AZCoreRecordMigrator.m
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordMigrator.h"
+#import "AZCoreRecordManager.h"
+#import "NSManagedObjectModel+AZCoreRecord.h"
+
+static void *azcr_migrationProgressContext = &azcr_migrationProgressContext;
+
+@interface AZCoreRecordMigrator ()
+
+@property (nonatomic, strong, readwrite) NSManagedObjectModel *destinationModel;
+@property (nonatomic, copy) NSArray *modelURLs;
+@property (nonatomic, copy) NSArray *bundles;
+@property (nonatomic, copy) void (^stepProgress)(float progress);
+
+@end
+
+@implementation AZCoreRecordMigrator
+
+@synthesize destinationModel = _destinationModel, modelURLs = _modelURLs, bundles = _bundles, stepProgress = _stepProgress;
+
+- (id) initWithDestinationModel: (NSManagedObjectModel *) destinationModel modelURLs: (NSArray *) modelURLs bundles: (NSArray *) bundles
+{
+	NSParameterAssert(destinationModel);
+	
+	if ((self = [super init]))
+	{
+		self.destinationModel = destinationModel;
+		self.modelURLs = modelURLs;
+		self.bundles = bundles.count ? bundles : [NSArray arrayWithObject: [NSBundle mainBundle]];
+	}
+	
+	return self;
+}
+
+#pragma mark - Planning
+
+- (NSManagedObjectModel *) azcr_sourceModelForMetadata: (NSDictionary *) metadata configuration: (NSString *) configuration
+{
+	for (NSURL *modelURL in self.modelURLs)
+	{
+		NSManagedObjectModel *model = [NSManagedObjectModel cachedModelWithContentsOfURL: modelURL];
+		if ([model isConfiguration: configuration compatibleWithStoreMetadata: metadata])
+			return model;
+	}
+	
+	return nil;
+}
+
+- (NSArray *) azcr_stepsFromModel: (NSManagedObjectModel *) sourceModel error: (NSError **) error
+{
+	NSManagedObjectModel *destinationModel = self.destinationModel;
+	NSMutableArray *steps = [NSMutableArray array];
+	NSMutableSet *visited = [NSMutableSet setWithObject: sourceModel.entityVersionHashesByName];
+	NSManagedObjectModel *currentModel = sourceModel;
+	
+	while (![currentModel.entityVersionHashesByName isEqual: destinationModel.entityVersionHashesByName])
+	{
+		NSManagedObjectModel *nextModel = nil;
+		NSMappingModel *mapping = [NSMappingModel mappingModelFromBundles: self.bundles forSourceModel: currentModel destinationModel: destinationModel];
+		
+		if (mapping)
+		{
+			nextModel = destinationModel;
+		}
+		else
+		{
+			// Follow whichever intermediate version has a hand-written mapping
+			for (NSURL *modelURL in self.modelURLs)
+			{
+				NSManagedObjectModel *candidate = [NSManagedObjectModel cachedModelWithContentsOfURL: modelURL];
+				if (!candidate || [visited containsObject: candidate.entityVersionHashesByName])
+					continue;
+				
+				mapping = [NSMappingModel mappingModelFromBundles: self.bundles forSourceModel: currentModel destinationModel: candidate];
+				if (mapping)
+				{
+					nextModel = candidate;
+					break;
+				}
+			}
+		}
+		
+		if (!mapping)
+		{
+			mapping = [NSMappingModel inferredMappingModelForSourceModel: currentModel destinationModel: destinationModel error: error];
+			if (!mapping)
+				return nil;
+			
+			nextModel = destinationModel;
+		}
+		
+		[steps addObject: [NSArray arrayWithObjects: currentModel, nextModel, mapping, nil]];
+		[visited addObject: nextModel.entityVersionHashesByName];
+		currentModel = nextModel;
+	}
+	
+	return steps;
+}
+
+- (BOOL) storeRequiresMigrationAtURL: (NSURL *) URL type: (NSString *) storeType configuration: (NSString *) configuration
+{
+	NSDictionary *metadata = [NSPersistentStoreCoordinator metadataForPersistentStoreOfType: storeType URL: URL error: NULL];
+	if (!metadata)
+		return NO;
+	
+	return ![self.destinationModel isConfiguration: configuration compatibleWithStoreMetadata: metadata];
+}
+
+#pragma mark - Migration
+
+- (BOOL) migrateStoreAtURL: (NSURL *) URL type: (NSString *) storeType configuration: (NSString *) configuration progress: (void (^)(float progress)) progress error: (NSError **) error
+{
+	NSParameterAssert(URL);
+	
+	NSDictionary *metadata = [NSPersistentStoreCoordinator metadataForPersistentStoreOfType: storeType URL: URL error: error];
+	if (!metadata)
+		return NO;
+	
+	if ([self.destinationModel isConfiguration: configuration compatibleWithStoreMetadata: metadata])
+		return YES;
+	
+	NSManagedObjectModel *sourceModel = [self azcr_sourceModelForMetadata: metadata configuration: configuration];
+	if (!sourceModel)
+	{
+		if (error)
+			*error = [NSError errorWithDomain: AZCoreRecordErrorDomain code: AZCoreRecordInvalidConfigurationError userInfo: [NSDictionary dictionaryWithObject: @"No model version matches the store being migrated." forKey: NSLocalizedDescriptionKey]];
+		return NO;
+	}
+	
+	NSArray *steps = [self azcr_stepsFromModel: sourceModel error: error];
+	if (!steps)
+		return NO;
+	
+	NSFileManager *fileManager = [NSFileManager new];
+	BOOL isSQLite = [storeType isEqualToString: NSSQLiteStoreType];
+	
+	// Fold any write-ahead log into the main file first, so nothing is left
+	// in sidecar files that would outlive the swap.
+	if (isSQLite && ![self azcr_checkpointStoreAtURL: URL model: sourceModel configuration: configuration error: error])
+		return NO;
+	
+	NSURL *stepURL = [URL.URLByDeletingLastPathComponent URLByAppendingPathComponent: [NSString stringWithFormat: @".%@.migrating", URL.lastPathComponent]];
+	
+	// Write the intermediate file without a WAL so the swap is a single rename
+	NSDictionary *stepOptions = nil;
+	if (isSQLite)
+		stepOptions = [NSDictionary dictionaryWithObject: [NSDictionary dictionaryWithObject: @"DELETE" forKey: @"journal_mode"] forKey: NSSQLitePragmasOption];
+	
+	NSUInteger stepCount = steps.count;
+	__block BOOL success = YES;
+	__block NSError *stepError = nil;
+	
+	[steps enumerateObjectsUsingBlock: ^(NSArray *step, NSUInteger idx, BOOL *stop) {
+		// A step runs entirely in memory; the pool at least hands that back
+		// before the next step starts.
+		@autoreleasepool {
+			NSMigrationManager *manager = [[NSMigrationManager alloc] initWithSourceModel: [step objectAtIndex: 0] destinationModel: [step objectAtIndex: 1]];
+			
+			if (progress)
+			{
+				self.stepProgress = ^(float stepProgress) {
+					progress((idx + stepProgress) / stepCount);
+				};
+			}
+			
+			[fileManager removeItemAtURL: stepURL error: NULL];
+			[manager addObserver: self forKeyPath: @"migrationProgress" options: 0 context: azcr_migrationProgressContext];
+			
+			NSError *localError = nil;
+			success = [manager migrateStoreFromURL: URL type: storeType options: nil withMappingModel: [step objectAtIndex: 2] toDestinationURL: stepURL destinationType: storeType destinationOptions: stepOptions error: &localError];
+			
+			[manager removeObserver: self forKeyPath: @"migrationProgress" context: azcr_migrationProgressContext];
+			self.stepProgress = nil;
+			
+			if (success)
+				success = [fileManager replaceItemAtURL: URL withItemAtURL: stepURL backupItemName: nil options: 0 resultingItemURL: NULL error: &localError];
+			
+			// Sidecars of the old file must not be applied to the new one;
+			// they only go once the new file is in place.
+			if (success && isSQLite)
+			{
+				[fileManager removeItemAtURL: [NSURL fileURLWithPath: [URL.path stringByAppendingString: @"-wal"]] error: NULL];
+				[fileManager removeItemAtURL: [NSURL fileURLWithPath: [URL.path stringByAppendingString: @"-shm"]] error: NULL];
+			}
+			
+			if (!success)
+			{
+				stepError = localError;
+				[fileManager removeItemAtURL: stepURL error: NULL];
+				*stop = YES;
+			}
+		}
+	}];
+	
+	if (!success && error)
+		*error = stepError;
+	
+	if (success && progress)
+		progress(1.0f);
+	
+	return success;
+}
+
+- (BOOL) azcr_checkpointStoreAtURL: (NSURL *) URL model: (NSManagedObjectModel *) model configuration: (NSString *) configuration error: (NSError **) error
+{
+	// Leaving WAL mode checkpoints the log and deletes it
+	NSDictionary *options = [NSDictionary dictionaryWithObject: [NSDictionary dictionaryWithObject: @"DELETE" forKey: @"journal_mode"] forKey: NSSQLitePragmasOption];
+	NSPersistentStoreCoordinator *coordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: model];
+	NSPersistentStore *store = [coordinator addPersistentStoreWithType: NSSQLiteStoreType configuration: configuration URL: URL options: options error: error];
+	if (!store)
+		return NO;
+	
+	return [coordinator removePersistentStore: store error: error];
+}
+
+- (void) observeValueForKeyPath: (NSString *) keyPath ofObject: (id) object change: (NSDictionary *) change context: (void *) context
+{
+	if (context != azcr_migrationProgressContext)
+	{
+		[super observeValueForKeyPath: keyPath ofObject: object change: change context: context];
+		return;
+	}
+	
+	void (^stepProgress)(float) = self.stepProgress;
+	if (stepProgress)
+		stepProgress([(NSMigrationManager *) object migrationProgress]);
+}
+
+@end
@@ -0,0 +1,70 @@
+//
+//  AZCoreRecordSQLiteOptions.h
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+enum {
+	AZCoreRecordSQLiteJournalModeDefault = 0,
+	AZCoreRecordSQLiteJournalModeDelete,
+	AZCoreRecordSQLiteJournalModeTruncate,
+	AZCoreRecordSQLiteJournalModePersist,
+	AZCoreRecordSQLiteJournalModeMemory,
+	AZCoreRecordSQLiteJournalModeWAL
+};
+typedef NSUInteger AZCoreRecordSQLiteJournalMode;
+
+enum {
+	AZCoreRecordSQLiteSynchronousDefault = 0,
+	AZCoreRecordSQLiteSynchronousOff,
+	AZCoreRecordSQLiteSynchronousNormal,
+	AZCoreRecordSQLiteSynchronousFull
+};
+typedef NSUInteger AZCoreRecordSQLiteSynchronous;
+
+enum {
+	AZCoreRecordSQLiteAutoVacuumDefault = 0,
+	AZCoreRecordSQLiteAutoVacuumNone,
+	AZCoreRecordSQLiteAutoVacuumFull,
+	AZCoreRecordSQLiteAutoVacuumIncremental
+};
+typedef NSUInteger AZCoreRecordSQLiteAutoVacuum;
+
+/** Typed SQLite tuning for the stores an AZCoreRecordManager creates.
+
+ Zero or default values leave SQLite's own setting alone. The options are
+ turned into `NSSQLitePragmasOption` when the local, fallback, and
+ ubiquitous stores are added.
+ */
+@interface AZCoreRecordSQLiteOptions : NSObject <NSCopying>
+
+@property (nonatomic) AZCoreRecordSQLiteJournalMode journalMode;
+@property (nonatomic) AZCoreRecordSQLiteSynchronous synchronous;
+
+/** Only takes effect on new stores, or after a full vacuum. */
+@property (nonatomic) AZCoreRecordSQLiteAutoVacuum autoVacuum;
+
+/** Page cache size, as given to `PRAGMA cache_size`. Negative values are in
+ kibibytes rather than pages. */
+@property (nonatomic) NSInteger cacheSize;
+
+/** Maximum number of bytes SQLite may memory-map. Needs SQLite 3.7.17 or
+ later; older versions, including those shipped with iOS 5 and 6, ignore it
+ and read through the page cache as usual. */
+@property (nonatomic) unsigned long long mmapSize;
+
+/** WAL, normal sync, and a larger page cache. */
++ (AZCoreRecordSQLiteOptions *) writeHeavyOptions;
+
+/** WAL, normal sync, a large page cache, and memory-mapped reads. */
++ (AZCoreRecordSQLiteOptions *) readHeavyOptions;
+
+- (BOOL) validate: (NSError **) error;
+
+@property (nonatomic, readonly) NSDictionary *pragmas;
+
+@end
@@ -0,0 +1,124 @@
+//
+//  AZCoreRecordSQLiteOptions.m
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordSQLiteOptions.h"
+#import "AZCoreRecordManager.h"
+
+@implementation AZCoreRecordSQLiteOptions
+
+@synthesize journalMode = _journalMode, synchronous = _synchronous, autoVacuum = _autoVacuum, cacheSize = _cacheSize, mmapSize = _mmapSize;
+
+#pragma mark - Presets
+
++ (AZCoreRecordSQLiteOptions *) writeHeavyOptions
+{
+	AZCoreRecordSQLiteOptions *options = [self new];
+	options.journalMode = AZCoreRecordSQLiteJournalModeWAL;
+	options.synchronous = AZCoreRecordSQLiteSynchronousNormal;
+	options.cacheSize = -8192;
+	return options;
+}
+
++ (AZCoreRecordSQLiteOptions *) readHeavyOptions
+{
+	AZCoreRecordSQLiteOptions *options = [self new];
+	options.journalMode = AZCoreRecordSQLiteJournalModeWAL;
+	options.synchronous = AZCoreRecordSQLiteSynchronousNormal;
+	options.cacheSize = -16384;
+	options.mmapSize = 64 * 1024 * 1024;
+	return options;
+}
+
+#pragma mark - NSCopying
+
+- (id) copyWithZone: (NSZone *) zone
+{
+	AZCoreRecordSQLiteOptions *copy = [[[self class] allocWithZone: zone] init];
+	copy.journalMode = self.journalMode;
+	copy.synchronous = self.synchronous;
+	copy.autoVacuum = self.autoVacuum;
+	copy.cacheSize = self.cacheSize;
+	copy.mmapSize = self.mmapSize;
+	return copy;
+}
+
+#pragma mark - Validation
+
+- (BOOL) validate: (NSError **) error
+{
+	NSString *reason = nil;
+	
+	if (self.journalMode > AZCoreRecordSQLiteJournalModeWAL)
+		reason = @"Unknown SQLite journal mode.";
+	else if (self.synchronous > AZCoreRecordSQLiteSynchronousFull)
+		reason = @"Unknown SQLite synchronous level.";
+	else if (self.autoVacuum > AZCoreRecordSQLiteAutoVacuumIncremental)
+		reason = @"Unknown SQLite auto-vacuum mode.";
+	else if (self.journalMode == AZCoreRecordSQLiteJournalModeMemory && self.synchronous == AZCoreRecordSQLiteSynchronousOff)
+		reason = @"An in-memory journal with synchronous off cannot survive a crash.";
+	
+	if (!reason)
+		return YES;
+	
+	if (error)
+		*error = [NSError errorWithDomain: AZCoreRecordErrorDomain code: AZCoreRecordInvalidConfigurationError userInfo: [NSDictionary dictionaryWithObject: reason forKey: NSLocalizedDescriptionKey]];
+	
+	return NO;
+}
+
+#pragma mark - Pragmas
+
+- (NSDictionary *) pragmas
+{
+	NSMutableDictionary *pragmas = [NSMutableDictionary dictionaryWithCapacity: 5];
+	
+	NSString *journalMode = nil;
+	switch (self.journalMode)
+	{
+		case AZCoreRecordSQLiteJournalModeDelete:	journalMode = @"DELETE";	break;
+		case AZCoreRecordSQLiteJournalModeTruncate:	journalMode = @"TRUNCATE";	break;
+		case AZCoreRecordSQLiteJournalModePersist:	journalMode = @"PERSIST";	break;
+		case AZCoreRecordSQLiteJournalModeMemory:	journalMode = @"MEMORY";	break;
+		case AZCoreRecordSQLiteJournalModeWAL:		journalMode = @"WAL";		break;
+		default: break;
+	}
+	if (journalMode)
+		[pragmas setObject: journalMode forKey: @"journal_mode"];
+	
+	NSString *synchronous = nil;
+	switch (self.synchronous)
+	{
+		case AZCoreRecordSQLiteSynchronousOff:		synchronous = @"OFF";		break;
+		case AZCoreRecordSQLiteSynchronousNormal:	synchronous = @"NORMAL";	break;
+		case AZCoreRecordSQLiteSynchronousFull:		synchronous = @"FULL";		break;
+		default: break;
+	}
+	if (synchronous)
+		[pragmas setObject: synchronous forKey: @"synchronous"];
+	
+	NSString *autoVacuum = nil;
+	switch (self.autoVacuum)
+	{
+		case AZCoreRecordSQLiteAutoVacuumNone:			autoVacuum = @"NONE";			break;
+		case AZCoreRecordSQLiteAutoVacuumFull:			autoVacuum = @"FULL";			break;
+		case AZCoreRecordSQLiteAutoVacuumIncremental:	autoVacuum = @"INCREMENTAL";	break;
+		default: break;
+	}
+	if (autoVacuum)
+		[pragmas setObject: autoVacuum forKey: @"auto_vacuum"];
+	
+	if (self.cacheSize)
+		[pragmas setObject: [NSString stringWithFormat: @"%ld", (long) self.cacheSize] forKey: @"cache_size"];
+	
+	if (self.mmapSize)
+		[pragmas setObject: [NSString stringWithFormat: @"%llu", self.mmapSize] forKey: @"mmap_size"];
+	
+	return pragmas;
+}
+
+@end
@@ -0,0 +1,54 @@
+//
+//  AZCoreRecordSectionDiff.h
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/** The section and row changes between two snapshots of a sectioned list,
+ in the form a table or collection view applies inside one batch update.
+
+ A snapshot is a flat array of object IDs (or any other hashable
+ identifiers) and a parallel array of section keys, one per row, with the
+ rows of each section kept together. Passing nil section keys puts every
+ row in a single section. An identifier that appears more than once is
+ matched occurrence by occurrence, the first with the first and so on.
+
+ Rows are matched by identifier in one pass over each snapshot. Of the
+ rows that stay in their section, the longest run still in the same
+ relative order stays put and only the rest are reported as moves;
+ sections are treated the same way, and a section that changes places is
+ reported as deleted and inserted along with its rows. Finding those runs
+ takes O(n log n) time in the rows and sections that stay, on top of the
+ linear matching.
+
+ Deleted and updated index paths and moves' sources refer to the old
+ snapshot; inserted index paths, inserted sections, and moves'
+ destinations refer to the new one. Rows that moved are not also listed as
+ updated, so reconfigure them after applying the moves.
+ */
+@interface AZCoreRecordSectionDiff : NSObject
+
+/** Computes the diff on the calling thread. */
++ (AZCoreRecordSectionDiff *) diffFromObjectIDs: (NSArray *) oldObjectIDs sectionKeys: (NSArray *) oldSectionKeys toObjectIDs: (NSArray *) newObjectIDs sectionKeys: (NSArray *) newSectionKeys updatedObjectIDs: (NSSet *) updatedObjectIDs;
+
+/** Computes the diff on a shared background queue and hands it to the
+ completion on the main queue, in the order the diffs were requested. */
++ (void) diffFromObjectIDs: (NSArray *) oldObjectIDs sectionKeys: (NSArray *) oldSectionKeys toObjectIDs: (NSArray *) newObjectIDs sectionKeys: (NSArray *) newSectionKeys updatedObjectIDs: (NSSet *) updatedObjectIDs completion: (void (^)(AZCoreRecordSectionDiff *diff)) completion;
+
+@property (nonatomic, readonly) NSIndexSet *deletedSections;
+@property (nonatomic, readonly) NSIndexSet *insertedSections;
+
+@property (nonatomic, readonly) NSArray *deletedIndexPaths;
+@property (nonatomic, readonly) NSArray *insertedIndexPaths;
+@property (nonatomic, readonly) NSArray *updatedIndexPaths;
+
+/** Pairs of index paths, each an array of the old and the new one. */
+@property (nonatomic, readonly) NSArray *movedIndexPaths;
+
+@property (nonatomic, readonly, getter = isEmpty) BOOL empty;
+
+@end
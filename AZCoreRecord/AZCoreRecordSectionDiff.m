@@ -0,0 +1,331 @@
+//
+//  AZCoreRecordSectionDiff.m
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordSectionDiff.h"
+
+static NSIndexPath *azcr_indexPath(NSUInteger section, NSUInteger row)
+{
+	NSUInteger indexes[2] = { section, row };
+	return [NSIndexPath indexPathWithIndexes: indexes length: 2];
+}
+
+static void azcr_collectSections(NSArray *sectionKeys, NSUInteger count, NSMutableArray *sections, NSUInteger *sectionOfRow, NSUInteger *rowInSection)
+{
+	NSNull *null = [NSNull null];
+	id previousKey = nil;
+	NSUInteger row = 0;
+	
+	for (NSUInteger i = 0; i < count; i++)
+	{
+		id key = sectionKeys ? [sectionKeys objectAtIndex: i] : null;
+		if (!sections.count || ![key isEqual: previousKey])
+		{
+			[sections addObject: key];
+			previousKey = key;
+			row = 0;
+		}
+	
+		sectionOfRow[i] = sections.count - 1;
+		rowInSection[i] = row++;
+	}
+}
+
+static void azcr_markLongestIncreasingRun(const NSUInteger *sequence, NSUInteger count, BOOL *inRun)
+{
+	// Patience sorting: tails[k] ends the smallest-valued run of length k + 1
+	NSUInteger *tails = malloc(MAX(count, 1) * sizeof(NSUInteger));
+	NSUInteger *previous = malloc(MAX(count, 1) * sizeof(NSUInteger));
+	NSUInteger length = 0;
+	
+	for (NSUInteger i = 0; i < count; i++)
+	{
+		NSUInteger low = 0, high = length;
+		while (low < high)
+		{
+			NSUInteger middle = low + (high - low) / 2;
+			if (sequence[tails[middle]] < sequence[i])
+				low = middle + 1;
+			else
+				high = middle;
+		}
+	
+		previous[i] = low ? tails[low - 1] : NSNotFound;
+		tails[low] = i;
+		if (low == length)
+			length++;
+	}
+	
+	memset(inRun, 0, count * sizeof(BOOL));
+	for (NSUInteger i = length ? tails[length - 1] : NSNotFound; i != NSNotFound; i = previous[i])
+		inRun[i] = YES;
+	
+	free(tails);
+	free(previous);
+}
+
+@interface AZCoreRecordSectionDiff ()
+
+@property (nonatomic, readwrite) NSIndexSet *deletedSections;
+@property (nonatomic, readwrite) NSIndexSet *insertedSections;
+@property (nonatomic, readwrite) NSArray *deletedIndexPaths;
+@property (nonatomic, readwrite) NSArray *insertedIndexPaths;
+@property (nonatomic, readwrite) NSArray *updatedIndexPaths;
+@property (nonatomic, readwrite) NSArray *movedIndexPaths;
+
+@end
+
+@implementation AZCoreRecordSectionDiff
+
+@synthesize deletedSections = _deletedSections, insertedSections = _insertedSections;
+@synthesize deletedIndexPaths = _deletedIndexPaths, insertedIndexPaths = _insertedIndexPaths, updatedIndexPaths = _updatedIndexPaths, movedIndexPaths = _movedIndexPaths;
+
++ (void) diffFromObjectIDs: (NSArray *) oldObjectIDs sectionKeys: (NSArray *) oldSectionKeys toObjectIDs: (NSArray *) newObjectIDs sectionKeys: (NSArray *) newSectionKeys updatedObjectIDs: (NSSet *) updatedObjectIDs completion: (void (^)(AZCoreRecordSectionDiff *diff)) completion
+{
+	NSParameterAssert(completion);
+	
+	// One serial queue, so completions can't overtake each other
+	static dispatch_queue_t queue = NULL;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		queue = dispatch_queue_create("com.AZCoreRecord.sectionDiff", DISPATCH_QUEUE_SERIAL);
+	});
+	
+	oldObjectIDs = [oldObjectIDs copy];
+	oldSectionKeys = [oldSectionKeys copy];
+	newObjectIDs = [newObjectIDs copy];
+	newSectionKeys = [newSectionKeys copy];
+	updatedObjectIDs = [updatedObjectIDs copy];
+	
+	dispatch_async(queue, ^{
+		AZCoreRecordSectionDiff *diff = [self diffFromObjectIDs: oldObjectIDs sectionKeys: oldSectionKeys toObjectIDs: newObjectIDs sectionKeys: newSectionKeys updatedObjectIDs: updatedObjectIDs];
+		dispatch_async(dispatch_get_main_queue(), ^{
+			completion(diff);
+		});
+	});
+}
+
++ (AZCoreRecordSectionDiff *) diffFromObjectIDs: (NSArray *) oldObjectIDs sectionKeys: (NSArray *) oldSectionKeys toObjectIDs: (NSArray *) newObjectIDs sectionKeys: (NSArray *) newSectionKeys updatedObjectIDs: (NSSet *) updatedObjectIDs
+{
+	NSParameterAssert(!oldSectionKeys || oldSectionKeys.count == oldObjectIDs.count);
+	NSParameterAssert(!newSectionKeys || newSectionKeys.count == newObjectIDs.count);
+	
+	NSUInteger oldCount = oldObjectIDs.count, newCount = newObjectIDs.count;
+	
+	NSUInteger *oldSectionOfRow = malloc(MAX(oldCount, 1) * sizeof(NSUInteger));
+	NSUInteger *oldRowInSection = malloc(MAX(oldCount, 1) * sizeof(NSUInteger));
+	NSUInteger *newSectionOfRow = malloc(MAX(newCount, 1) * sizeof(NSUInteger));
+	NSUInteger *newRowInSection = malloc(MAX(newCount, 1) * sizeof(NSUInteger));
+	
+	NSMutableArray *oldSections = [NSMutableArray array];
+	NSMutableArray *newSections = [NSMutableArray array];
+	azcr_collectSections(oldSectionKeys, oldCount, oldSections, oldSectionOfRow, oldRowInSection);
+	azcr_collectSections(newSectionKeys, newCount, newSections, newSectionOfRow, newRowInSection);
+	
+	NSUInteger oldSectionCount = oldSections.count, newSectionCount = newSections.count;
+	
+	// Sections survive if they're in both snapshots and keep their order
+	// relative to the other survivors.
+	NSMutableDictionary *newSectionIndexes = [NSMutableDictionary dictionaryWithCapacity: newSectionCount];
+	[newSections enumerateObjectsUsingBlock: ^(id key, NSUInteger idx, BOOL *stop) {
+		if (![newSectionIndexes objectForKey: key])
+			[newSectionIndexes setObject: [NSNumber numberWithUnsignedInteger: idx] forKey: key];
+	}];
+	
+	NSUInteger *oldToNewSection = malloc(MAX(oldSectionCount, 1) * sizeof(NSUInteger));
+	NSUInteger *newToOldSection = malloc(MAX(newSectionCount, 1) * sizeof(NSUInteger));
+	NSUInteger *commonSections = malloc(MAX(oldSectionCount, 1) * sizeof(NSUInteger));
+	NSUInteger *commonTargets = malloc(MAX(oldSectionCount, 1) * sizeof(NSUInteger));
+	BOOL *sectionKept = malloc(MAX(oldSectionCount, 1) * sizeof(BOOL));
+	NSUInteger commonCount = 0;
+	
+	for (NSUInteger s = 0; s < newSectionCount; s++)
+		newToOldSection[s] = NSNotFound;
+	
+	for (NSUInteger s = 0; s < oldSectionCount; s++)
+	{
+		oldToNewSection[s] = NSNotFound;
+	
+		NSNumber *target = [newSectionIndexes objectForKey: [oldSections objectAtIndex: s]];
+		if (!target)
+			continue;
+	
+		commonSections[commonCount] = s;
+		commonTargets[commonCount] = target.unsignedIntegerValue;
+		commonCount++;
+	}
+	
+	azcr_markLongestIncreasingRun(commonTargets, commonCount, sectionKept);
+	for (NSUInteger c = 0; c < commonCount; c++)
+	{
+		if (!sectionKept[c])
+			continue;
+	
+		oldToNewSection[commonSections[c]] = commonTargets[c];
+		newToOldSection[commonTargets[c]] = commonSections[c];
+	}
+	
+	NSMutableIndexSet *deletedSections = [NSMutableIndexSet indexSet];
+	for (NSUInteger s = 0; s < oldSectionCount; s++)
+		if (oldToNewSection[s] == NSNotFound)
+			[deletedSections addIndex: s];
+	
+	NSMutableIndexSet *insertedSections = [NSMutableIndexSet indexSet];
+	for (NSUInteger s = 0; s < newSectionCount; s++)
+		if (newToOldSection[s] == NSNotFound)
+			[insertedSections addIndex: s];
+	
+	// Match rows by identifier. Repeated identifiers pair up in order, so
+	// each old row is matched at most once.
+	NSMutableDictionary *oldIndexes = [NSMutableDictionary dictionaryWithCapacity: oldCount];
+	[oldObjectIDs enumerateObjectsUsingBlock: ^(id objectID, NSUInteger idx, BOOL *stop) {
+		NSNumber *index = [NSNumber numberWithUnsignedInteger: idx];
+		id existing = [oldIndexes objectForKey: objectID];
+	
+		if (!existing)
+			[oldIndexes setObject: index forKey: objectID];
+		else if ([existing isKindOfClass: [NSMutableArray class]])
+			[existing addObject: index];
+		else
+			[oldIndexes setObject: [NSMutableArray arrayWithObjects: existing, index, nil] forKey: objectID];
+	}];
+	
+	NSUInteger *oldToNew = malloc(MAX(oldCount, 1) * sizeof(NSUInteger));
+	NSUInteger *newToOld = malloc(MAX(newCount, 1) * sizeof(NSUInteger));
+	
+	for (NSUInteger i = 0; i < oldCount; i++)
+		oldToNew[i] = NSNotFound;
+	
+	for (NSUInteger j = 0; j < newCount; j++)
+	{
+		id objectID = [newObjectIDs objectAtIndex: j];
+		id match = [oldIndexes objectForKey: objectID];
+		NSNumber *oldIndex = nil;
+	
+		if ([match isKindOfClass: [NSMutableArray class]])
+		{
+			if ([match count])
+			{
+				oldIndex = [match objectAtIndex: 0];
+				[match removeObjectAtIndex: 0];
+			}
+		}
+		else if (match)
+		{
+			oldIndex = match;
+			[oldIndexes removeObjectForKey: objectID];
+		}
+	
+		newToOld[j] = oldIndex ? oldIndex.unsignedIntegerValue : NSNotFound;
+		if (oldIndex)
+			oldToNew[newToOld[j]] = j;
+	}
+	
+	// Rows inside deleted or inserted sections go with their section
+	NSMutableArray *deletedIndexPaths = [NSMutableArray array];
+	for (NSUInteger i = 0; i < oldCount; i++)
+	{
+		if (oldToNewSection[oldSectionOfRow[i]] == NSNotFound)
+			continue;
+	
+		NSUInteger j = oldToNew[i];
+		if (j == NSNotFound || newToOldSection[newSectionOfRow[j]] == NSNotFound)
+			[deletedIndexPaths addObject: azcr_indexPath(oldSectionOfRow[i], oldRowInSection[i])];
+	}
+	
+	NSMutableArray *insertedIndexPaths = [NSMutableArray array];
+	NSMutableArray *updatedIndexPaths = [NSMutableArray array];
+	NSMutableArray *movedIndexPaths = [NSMutableArray array];
+	
+	NSUInteger *runRows = malloc(MAX(newCount, 1) * sizeof(NSUInteger));
+	NSUInteger *runOldRows = malloc(MAX(newCount, 1) * sizeof(NSUInteger));
+	BOOL *rowKept = malloc(MAX(newCount, 1) * sizeof(BOOL));
+	
+	// New rows come grouped by section, so each section is one run
+	NSUInteger start = 0;
+	while (start < newCount)
+	{
+		NSUInteger section = newSectionOfRow[start];
+		NSUInteger end = start;
+		while (end < newCount && newSectionOfRow[end] == section)
+			end++;
+	
+		if (newToOldSection[section] == NSNotFound)
+		{
+			start = end;
+			continue;
+		}
+	
+		NSUInteger runCount = 0;
+		for (NSUInteger j = start; j < end; j++)
+		{
+			NSUInteger i = newToOld[j];
+			if (i == NSNotFound || oldToNewSection[oldSectionOfRow[i]] == NSNotFound)
+			{
+				[insertedIndexPaths addObject: azcr_indexPath(section, newRowInSection[j])];
+			}
+			else if (oldToNewSection[oldSectionOfRow[i]] != section)
+			{
+				[movedIndexPaths addObject: [NSArray arrayWithObjects: azcr_indexPath(oldSectionOfRow[i], oldRowInSection[i]), azcr_indexPath(section, newRowInSection[j]), nil]];
+			}
+			else
+			{
+				runRows[runCount] = j;
+				runOldRows[runCount] = oldRowInSection[i];
+				runCount++;
+			}
+		}
+	
+		// Rows that stayed in this section only move if they fell out of
+		// the longest run still in order.
+		azcr_markLongestIncreasingRun(runOldRows, runCount, rowKept);
+		for (NSUInteger r = 0; r < runCount; r++)
+		{
+			NSUInteger j = runRows[r];
+			NSUInteger i = newToOld[j];
+			NSIndexPath *oldIndexPath = azcr_indexPath(oldSectionOfRow[i], oldRowInSection[i]);
+	
+			if (!rowKept[r])
+				[movedIndexPaths addObject: [NSArray arrayWithObjects: oldIndexPath, azcr_indexPath(section, newRowInSection[j]), nil]];
+			else if ([updatedObjectIDs containsObject: [newObjectIDs objectAtIndex: j]])
+				[updatedIndexPaths addObject: oldIndexPath];
+		}
+	
+		start = end;
+	}
+	
+	free(oldSectionOfRow);
+	free(oldRowInSection);
+	free(newSectionOfRow);
+	free(newRowInSection);
+	free(oldToNewSection);
+	free(newToOldSection);
+	free(commonSections);
+	free(commonTargets);
+	free(sectionKept);
+	free(oldToNew);
+	free(newToOld);
+	free(runRows);
+	free(runOldRows);
+	free(rowKept);
+	
+	AZCoreRecordSectionDiff *diff = [self new];
+	diff.deletedSections = deletedSections;
+	diff.insertedSections = insertedSections;
+	diff.deletedIndexPaths = deletedIndexPaths;
+	diff.insertedIndexPaths = insertedIndexPaths;
+	diff.updatedIndexPaths = updatedIndexPaths;
+	diff.movedIndexPaths = movedIndexPaths;
+	return diff;
+}
+
+- (BOOL) isEmpty
+{
+	return !self.deletedSections.count && !self.insertedSections.count && !self.deletedIndexPaths.count && !self.insertedIndexPaths.count && !self.updatedIndexPaths.count && !self.movedIndexPaths.count;
+}
+
+@end
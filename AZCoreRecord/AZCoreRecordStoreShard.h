@@ -0,0 +1,37 @@
+//
+//  AZCoreRecordStoreShard.h
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import <CoreData/CoreData.h>
+
+@class AZCoreRecordSQLiteOptions;
+
+/** One model configuration backed by its own persistent store.
+
+ Shards are added alongside the local and ubiquitous stores, so entities
+ with very different write patterns can live in separate files with
+ separate write locks and journals.
+ */
+@interface AZCoreRecordStoreShard : NSObject <NSCopying>
+
++ (AZCoreRecordStoreShard *) shardWithConfiguration: (NSString *) configurationName;
+
+@property (nonatomic, copy) NSString *configurationName;
+
+/** File name inside the stack's store directory. Defaults to the
+ configuration name with a `sqlite` extension. */
+@property (nonatomic, copy) NSString *fileName;
+
+/** Defaults to `NSSQLiteStoreType`. */
+@property (nonatomic, copy) NSString *storeType;
+
+/** Tuning for this store only; `nil` uses the manager's stackSQLiteOptions. */
+@property (nonatomic, copy) AZCoreRecordSQLiteOptions *sqliteOptions;
+
+- (BOOL) validate: (NSError **) error;
+
+@end
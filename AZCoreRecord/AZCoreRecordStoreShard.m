@@ -0,0 +1,71 @@
+//
+//  AZCoreRecordStoreShard.m
+//  AZCoreRecord
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordStoreShard.h"
+#import "AZCoreRecordSQLiteOptions.h"
+#import "AZCoreRecordManager.h"
+
+@implementation AZCoreRecordStoreShard
+
+@synthesize configurationName = _configurationName, fileName = _fileName, storeType = _storeType, sqliteOptions = _sqliteOptions;
+
++ (AZCoreRecordStoreShard *) shardWithConfiguration: (NSString *) configurationName
+{
+	AZCoreRecordStoreShard *shard = [self new];
+	shard.configurationName = configurationName;
+	return shard;
+}
+
+- (NSString *) fileName
+{
+	if (_fileName.length || !self.configurationName.length)
+		return _fileName;
+	
+	return [self.configurationName stringByAppendingPathExtension: @"sqlite"];
+}
+
+- (NSString *) storeType
+{
+	return _storeType.length ? _storeType : NSSQLiteStoreType;
+}
+
+#pragma mark - NSCopying
+
+- (id) copyWithZone: (NSZone *) zone
+{
+	AZCoreRecordStoreShard *copy = [[[self class] allocWithZone: zone] init];
+	copy.configurationName = _configurationName;
+	copy.fileName = _fileName;
+	copy.storeType = _storeType;
+	copy.sqliteOptions = _sqliteOptions;
+	return copy;
+}
+
+#pragma mark - Validation
+
+- (BOOL) validate: (NSError **) error
+{
+	NSString *reason = nil;
+	
+	if (!self.configurationName.length)
+		reason = @"A store shard needs a model configuration name.";
+	else if (![self.storeType isEqualToString: NSInMemoryStoreType] && !self.fileName.length)
+		reason = @"A store shard needs a file name.";
+	else if (self.sqliteOptions && ![self.sqliteOptions validate: error])
+		return NO;
+	
+	if (!reason)
+		return YES;
+	
+	if (error)
+		*error = [NSError errorWithDomain: AZCoreRecordErrorDomain code: AZCoreRecordInvalidConfigurationError userInfo: [NSDictionary dictionaryWithObject: reason forKey: NSLocalizedDescriptionKey]];
+	
+	return NO;
+}
+
+@end
@@ -9,6 +9,8 @@
 
 #import <Foundation/Foundation.h>
 
+@class AZCoreRecordDeviceRegistry;
+
 extern NSString *const AZUbiquityIdentityDidChangeNotification;
 
 @interface AZCoreRecordUbiquitySentinel : NSObject <NSFilePresenter>
@@ -18,4 +20,7 @@ extern NSString *const AZUbiquityIdentityDidChangeNotification;
 @property (nonatomic, readonly) NSString *ubiquityIdentityToken;
 @property (nonatomic, readonly, getter = isUbiquityAvailable) BOOL ubiquityAvailable;
 
+/** Devices syncing through the current container, or nil without one. */
+@property (nonatomic, strong, readonly) AZCoreRecordDeviceRegistry *deviceRegistry;
+
 @end
@@ -8,6 +8,9 @@
 //
 
 #import "AZCoreRecordUbiquitySentinel.h"
+#import "AZCoreRecordDeviceRegistry.h"
+#import "AZCoreRecordDownloadTracker.h"
+#import "AZCoreRecordManager.h"
 #import <CoreData/CoreData.h>
 
 #ifdef __IPHONE_OS_VERSION_MIN_REQUIRED
@@ -28,6 +31,8 @@ NSString *const AZUbiquityIdentityDidChangeNotification = NSUbiquityIdentityDidC
 @property (nonatomic) BOOL performingDeviceRegistrationCheck;
 @property (nonatomic, strong) NSMetadataQuery *devicesListMetadataQuery;
 @property (nonatomic, strong) NSFileManager *fileManager;
+@property (nonatomic, strong) AZCoreRecordDownloadTracker *downloadTracker;
+@property (nonatomic, strong, readwrite) AZCoreRecordDeviceRegistry *deviceRegistry;
 @property (nonatomic, copy) NSURL *ubiquityURL;
 
 - (void)startMonitoringDevicesList;
@@ -41,7 +46,7 @@ NSString *const AZUbiquityIdentityDidChangeNotification = NSUbiquityIdentityDidC
 
 @implementation AZCoreRecordUbiquitySentinel
 
-@synthesize ubiquityURL = _ubiquityURL, fileManager = _fileManager, devicesListMetadataQuery = _devicesListMetadataQuery;
+@synthesize ubiquityURL = _ubiquityURL, fileManager = _fileManager, devicesListMetadataQuery = _devicesListMetadataQuery, downloadTracker = _downloadTracker, deviceRegistry = _deviceRegistry;
 @synthesize haveSentResetNotification = _haveSentResetNotification, performingDeviceRegistrationCheck = _performingDeviceRegistrationCheck;
 
 + (void)load {
@@ -72,6 +77,7 @@ NSString *const AZUbiquityIdentityDidChangeNotification = NSUbiquityIdentityDidC
 - (id)init {
 	if ((self = [super init])) {
 		self.fileManager = [NSFileManager new];
+		self.downloadTracker = [AZCoreRecordDownloadTracker new];
 	}
 	return self;
 }
@@ -86,45 +92,7 @@ NSString *const AZUbiquityIdentityDidChangeNotification = NSUbiquityIdentityDidC
 - (void)syncURLWithCloud:(NSURL *)URL completion:(void (^)(BOOL success, NSError *error))block
 {
 	NSParameterAssert(block);
-	
-    NSError *error;
-    NSNumber *downloaded;
-    BOOL success = [URL getResourceValue:&downloaded forKey:NSURLUbiquitousItemIsDownloadedKey error:&error];
-    if ( !success ) {
-        // Resource doesn't exist
-        block(YES, nil);
-        return;
-    }
-    
-    if ( !downloaded.boolValue ) {
-        NSNumber *downloading;
-        BOOL success = [URL getResourceValue:&downloading forKey:NSURLUbiquitousItemIsDownloadingKey error:&error];
-        if ( !success ) {
-            block(NO, error);
-            return;
-        }
-        
-        if ( !downloading.boolValue ) {
-            BOOL success = [[NSFileManager defaultManager] startDownloadingUbiquitousItemAtURL: URL error:&error];
-            if ( !success ) {
-                block(NO, error);
-                return;
-            }
-        }
-        
-        // Download not complete. Schedule another check.
-        double delayInSeconds = 0.1;
-        dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, delayInSeconds * NSEC_PER_SEC);
-        dispatch_queue_t queue = dispatch_get_current_queue();
-        dispatch_retain(queue);
-        dispatch_after(popTime, queue, ^{
-            [self syncURLWithCloud: URL completion: [block copy]];
-            dispatch_release(queue);
-        });
-    }
-    else {
-        block(YES, nil);
-    }
+	[self.downloadTracker waitForItemAtURL: URL completion: block];
 }
 
 #pragma mark - Internal
@@ -140,7 +108,9 @@ NSString *const AZUbiquityIdentityDidChangeNotification = NSUbiquityIdentityDidC
 - (void)startMonitoringDevicesList {
 	self.devicesListMetadataQuery = [NSMetadataQuery new];
 	self.devicesListMetadataQuery.searchScopes = [NSArray arrayWithObject:NSMetadataQueryUbiquitousDataScope];
-	self.devicesListMetadataQuery.predicate = [NSPredicate predicateWithFormat:@"%K like %@", NSMetadataItemFSNameKey, self.presentedItemURL.lastPathComponent];
+	// Only this device's own record decides whether the container was reset
+	NSURL *recordURL = [self.deviceRegistry recordURLForDevice: self.ubiquityIdentityToken];
+	self.devicesListMetadataQuery.predicate = [NSPredicate predicateWithFormat:@"%K like %@", NSMetadataItemFSNameKey, recordURL.lastPathComponent];
 	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(devicesListDidUpdate:) name:NSMetadataQueryDidUpdateNotification object: self.devicesListMetadataQuery];
 	[NSFileCoordinator addFilePresenter:self];
 }
@@ -165,34 +135,38 @@ NSString *const AZUbiquityIdentityDidChangeNotification = NSUbiquityIdentityDidC
 
 -(void)devicesListDidUpdate:(NSNotification *)notif
 {
-    if ( self.haveSentResetNotification || self.performingDeviceRegistrationCheck ) return;
+    if ( self.haveSentResetNotification || self.performingDeviceRegistrationCheck || !self.deviceRegistry ) return;
     [self.devicesListMetadataQuery disableUpdates];
     self.performingDeviceRegistrationCheck = YES;
 	
 	dispatch_queue_t completionQueue = dispatch_get_current_queue();
 	dispatch_retain(completionQueue);
 	
-	NSURL *url = self.presentedItemURL;
-	[self syncURLWithCloud: self.presentedItemURL completion: ^(BOOL success, NSError *error) {
-		NSFileCoordinator *coordinator = [[NSFileCoordinator alloc] initWithFilePresenter:self];
-		[coordinator coordinateReadingItemAtURL:url options:0 error:NULL byAccessor:^(NSURL *readURL) {
-			NSArray *devices = [NSArray arrayWithContentsOfURL:readURL];
-			NSString *deviceId = [self ubiquityIdentityToken];
-			BOOL deviceIsRegistered = [devices containsObject:deviceId];
-			dispatch_async(completionQueue, ^{
-				self.performingDeviceRegistrationCheck = NO;
-				if ( !deviceIsRegistered ) {
-					self.haveSentResetNotification = YES;
-					[self stopMonitoringDevicesList];
-					[[NSNotificationCenter defaultCenter] postNotificationName: AZUbiquityIdentityDidChangeNotification object:self userInfo:nil];
-				}
-				else {
-					[self.devicesListMetadataQuery enableUpdates];
-				}
-				
-				dispatch_release(completionQueue);
-			});
-		}];
+	AZCoreRecordDeviceRegistry *registry = self.deviceRegistry;
+	NSString *deviceId = [self ubiquityIdentityToken];
+	[self syncURLWithCloud: [registry recordURLForDevice: deviceId] completion: ^(BOOL success, NSError *error) {
+		// A device only listed by an older version has no record until the
+		// list is imported, which mustn't look like a reset either
+		[registry importLegacyDevices];
+		
+		// A failed or timed-out download says nothing about the record, so
+		// it mustn't be read as the container having been reset
+		BOOL deviceIsRegistered = !success || [registry containsDevice: deviceId];
+		if (!success)
+			[AZCoreRecordManager handleError: error];
+		dispatch_async(completionQueue, ^{
+			self.performingDeviceRegistrationCheck = NO;
+			if ( !deviceIsRegistered ) {
+				self.haveSentResetNotification = YES;
+				[self stopMonitoringDevicesList];
+				[[NSNotificationCenter defaultCenter] postNotificationName: AZUbiquityIdentityDidChangeNotification object:self userInfo:nil];
+			}
+			else {
+				[self.devicesListMetadataQuery enableUpdates];
+			}
+			
+			dispatch_release(completionQueue);
+		});
 	}];
 }
 
@@ -202,31 +176,18 @@ NSString *const AZUbiquityIdentityDidChangeNotification = NSUbiquityIdentityDidC
 		return;
 	
     dispatch_async(dispatch_get_global_queue(0, 0), ^{
-		[self syncURLWithCloud: self.presentedItemURL completion: ^(BOOL success, NSError *error) {
+		AZCoreRecordDeviceRegistry *registry = self.deviceRegistry;
+		NSString *deviceId = [self ubiquityIdentityToken];
+		if (!registry || !deviceId) return;
+		
+		// Carry over devices listed by older versions before adding this one
+		[registry importLegacyDevices];
+		
+		// Writes only when this device's record is missing
+		[self syncURLWithCloud: [registry recordURLForDevice: deviceId] completion: ^(BOOL success, NSError *error) {
             if ( !success ) return;
             
-            __block BOOL updated = NO;
-            __block NSMutableArray *devices = nil;
-            NSFileCoordinator *coordinator = [[NSFileCoordinator alloc] initWithFilePresenter:self];
-            [coordinator coordinateReadingItemAtURL: self.presentedItemURL options:0 error:NULL byAccessor:^(NSURL *readURL) {
-                devices = [NSMutableArray arrayWithContentsOfURL:readURL];
-                if ( !devices ) devices = [NSMutableArray array];
-                NSString *deviceId = [self ubiquityIdentityToken];
-                
-                if ( ![devices containsObject:deviceId] ) {
-                    [devices addObject:deviceId];
-                    updated = YES;
-                }
-            }];
-            
-            [coordinator coordinateWritingItemAtURL: self.ubiquityURL options:0 error:NULL byAccessor:^(NSURL *newURL) {
-                NSFileManager *fm = [[NSFileManager alloc] init];
-                [fm createDirectoryAtURL:newURL withIntermediateDirectories:YES attributes:nil error:NULL];
-            }];
-            
-            if ( updated ) [coordinator coordinateWritingItemAtURL: self.presentedItemURL options:NSFileCoordinatorWritingForReplacing error:NULL byAccessor:^(NSURL *writeURL) {
-                [devices writeToURL:writeURL atomically:YES];
-            }];
+            [registry registerDevice: deviceId error: NULL];
 		}];
     });
 }
@@ -237,6 +198,7 @@ NSString *const AZUbiquityIdentityDidChangeNotification = NSUbiquityIdentityDidC
 	if (self.devicesListMetadataQuery)
 		[self stopMonitoringDevicesList];
 	_ubiquityURL = [ubiquityURL copy];
+	self.deviceRegistry = _ubiquityURL ? [[AZCoreRecordDeviceRegistry alloc] initWithDirectoryURL: [_ubiquityURL URLByAppendingPathComponent: @"UbiquitousSyncingDevices"] filePresenter: self] : nil;
 	if (self.ubiquityURL)
 		[self startMonitoringDevicesList];
 }
@@ -263,10 +225,7 @@ NSString *const AZUbiquityIdentityDidChangeNotification = NSUbiquityIdentityDidC
 #pragma mark - NSFilePresenter
 
 - (NSURL *)presentedItemURL {
-	if (!self.ubiquityURL)
-		return nil;
-	
-	return [self.ubiquityURL URLByAppendingPathComponent: @"UbiquitousSyncingDevices.plist"];
+	return self.deviceRegistry.directoryURL;
 }
 
 - (NSOperationQueue *)presentedItemOperationQueue {
@@ -285,6 +244,17 @@ NSString *const AZUbiquityIdentityDidChangeNotification = NSUbiquityIdentityDidC
 	});
 }
 
+- (void)presentedSubitemDidChangeAtURL:(NSURL *)url
+{
+	// Other devices' records coming and going don't concern this one
+	if (![url isEqual: [self.deviceRegistry recordURLForDevice: self.ubiquityIdentityToken]])
+		return;
+	
+	dispatch_async(dispatch_get_main_queue(), ^{
+		[self updateDevicesList];
+	});
+}
+
 - (void)accommodatePresentedItemDeletionWithCompletionHandler:(void (^)(NSError *))completionHandler {
 	dispatch_async(dispatch_get_main_queue(), ^{
 		[self updateDevicesList];
@@ -15,6 +15,10 @@
 
 - (BOOL) performFetch;
 
+/** A snapshot of the current results for AZCoreRecordSectionDiff: every
+ object ID, and the name of the section each one is in. */
+- (void) getObjectIDs: (NSArray **) objectIDs sectionKeys: (NSArray **) sectionKeys;
+
 + (NSFetchedResultsController *) fetchedResultsControllerForRequest: (NSFetchRequest *) request;
 + (NSFetchedResultsController *) fetchedResultsControllerForRequest: (NSFetchRequest *) request inContext: (NSManagedObjectContext *) context;
 
@@ -24,6 +28,24 @@
 + (NSFetchedResultsController *) fetchedResultsControllerForEntity: (Class) entityClass sortedBy: (NSString *) sortTerm ascending: (BOOL) ascending predicate: (NSPredicate *) searchTerm groupedBy: (NSString *) keyPath;
 + (NSFetchedResultsController *) fetchedResultsControllerForEntity: (Class) entityClass sortedBy: (NSString *) sortTerm ascending: (BOOL) ascending predicate: (NSPredicate *) searchTerm groupedBy: (NSString *) keyPath inContext: (NSManagedObjectContext *) context;
 
+/** The section cache name the factories above use: the entity name plus a
+ fingerprint of the predicate, its values included, the sort descriptors,
+ and the section key path, so controllers that differ in any of them keep
+ separate caches. Managed objects in the predicate count by object ID;
+ block predicates can't be told apart and share a name. */
++ (NSString *) cacheNameForRequest: (NSFetchRequest *) request groupedBy: (NSString *) group;
+
+/** Fetches on a private context so the section cache is already on disk
+ when a controller for the same request is created. The completion runs on
+ the main queue. */
++ (void) prewarmCacheForRequest: (NSFetchRequest *) request groupedBy: (NSString *) group completion: (void (^)(void)) completion;
++ (void) prewarmCacheForRequest: (NSFetchRequest *) request groupedBy: (NSString *) group inContext: (NSManagedObjectContext *) context completion: (void (^)(void)) completion;
+
++ (void) purgeCacheForRequest: (NSFetchRequest *) request groupedBy: (NSString *) group;
+
+/** Deletes every fetched results controller cache, not just these. */
++ (void) purgeAllCaches;
+
 @end
 
 #endif
\ No newline at end of file
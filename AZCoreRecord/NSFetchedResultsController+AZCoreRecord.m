@@ -14,6 +14,120 @@
 
 #ifdef __IPHONE_OS_VERSION_MIN_REQUIRED
 
+#import <CommonCrypto/CommonDigest.h>
+
+static NSString *azcr_predicateDescription(NSPredicate *predicate);
+static NSString *azcr_expressionDescription(NSExpression *expression);
+
+static NSString *azcr_constantDescription(id value)
+{
+	// Objects go by their URI rather than the address predicateFormat
+	// shows, so the same object gives the same name on every launch.
+	if ([value isKindOfClass: [NSManagedObject class]])
+		value = [value objectID];
+	
+	if (!value || value == [NSNull null])
+		return @"nil";
+	if ([value isKindOfClass: [NSManagedObjectID class]])
+		return [[value URIRepresentation] absoluteString];
+	if ([value isKindOfClass: [NSExpression class]])
+		return azcr_expressionDescription(value);
+	if ([value isKindOfClass: [NSString class]])
+		return [NSString stringWithFormat: @"\"%@\"", value];
+	
+	if ([value isKindOfClass: [NSArray class]] || [value isKindOfClass: [NSSet class]] || [value isKindOfClass: [NSOrderedSet class]])
+	{
+		NSMutableArray *elements = [NSMutableArray array];
+		for (id element in value)
+			[elements addObject: azcr_constantDescription(element)];
+		
+		// A set's order means nothing
+		if ([value isKindOfClass: [NSSet class]])
+			[elements sortUsingSelector: @selector(compare:)];
+		
+		return [NSString stringWithFormat: @"{%@}", [elements componentsJoinedByString: @","]];
+	}
+	
+	return [value description];
+}
+
+static NSString *azcr_expressionDescription(NSExpression *expression)
+{
+	switch (expression.expressionType)
+	{
+		case NSConstantValueExpressionType:
+		case NSAggregateExpressionType:
+			return azcr_constantDescription(expression.constantValue);
+		case NSEvaluatedObjectExpressionType:
+			return @"SELF";
+		case NSVariableExpressionType:
+			return [@"$" stringByAppendingString: expression.variable];
+		case NSKeyPathExpressionType:
+			return expression.keyPath;
+		case NSFunctionExpressionType:
+		{
+			NSMutableArray *arguments = [NSMutableArray arrayWithCapacity: expression.arguments.count];
+			for (NSExpression *argument in expression.arguments)
+				[arguments addObject: azcr_expressionDescription(argument)];
+			return [NSString stringWithFormat: @"%@.%@(%@)", azcr_expressionDescription(expression.operand), expression.function, [arguments componentsJoinedByString: @","]];
+		}
+		case NSSubqueryExpressionType:
+			return [NSString stringWithFormat: @"SUBQUERY(%@,$%@,%@)", azcr_expressionDescription(expression.collection), expression.variable, azcr_predicateDescription(expression.predicate)];
+		case NSUnionSetExpressionType:
+		case NSIntersectSetExpressionType:
+		case NSMinusSetExpressionType:
+			return [NSString stringWithFormat: @"%d(%@,%@)", (int) expression.expressionType, azcr_expressionDescription(expression.leftExpression), azcr_expressionDescription(expression.rightExpression)];
+		default:
+			// Block expressions only describe themselves by address
+			return [NSString stringWithFormat: @"%d", (int) expression.expressionType];
+	}
+}
+
+static NSString *azcr_predicateDescription(NSPredicate *predicate)
+{
+	if (!predicate)
+		return @"";
+	
+	if ([predicate isKindOfClass: [NSCompoundPredicate class]])
+	{
+		NSCompoundPredicate *compound = (NSCompoundPredicate *) predicate;
+		NSMutableArray *subpredicates = [NSMutableArray arrayWithCapacity: compound.subpredicates.count];
+		for (NSPredicate *subpredicate in compound.subpredicates)
+			[subpredicates addObject: azcr_predicateDescription(subpredicate)];
+		return [NSString stringWithFormat: @"%d(%@)", (int) compound.compoundPredicateType, [subpredicates componentsJoinedByString: @","]];
+	}
+	
+	if ([predicate isKindOfClass: [NSComparisonPredicate class]])
+	{
+		NSComparisonPredicate *comparison = (NSComparisonPredicate *) predicate;
+		NSString *operatorName = comparison.predicateOperatorType == NSCustomSelectorPredicateOperatorType ? NSStringFromSelector(comparison.customSelector) : [NSString stringWithFormat: @"%d", (int) comparison.predicateOperatorType];
+		return [NSString stringWithFormat: @"%@ %@,%d,%d %@", azcr_expressionDescription(comparison.leftExpression), operatorName, (int) comparison.comparisonPredicateModifier, (int) comparison.options, azcr_expressionDescription(comparison.rightExpression)];
+	}
+	
+	// TRUEPREDICATE and FALSEPREDICATE; block predicates embed their address
+	NSString *format = predicate.predicateFormat;
+	return [format hasPrefix: @"BLOCKPREDICATE"] ? @"BLOCKPREDICATE" : format;
+}
+
+static NSString *azcr_requestFingerprint(NSFetchRequest *request, NSString *group)
+{
+	// Everything that shapes the sections, in a form that's stable across
+	// launches, the predicate's values included.
+	NSMutableString *description = [NSMutableString stringWithFormat: @"%@|%d|%@|%@", request.entityName, request.includesSubentities, azcr_predicateDescription(request.predicate), group ?: @""];
+	for (NSSortDescriptor *descriptor in request.sortDescriptors)
+		[description appendFormat: @"|%@,%d,%@", descriptor.key, descriptor.ascending, NSStringFromSelector(descriptor.selector)];
+	
+	NSData *data = [description dataUsingEncoding: NSUTF8StringEncoding];
+	unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+	CC_SHA1(data.bytes, (CC_LONG) data.length, digest);
+	
+	NSMutableString *fingerprint = [NSMutableString stringWithCapacity: 16];
+	for (NSUInteger i = 0; i < 8; i++)
+		[fingerprint appendFormat: @"%02x", digest[i]];
+	
+	return fingerprint;
+}
+
 @implementation NSFetchedResultsController (AZCoreRecord)
 
 - (BOOL) performFetch
@@ -24,6 +138,27 @@
 	return saved;
 }
 
+- (void) getObjectIDs: (NSArray **) outObjectIDs sectionKeys: (NSArray **) outSectionKeys
+{
+	NSMutableArray *objectIDs = [NSMutableArray array];
+	NSMutableArray *sectionKeys = [NSMutableArray array];
+	
+	for (id <NSFetchedResultsSectionInfo> section in self.sections)
+	{
+		id key = section.name ?: [NSNull null];
+		for (NSManagedObject *object in section.objects)
+		{
+			[objectIDs addObject: object.objectID];
+			[sectionKeys addObject: key];
+		}
+	}
+	
+	if (outObjectIDs)
+		*outObjectIDs = objectIDs;
+	if (outSectionKeys)
+		*outSectionKeys = sectionKeys;
+}
+
 + (NSFetchedResultsController *) fetchedResultsControllerForRequest: (NSFetchRequest *) request
 {
 	return [self fetchedResultsControllerForRequest: request inContext: nil];
@@ -44,7 +179,7 @@
     
 	NSString *cacheName = nil;
 #if !TARGET_IPHONE_SIMULATOR
-	cacheName = [NSString stringWithFormat: @"AZCoreRecordCache-%@", [request entityName]];
+	cacheName = [self cacheNameForRequest: request groupedBy: group];
 #endif
 	
 	NSFetchedResultsController *controller = [[NSFetchedResultsController alloc] initWithFetchRequest: request managedObjectContext: context sectionNameKeyPath: group cacheName: cacheName];
@@ -63,6 +198,65 @@
 	return [self fetchedResultsControllerForRequest: request groupedBy: keyPath inContext: context];
 }
 
+#pragma mark - Section Caches
+
++ (NSString *) cacheNameForRequest: (NSFetchRequest *) request groupedBy: (NSString *) group
+{
+	NSParameterAssert(request);
+	return [NSString stringWithFormat: @"AZCoreRecordCache-%@-%@", [request entityName], azcr_requestFingerprint(request, group)];
+}
+
++ (void) prewarmCacheForRequest: (NSFetchRequest *) request groupedBy: (NSString *) group completion: (void (^)(void)) completion
+{
+	[self prewarmCacheForRequest: request groupedBy: group inContext: nil completion: completion];
+}
++ (void) prewarmCacheForRequest: (NSFetchRequest *) request groupedBy: (NSString *) group inContext: (NSManagedObjectContext *) context completion: (void (^)(void)) completion
+{
+	NSString *cacheName = nil;
+#if !TARGET_IPHONE_SIMULATOR
+	cacheName = [self cacheNameForRequest: request groupedBy: group];
+#endif
+	
+	if (!cacheName)
+	{
+		if (completion)
+			dispatch_async(dispatch_get_main_queue(), completion);
+		return;
+	}
+	
+	if (!context)
+		context = [NSManagedObjectContext contextForCurrentThread];
+	
+	NSManagedObjectContext *workingContext = [[NSManagedObjectContext alloc] initWithConcurrencyType: NSPrivateQueueConcurrencyType];
+	workingContext.persistentStoreCoordinator = context.persistentStoreCoordinator;
+	workingContext.undoManager = nil;
+	
+	NSFetchRequest *fetchRequest = [request copy];
+	
+	[workingContext performBlock: ^{
+		NSFetchedResultsController *controller = [[self alloc] initWithFetchRequest: fetchRequest managedObjectContext: workingContext sectionNameKeyPath: group cacheName: cacheName];
+		[controller performFetch];
+		
+		if (completion)
+			dispatch_async(dispatch_get_main_queue(), completion);
+	}];
+}
+
++ (void) purgeCacheForRequest: (NSFetchRequest *) request groupedBy: (NSString *) group
+{
+	NSString *cacheName = [self cacheNameForRequest: request groupedBy: group];
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+		[NSFetchedResultsController deleteCacheWithName: cacheName];
+	});
+}
+
++ (void) purgeAllCaches
+{
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+		[NSFetchedResultsController deleteCacheWithName: nil];
+	});
+}
+
 @end
 
 #endif
\ No newline at end of file
@@ -14,6 +14,16 @@
 
 static NSUInteger defaultBatchSize = 20;
 
+// Thread contexts are private-queue; this keeps fetches on them serialized
+// with the manager reclaiming their memory.
+static void azcr_performAndWait(NSManagedObjectContext *context, void (^block)(void))
+{
+	if (context.concurrencyType == NSConfinementConcurrencyType)
+		block();
+	else
+		[context performBlockAndWait: block];
+}
+
 @interface NSManagedObject (AZCoreRecord_MOGenerator)
 
 + (NSEntityDescription *) entityInManagedObjectContext: (NSManagedObjectContext *) context;
@@ -195,12 +205,28 @@ static NSUInteger defaultBatchSize = 20;
 }
 + (NSUInteger) countOfEntitiesWithPredicate: (NSPredicate *) searchFilter inContext: (NSManagedObjectContext *) context
 {
-	if (!context)
+	// Routed counts stand in for the calling thread's context, which is the
+	// one whose unsaved changes a replica would miss.
+	BOOL routable = !context && ![NSThread isMainThread];
+	if (routable)
+		context = [NSManagedObjectContext contextForCurrentThread];
+	else if (!context)
 		context = [NSManagedObjectContext defaultContext];
 	
-	NSError *error = nil;
+	__block NSError *error = nil;
 	NSFetchRequest *request = [self requestAllWithPredicate: searchFilter inContext: context];
-	NSUInteger count = [context countForFetchRequest: request error: &error];
+	
+	if (routable && !context.hasChanges)
+	{
+		NSUInteger count = [[AZCoreRecordManager sharedManager] countForFetchRequestOnReadReplica: request];
+		if (count != NSNotFound)
+			return count;
+	}
+	
+	__block NSUInteger count = 0;
+	azcr_performAndWait(context, ^{
+		count = [context countForFetchRequest: request error: &error];
+	});
 	[AZCoreRecordManager handleError: error];
 	return count;
 }
@@ -461,9 +487,30 @@ static NSUInteger defaultBatchSize = 20;
 }
 + (NSArray *) findAllSortedBy: (NSString *) sortTerm ascending: (BOOL) ascending predicate: (NSPredicate *) searchTerm inContext: (NSManagedObjectContext *) context
 {
+	BOOL routable = !context;
+	if (!context)
+		context = [NSManagedObjectContext contextForCurrentThread];
+	
 	NSFetchRequest *request = [self requestAllSortedBy: sortTerm ascending: ascending predicate: searchTerm inContext: context];
-	NSError *error = nil;
-	NSArray *results = [context executeFetchRequest: request error: &error];
+	
+	// A replica can't see unsaved changes
+	if (routable && !context.hasChanges)
+	{
+		NSArray *objectIDs = [[AZCoreRecordManager sharedManager] objectIDsForFetchRequestOnReadReplica: request];
+		if (objectIDs)
+		{
+			NSMutableArray *objects = [NSMutableArray arrayWithCapacity: objectIDs.count];
+			for (NSManagedObjectID *objectID in objectIDs)
+				[objects addObject: [context objectWithID: objectID]];
+			return objects;
+		}
+	}
+	
+	__block NSError *error = nil;
+	__block NSArray *results = nil;
+	azcr_performAndWait(context, ^{
+		results = [context executeFetchRequest: request error: &error];
+	});
 	[AZCoreRecordManager handleError: error];
 	return results;
 }
@@ -11,6 +11,10 @@
 
 extern NSString *const AZCoreRecordDidMergeUbiquitousChangesNotification;
 
+extern NSString *const AZCoreRecordContextPoolHitCountKey;
+extern NSString *const AZCoreRecordContextPoolMissCountKey;
+extern NSString *const AZCoreRecordContextPoolAvailableCountKey;
+
 @interface NSManagedObjectContext (AZCoreRecord)
 
 #pragma mark - Instance Methods
@@ -30,11 +34,35 @@ extern NSString *const AZCoreRecordDidMergeUbiquitousChangesNotification;
 
 - (NSManagedObjectContext *) newChildContext;
 
+#pragma mark - Reusable Child Contexts
+
+- (NSManagedObjectContext *) dequeueReusableChildContext;
+- (void) enqueueReusableChildContext: (NSManagedObjectContext *) context;
+- (void) drainReusableChildContexts;
+
+- (NSDictionary *) reusableChildContextStatistics;
+
 #pragma mark - Ubiquity Support
 
 - (void) startObservingUbiquitousChanges;
 - (void) stopObservingUbiquitousChanges;
 
+#pragma mark - Merging
+
+- (void) mergeChangesFromNotification: (NSNotification *) notification;
+
+/** `completion` runs on the context's queue once every change queued so far,
+ this notification's included, has been merged; completions run in the
+ order their notifications were passed in.
+ 
+ A confinement context merges synchronously, so call this on its owning
+ thread. Only queue-based contexts can observe saves or ubiquitous imports,
+ which are posted on other threads. */
+- (void) mergeChangesFromNotification: (NSNotification *) notification completion: (void (^)(void)) completion;
+
+- (void) startObservingContextSaves;
+- (void) stopObservingContextSaves;
+
 #pragma mark - Reset Context
 
 + (void) resetDefaultContext;
@@ -47,4 +75,9 @@ extern NSString *const AZCoreRecordDidMergeUbiquitousChangesNotification;
 - (void) saveDataInBackgroundWithBlock: (void (^)(NSManagedObjectContext *context)) block;
 - (void) saveDataInBackgroundWithBlock: (void (^)(NSManagedObjectContext *context)) block completion: (void (^)(void)) callback;
 
+#pragma mark - Durable saving
+
+- (void) saveToPersistentStoreWithCompletion: (void (^)(BOOL success)) callback;
+- (void) saveDataToPersistentStoreWithBlock: (void (^)(NSManagedObjectContext *context)) block completion: (void (^)(BOOL success)) callback;
+
 @end
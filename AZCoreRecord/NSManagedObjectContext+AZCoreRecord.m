@@ -12,6 +12,177 @@
 #import <objc/runtime.h>
 #import "NSPersistentStoreCoordinator+AZCoreRecord.h"
 
+NSString *const AZCoreRecordDidMergeUbiquitousChangesNotification = @"AZCoreRecordDidMergeUbiquitousChangesNotification";
+
+NSString *const AZCoreRecordContextPoolHitCountKey = @"AZCoreRecordContextPoolHitCountKey";
+NSString *const AZCoreRecordContextPoolMissCountKey = @"AZCoreRecordContextPoolMissCountKey";
+NSString *const AZCoreRecordContextPoolAvailableCountKey = @"AZCoreRecordContextPoolAvailableCountKey";
+
+static const NSUInteger azcr_contextPoolCapacity = 4;
+static const NSTimeInterval azcr_contextPoolIdleInterval = 10.0;
+static void *azcr_contextPoolKey = &azcr_contextPoolKey;
+static void *azcr_pendingSaveCallbacksKey = &azcr_pendingSaveCallbacksKey;
+static void *azcr_pendingMergesKey = &azcr_pendingMergesKey;
+static void *azcr_mergingKey = &azcr_mergingKey;
+static NSString *const azcr_mergeCompletionKey = @"azcr_mergeCompletion";
+
+static const NSUInteger azcr_mergeSliceSize = 256;
+static const NSTimeInterval azcr_mergeSliceBudget = 0.004;
+
+static dispatch_semaphore_t azcr_associatedObjectSemaphore(void)
+{
+	static dispatch_once_t onceToken;
+	static dispatch_semaphore_t semaphore = NULL;
+	dispatch_once(&onceToken, ^{
+		semaphore = dispatch_semaphore_create(1);
+	});
+	return semaphore;
+}
+
+@interface AZCoreRecordContextPool : NSObject {
+@private
+	dispatch_semaphore_t _semaphore;
+	NSMutableArray *_contexts;
+	NSUInteger _hits;
+	NSUInteger _misses;
+	CFAbsoluteTime _lastUse;
+	BOOL _expiryScheduled;
+}
+
+- (NSManagedObjectContext *) dequeueContextForParent: (NSManagedObjectContext *) parent;
+- (void) enqueueContext: (NSManagedObjectContext *) context;
+- (void) drain;
+- (NSDictionary *) statistics;
+
+@end
+
+@implementation AZCoreRecordContextPool
+
+- (id) init
+{
+	if ((self = [super init]))
+	{
+		_semaphore = dispatch_semaphore_create(1);
+		_contexts = [NSMutableArray arrayWithCapacity: azcr_contextPoolCapacity];
+	}
+	
+	return self;
+}
+
+- (void) dealloc
+{
+	dispatch_release(_semaphore);
+}
+
+- (NSManagedObjectContext *) dequeueContextForParent: (NSManagedObjectContext *) parent
+{
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	
+	_lastUse = CFAbsoluteTimeGetCurrent();
+	
+	NSManagedObjectContext *context = [_contexts lastObject];
+	if (context)
+	{
+		[_contexts removeLastObject];
+		_hits++;
+	}
+	else
+	{
+		_misses++;
+	}
+	
+	dispatch_semaphore_signal(_semaphore);
+	
+	if (!context)
+		context = [parent newChildContext];
+	
+	return context;
+}
+
+- (void) enqueueContext: (NSManagedObjectContext *) context
+{
+	// Reset outside the lock; a dirty context is never handed out again.
+	[context reset];
+	context.mergePolicy = NSMergeByPropertyObjectTrumpMergePolicy;
+	
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	
+	_lastUse = CFAbsoluteTimeGetCurrent();
+	
+	if (_contexts.count < azcr_contextPoolCapacity)
+		[_contexts addObject: context];
+	
+	if (!_expiryScheduled)
+		[self azcr_scheduleExpiry];
+	
+	dispatch_semaphore_signal(_semaphore);
+}
+
+// Pooled children retain their parent, which retains the pool, so a parent
+// that is thrown away without draining would live forever. Letting idle
+// children go breaks that cycle no matter who owns the parent.
+- (void) azcr_scheduleExpiry
+{
+	_expiryScheduled = YES;
+	
+	__weak AZCoreRecordContextPool *weakSelf = self;
+	dispatch_time_t when = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(azcr_contextPoolIdleInterval * NSEC_PER_SEC));
+	dispatch_after(when, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+		[weakSelf azcr_expireIdleContexts];
+	});
+}
+
+- (void) azcr_expireIdleContexts
+{
+	// Released on return, outside the lock: the last child may take the
+	// parent, and the parent this pool, with it.
+	NSArray *expired = nil;
+	
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	
+	if (_contexts.count && CFAbsoluteTimeGetCurrent() - _lastUse < azcr_contextPoolIdleInterval)
+	{
+		[self azcr_scheduleExpiry];
+	}
+	else
+	{
+		expired = [_contexts copy];
+		[_contexts removeAllObjects];
+		_expiryScheduled = NO;
+	}
+	
+	dispatch_semaphore_signal(_semaphore);
+}
+
+- (void) drain
+{
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	[_contexts removeAllObjects];
+	dispatch_semaphore_signal(_semaphore);
+}
+
+- (NSDictionary *) statistics
+{
+	dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+	
+	NSDictionary *statistics = [NSDictionary dictionaryWithObjectsAndKeys:
+								[NSNumber numberWithUnsignedInteger: _hits], AZCoreRecordContextPoolHitCountKey,
+								[NSNumber numberWithUnsignedInteger: _misses], AZCoreRecordContextPoolMissCountKey,
+								[NSNumber numberWithUnsignedInteger: _contexts.count], AZCoreRecordContextPoolAvailableCountKey, nil];
+	
+	dispatch_semaphore_signal(_semaphore);
+	
+	return statistics;
+}
+
+@end
+
+@interface NSManagedObjectContext (AZCoreRecordPrivate)
+
+- (void) azcr_saveToPersistentStoreWithCallback: (void (^)(BOOL success)) callback;
+
+@end
+
 @implementation NSManagedObjectContext (AZCoreRecord)
 
 #pragma mark - Instance Methods
@@ -89,17 +260,67 @@
 	return context;
 }
 
+#pragma mark - Reusable Child Contexts
+
+- (AZCoreRecordContextPool *) azcr_contextPool
+{
+	dispatch_semaphore_t semaphore = azcr_associatedObjectSemaphore();
+	dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+	
+	AZCoreRecordContextPool *pool = objc_getAssociatedObject(self, azcr_contextPoolKey);
+	if (!pool)
+	{
+		pool = [AZCoreRecordContextPool new];
+		objc_setAssociatedObject(self, azcr_contextPoolKey, pool, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+	}
+	
+	dispatch_semaphore_signal(semaphore);
+	
+	return pool;
+}
+
+- (NSManagedObjectContext *) dequeueReusableChildContext
+{
+	return [[self azcr_contextPool] dequeueContextForParent: self];
+}
+
+- (void) enqueueReusableChildContext: (NSManagedObjectContext *) context
+{
+	NSParameterAssert(context.parentContext == self);
+	[[self azcr_contextPool] enqueueContext: context];
+}
+
+- (void) drainReusableChildContexts
+{
+	// Pooled children retain their parent until they sit idle for a few
+	// seconds; draining lets a parent that is being thrown away go at once.
+	[objc_getAssociatedObject(self, azcr_contextPoolKey) drain];
+}
+
+- (NSDictionary *) reusableChildContextStatistics
+{
+	return [[self azcr_contextPool] statistics];
+}
+
 #pragma mark - Ubiquity Support
 
 - (void) azcr_mergeUbiquitousChanges: (NSNotification *) notification
 {
-	[self performBlock: ^{
-		[self mergeChangesFromContextDidSaveNotification: notification];
+	// An initial sync can carry tens of thousands of IDs; the merge engine
+	// spreads them over time-boxed slices instead of one long block.
+	NSDictionary *userInfo = notification.userInfo;
+	[self mergeChangesFromNotification: notification completion: ^{
+		[[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordDidMergeUbiquitousChangesNotification object: self userInfo: userInfo];
 	}];
 }
 
 - (void) startObservingUbiquitousChanges
 {
+	// Imports are posted on a background thread, which a confinement
+	// context can't be touched from.
+	if (self.concurrencyType == NSConfinementConcurrencyType)
+		[NSException raise: NSInvalidArgumentException format: @"-startObservingUbiquitousChanges requires a queue-based context."];
+	
 	[[NSNotificationCenter defaultCenter] addObserver: self selector: @selector(azcr_mergeUbiquitousChanges:) name: NSPersistentStoreDidImportUbiquitousContentChangesNotification object: self.persistentStoreCoordinator];
 }
 
@@ -108,6 +329,219 @@
 	[[NSNotificationCenter defaultCenter] removeObserver: self name: NSPersistentStoreDidImportUbiquitousContentChangesNotification object: self.persistentStoreCoordinator];
 }
 
+#pragma mark - Merging
+
+- (void) azcr_mergeSlices: (NSMutableArray *) slices completions: (NSArray *) completions
+{
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	
+	while (slices.count && (CFAbsoluteTimeGetCurrent() - start) < azcr_mergeSliceBudget)
+	{
+		NSDictionary *slice = [slices objectAtIndex: 0];
+		NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithCapacity: 3];
+		
+		[slice enumerateKeysAndObjectsUsingBlock: ^(NSString *key, NSArray *objectIDs, BOOL *stop) {
+			NSMutableSet *filteredIDs = [NSMutableSet setWithCapacity: objectIDs.count];
+			BOOL onlyRegistered = ![key isEqualToString: NSInsertedObjectsKey];
+			
+			for (NSManagedObjectID *objectID in objectIDs)
+			{
+				// Anything the context hasn't registered has nothing to refresh
+				if (onlyRegistered && ![self objectRegisteredForID: objectID])
+					continue;
+				
+				[filteredIDs addObject: objectID];
+			}
+			
+			if (filteredIDs.count)
+				[userInfo setObject: filteredIDs forKey: key];
+		}];
+		
+		if (userInfo.count)
+			[self mergeChangesFromContextDidSaveNotification: [NSNotification notificationWithName: NSManagedObjectContextDidSaveNotification object: nil userInfo: userInfo]];
+		
+		[slices removeObjectAtIndex: 0];
+	}
+	
+	if (slices.count)
+	{
+		if (self.concurrencyType == NSConfinementConcurrencyType)
+			return;
+		
+		// Out of time; yield the queue and pick up where we left off.
+		[self performBlock: ^{
+			[self azcr_mergeSlices: slices completions: completions];
+		}];
+		return;
+	}
+	
+	for (void (^completion)(void) in completions)
+		completion();
+	
+	if (self.concurrencyType == NSConfinementConcurrencyType)
+		return;
+	
+	// Changes that arrived meanwhile waited for this batch; they go next, so
+	// completions always fire in the order their changes were queued.
+	[self performBlock: ^{
+		[self azcr_mergePendingChanges];
+	}];
+}
+
+- (NSMutableArray *) azcr_takePendingSlicesWithCompletions: (NSArray **) outCompletions
+{
+	dispatch_semaphore_t semaphore = azcr_associatedObjectSemaphore();
+	dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+	
+	NSArray *pending = objc_getAssociatedObject(self, azcr_pendingMergesKey);
+	objc_setAssociatedObject(self, azcr_pendingMergesKey, nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+	if (!pending.count)
+		objc_setAssociatedObject(self, azcr_mergingKey, nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+	
+	dispatch_semaphore_signal(semaphore);
+	
+	if (!pending.count)
+		return nil;
+	
+	NSMutableSet *inserted = [NSMutableSet set];
+	NSMutableSet *updated = [NSMutableSet set];
+	NSMutableSet *deleted = [NSMutableSet set];
+	NSMutableArray *completions = [NSMutableArray array];
+	
+	for (NSDictionary *changes in pending)
+	{
+		[inserted unionSet: [changes objectForKey: NSInsertedObjectsKey]];
+		[updated unionSet: [changes objectForKey: NSUpdatedObjectsKey]];
+		[deleted unionSet: [changes objectForKey: NSDeletedObjectsKey]];
+		
+		id completion = [changes objectForKey: azcr_mergeCompletionKey];
+		if (completion)
+			[completions addObject: completion];
+	}
+	
+	[updated minusSet: inserted];
+	[updated minusSet: deleted];
+	[inserted minusSet: deleted];
+	
+	NSMutableArray *slices = [NSMutableArray array];
+	NSDictionary *changes = [NSDictionary dictionaryWithObjectsAndKeys: deleted, NSDeletedObjectsKey, inserted, NSInsertedObjectsKey, updated, NSUpdatedObjectsKey, nil];
+	[changes enumerateKeysAndObjectsUsingBlock: ^(NSString *key, NSSet *objectIDs, BOOL *stop) {
+		NSArray *allIDs = objectIDs.allObjects;
+		for (NSUInteger location = 0; location < allIDs.count; location += azcr_mergeSliceSize)
+		{
+			NSRange range = NSMakeRange(location, MIN(azcr_mergeSliceSize, allIDs.count - location));
+			[slices addObject: [NSDictionary dictionaryWithObject: [allIDs subarrayWithRange: range] forKey: key]];
+		}
+	}];
+	
+	*outCompletions = completions;
+	return slices;
+}
+
+- (void) azcr_mergePendingChanges
+{
+	NSArray *completions = nil;
+	NSMutableArray *slices = [self azcr_takePendingSlicesWithCompletions: &completions];
+	if (!slices)
+		return;
+	
+	if (self.concurrencyType != NSConfinementConcurrencyType)
+	{
+		[self azcr_mergeSlices: slices completions: completions];
+		return;
+	}
+	
+	do
+	{
+		do
+			[self azcr_mergeSlices: slices completions: completions];
+		while (slices.count);
+		
+		slices = [self azcr_takePendingSlicesWithCompletions: &completions];
+	}
+	while (slices);
+}
+
+- (void) mergeChangesFromNotification: (NSNotification *) notification
+{
+	[self mergeChangesFromNotification: notification completion: nil];
+}
+
+- (void) mergeChangesFromNotification: (NSNotification *) notification completion: (void (^)(void)) completion
+{
+	// Resolve object IDs now, on the sender's thread; the objects themselves
+	// belong to the saving context.
+	NSMutableDictionary *changes = [NSMutableDictionary dictionaryWithCapacity: 3];
+	for (NSString *key in [NSArray arrayWithObjects: NSInsertedObjectsKey, NSUpdatedObjectsKey, NSDeletedObjectsKey, nil])
+	{
+		NSMutableSet *objectIDs = [NSMutableSet set];
+		for (id object in [notification.userInfo objectForKey: key])
+			[objectIDs addObject: [object isKindOfClass: [NSManagedObjectID class]] ? object : [object objectID]];
+		[changes setObject: objectIDs forKey: key];
+	}
+	
+	if (completion)
+		[changes setObject: [completion copy] forKey: azcr_mergeCompletionKey];
+	
+	dispatch_semaphore_t semaphore = azcr_associatedObjectSemaphore();
+	dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+	
+	NSMutableArray *pending = objc_getAssociatedObject(self, azcr_pendingMergesKey);
+	if (!pending)
+	{
+		pending = [NSMutableArray array];
+		objc_setAssociatedObject(self, azcr_pendingMergesKey, pending, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+	}
+	[pending addObject: changes];
+	
+	// Only one merge runs per context at a time; it picks up whatever is
+	// pending when its current batch is done.
+	BOOL shouldSchedule = !objc_getAssociatedObject(self, azcr_mergingKey);
+	if (shouldSchedule)
+		objc_setAssociatedObject(self, azcr_mergingKey, [NSNumber numberWithBool: YES], OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+	
+	dispatch_semaphore_signal(semaphore);
+	
+	if (!shouldSchedule)
+		return;
+	
+	if (self.concurrencyType == NSConfinementConcurrencyType)
+		[self azcr_mergePendingChanges];
+	else
+		[self performBlock: ^{
+			[self azcr_mergePendingChanges];
+		}];
+}
+
+- (void) azcr_mergeContextDidSave: (NSNotification *) notification
+{
+	NSManagedObjectContext *context = notification.object;
+	
+	// Only saves that reached the store carry permanent IDs worth merging
+	if (context == self || context.parentContext)
+		return;
+	
+	if (context.persistentStoreCoordinator != self.persistentStoreCoordinator)
+		return;
+	
+	[self mergeChangesFromNotification: notification];
+}
+
+- (void) startObservingContextSaves
+{
+	// Saves are posted on the saving context's thread, which a confinement
+	// context can't be touched from.
+	if (self.concurrencyType == NSConfinementConcurrencyType)
+		[NSException raise: NSInvalidArgumentException format: @"-startObservingContextSaves requires a queue-based context."];
+	
+	[[NSNotificationCenter defaultCenter] addObserver: self selector: @selector(azcr_mergeContextDidSave:) name: NSManagedObjectContextDidSaveNotification object: nil];
+}
+
+- (void) stopObservingContextSaves
+{
+	[[NSNotificationCenter defaultCenter] removeObserver: self name: NSManagedObjectContextDidSaveNotification object: nil];
+}
+
 #pragma mark - Reset Context
 
 + (void) resetDefaultContext
@@ -119,16 +553,19 @@
 }
 + (void) resetContextForCurrentThread 
 {
-	[[NSManagedObjectContext contextForCurrentThread] reset];
+	NSManagedObjectContext *context = [NSManagedObjectContext contextForCurrentThread];
+	[context performBlockAndWait: ^{
+		[context reset];
+	}];
 }
 
 #pragma mark - Data saving
 
-- (void) saveDataWithBlock: (void(^)(NSManagedObjectContext *context)) block
+- (BOOL) azcr_saveDataWithBlock: (void(^)(NSManagedObjectContext *context)) block
 {
 	NSParameterAssert(block != nil);
 	
-	NSManagedObjectContext *localContext = [self newChildContext];
+	NSManagedObjectContext *localContext = [self dequeueReusableChildContext];
 	
 	NSMergePolicy *backupMergePolicy = self.mergePolicy;
 	self.mergePolicy = NSMergeByPropertyStoreTrumpMergePolicy;
@@ -136,9 +573,18 @@
 	
 	block(localContext);
 	
-	[localContext save];
+	BOOL success = [localContext save];
 	
 	self.mergePolicy = backupMergePolicy;
+	
+	[self enqueueReusableChildContext: localContext];
+	
+	return success;
+}
+
+- (void) saveDataWithBlock: (void(^)(NSManagedObjectContext *context)) block
+{
+	[self azcr_saveDataWithBlock: block];
 }
 
 - (void) saveDataInBackgroundWithBlock: (void (^)(NSManagedObjectContext *)) block
@@ -150,7 +596,7 @@
 {
 	NSParameterAssert(block != nil);
 	
-	NSManagedObjectContext *localContext = [self newChildContext];
+	NSManagedObjectContext *localContext = [self dequeueReusableChildContext];
 	
 	NSMergePolicy *backupMergePolicy = self.mergePolicy;
 	self.mergePolicy = NSMergeByPropertyStoreTrumpMergePolicy;
@@ -163,9 +609,100 @@
 		
 		self.mergePolicy = backupMergePolicy;
 		
+		[self enqueueReusableChildContext: localContext];
+		
 		if (callback)
 			dispatch_async(dispatch_get_main_queue(), callback);
 	}];
 }
 
+#pragma mark - Durable saving
+
+- (void) azcr_saveLevelWithCallbacks: (NSArray *) callbacks
+{
+	void (^finish)(BOOL) = ^(BOOL success){
+		for (void (^callback)(BOOL) in callbacks)
+			callback(success);
+	};
+	
+	NSError *error = nil;
+	if (self.hasChanges && ![self save: &error])
+	{
+		[AZCoreRecordManager handleError: error];
+		finish(NO);
+		return;
+	}
+	
+	NSManagedObjectContext *parentContext = self.parentContext;
+	if (!parentContext)
+	{
+		finish(YES);
+		return;
+	}
+	
+	[parentContext azcr_saveToPersistentStoreWithCallback: finish];
+}
+
+- (void) azcr_saveToPersistentStoreWithCallback: (void (^)(BOOL success)) callback
+{
+	if (self.concurrencyType == NSConfinementConcurrencyType)
+	{
+		[self azcr_saveLevelWithCallbacks: [NSArray arrayWithObject: callback]];
+		return;
+	}
+	
+	dispatch_semaphore_t semaphore = azcr_associatedObjectSemaphore();
+	
+	// Requests arriving before this level's queue gets around to saving
+	// ride along with the one already scheduled, so they share a commit.
+	dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+	
+	NSMutableArray *pending = objc_getAssociatedObject(self, azcr_pendingSaveCallbacksKey);
+	BOOL shouldSchedule = !pending;
+	if (shouldSchedule)
+	{
+		pending = [NSMutableArray array];
+		objc_setAssociatedObject(self, azcr_pendingSaveCallbacksKey, pending, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+	}
+	[pending addObject: [callback copy]];
+	
+	dispatch_semaphore_signal(semaphore);
+	
+	if (!shouldSchedule)
+		return;
+	
+	[self performBlock: ^{
+		dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+		NSArray *callbacks = objc_getAssociatedObject(self, azcr_pendingSaveCallbacksKey);
+		objc_setAssociatedObject(self, azcr_pendingSaveCallbacksKey, nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+		dispatch_semaphore_signal(semaphore);
+		
+		[self azcr_saveLevelWithCallbacks: callbacks];
+	}];
+}
+
+- (void) saveToPersistentStoreWithCompletion: (void (^)(BOOL success)) callback
+{
+	[self azcr_saveToPersistentStoreWithCallback: ^(BOOL success) {
+		if (callback)
+			dispatch_async(dispatch_get_main_queue(), ^{
+				callback(success);
+			});
+	}];
+}
+
+- (void) saveDataToPersistentStoreWithBlock: (void (^)(NSManagedObjectContext *context)) block completion: (void (^)(BOOL success)) callback
+{
+	if (![self azcr_saveDataWithBlock: block])
+	{
+		if (callback)
+			dispatch_async(dispatch_get_main_queue(), ^{
+				callback(NO);
+			});
+		return;
+	}
+	
+	[self saveToPersistentStoreWithCompletion: callback];
+}
+
 @end
@@ -16,4 +16,19 @@
 + (NSManagedObjectModel *) modelWithName: (NSString *) name;
 + (NSManagedObjectModel *) modelWithName: (NSString *) name inBundle: (NSBundle *) bundle;
 
+#pragma mark - Model Cache
+
+/** Cached models are compiled once and shared by every caller, so treat
+ them as read-only. The cache keeps the eight most recently used models and
+ recompiles a model whose file has changed. */
++ (NSManagedObjectModel *) cachedModelWithName: (NSString *) name;
++ (NSManagedObjectModel *) cachedModelWithName: (NSString *) name inBundle: (NSBundle *) bundle;
++ (NSManagedObjectModel *) cachedModelWithContentsOfURL: (NSURL *) URL;
++ (void) removeCachedModels;
+
+#pragma mark - Model Versions
+
++ (NSArray *) modelVersionURLsAtURL: (NSURL *) URL;
++ (NSArray *) modelVersionURLsInBundle: (NSBundle *) bundle;
+
 @end
\ No newline at end of file
@@ -10,6 +10,15 @@
 #import "NSManagedObjectModel+AZCoreRecord.h"
 #import "AZCoreRecordManager.h"
 
+static NSString *const AZCoreRecordCachedModelKey = @"model";
+static NSString *const AZCoreRecordCachedModelDateKey = @"date";
+
+static const NSUInteger azcr_modelCacheCapacity = 8;
+
+static NSMutableDictionary *azcr_modelCache = nil;
+static NSMutableArray *azcr_modelCacheOrder = nil;
+static dispatch_semaphore_t azcr_modelCacheSemaphore = NULL;
+
 @implementation NSManagedObjectModel (AZCoreRecord)
 
 #pragma mark - Model Factory Methods
@@ -19,6 +28,11 @@
 	return [self modelWithName: modelName inBundle: [NSBundle mainBundle]];
 }
 + (NSManagedObjectModel *) modelWithName: (NSString *) modelName inBundle: (NSBundle *) bundle
+{
+	return [[NSManagedObjectModel alloc] initWithContentsOfURL: [self azcr_URLForModelNamed: modelName inBundle: bundle]];
+}
+
++ (NSURL *) azcr_URLForModelNamed: (NSString *) modelName inBundle: (NSBundle *) bundle
 {
 	NSString *resource = [modelName stringByDeletingPathExtension];
 	NSString *pathExtension = [modelName pathExtension];
@@ -28,7 +42,122 @@
 	if (!URL) URL = [bundle URLForResource: resource withExtension: @"mom"];
 	NSAssert2(URL, @"Could not find model named %@ in bundle %@", modelName, bundle);
 	
-	return [[NSManagedObjectModel alloc] initWithContentsOfURL: URL];
+	return URL;
+}
+
+#pragma mark - Model Cache
+
++ (NSManagedObjectModel *) cachedModelWithName: (NSString *) modelName
+{
+	return [self cachedModelWithName: modelName inBundle: [NSBundle mainBundle]];
+}
++ (NSManagedObjectModel *) cachedModelWithName: (NSString *) modelName inBundle: (NSBundle *) bundle
+{
+	return [self cachedModelWithContentsOfURL: [self azcr_URLForModelNamed: modelName inBundle: bundle]];
+}
+
++ (NSManagedObjectModel *) cachedModelWithContentsOfURL: (NSURL *) URL
+{
+	NSParameterAssert(URL);
+	
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		azcr_modelCache = [NSMutableDictionary dictionaryWithCapacity: azcr_modelCacheCapacity];
+		azcr_modelCacheOrder = [NSMutableArray arrayWithCapacity: azcr_modelCacheCapacity];
+		azcr_modelCacheSemaphore = dispatch_semaphore_create(1);
+	});
+	
+	NSURL *key = [[URL URLByResolvingSymlinksInPath] URLByStandardizingPath];
+	
+	NSDate *modificationDate = nil;
+	[key getResourceValue: &modificationDate forKey: NSURLContentModificationDateKey error: NULL];
+	if (!modificationDate)
+		modificationDate = [NSDate distantPast];
+	
+	dispatch_semaphore_wait(azcr_modelCacheSemaphore, DISPATCH_TIME_FOREVER);
+	
+	NSDictionary *entry = [azcr_modelCache objectForKey: key];
+	BOOL isCurrent = [[entry objectForKey: AZCoreRecordCachedModelDateKey] isEqualToDate: modificationDate];
+	if (isCurrent)
+		[self azcr_markCachedModelUsed: key];
+	
+	dispatch_semaphore_signal(azcr_modelCacheSemaphore);
+	
+	if (isCurrent)
+		return [entry objectForKey: AZCoreRecordCachedModelKey];
+	
+	// Compile outside the lock so unrelated models don't wait on each other
+	NSManagedObjectModel *model = [[NSManagedObjectModel alloc] initWithContentsOfURL: key];
+	if (!model)
+		return nil;
+	
+	dispatch_semaphore_wait(azcr_modelCacheSemaphore, DISPATCH_TIME_FOREVER);
+	
+	entry = [azcr_modelCache objectForKey: key];
+	if ([[entry objectForKey: AZCoreRecordCachedModelDateKey] isEqualToDate: modificationDate])
+	{
+		// Someone beat us to it; hand out their instance so it stays shared
+		model = [entry objectForKey: AZCoreRecordCachedModelKey];
+	}
+	else
+	{
+		entry = [NSDictionary dictionaryWithObjectsAndKeys: model, AZCoreRecordCachedModelKey, modificationDate, AZCoreRecordCachedModelDateKey, nil];
+		[azcr_modelCache setObject: entry forKey: key];
+	}
+	
+	[self azcr_markCachedModelUsed: key];
+	
+	while (azcr_modelCacheOrder.count > azcr_modelCacheCapacity)
+	{
+		[azcr_modelCache removeObjectForKey: [azcr_modelCacheOrder objectAtIndex: 0]];
+		[azcr_modelCacheOrder removeObjectAtIndex: 0];
+	}
+	
+	dispatch_semaphore_signal(azcr_modelCacheSemaphore);
+	
+	return model;
+}
+
++ (void) azcr_markCachedModelUsed: (NSURL *) key
+{
+	// Called with the cache semaphore held; most recently used goes last
+	[azcr_modelCacheOrder removeObject: key];
+	[azcr_modelCacheOrder addObject: key];
+}
+
++ (void) removeCachedModels
+{
+	if (!azcr_modelCacheSemaphore)
+		return;
+	
+	dispatch_semaphore_wait(azcr_modelCacheSemaphore, DISPATCH_TIME_FOREVER);
+	[azcr_modelCache removeAllObjects];
+	[azcr_modelCacheOrder removeAllObjects];
+	dispatch_semaphore_signal(azcr_modelCacheSemaphore);
+}
+
+#pragma mark - Model Versions
+
++ (NSArray *) modelVersionURLsAtURL: (NSURL *) URL
+{
+	NSParameterAssert(URL);
+	
+	if (![URL.pathExtension isEqualToString: @"momd"])
+		return [NSArray arrayWithObject: URL];
+	
+	NSArray *contents = [[NSFileManager new] contentsOfDirectoryAtURL: URL includingPropertiesForKeys: nil options: NSDirectoryEnumerationSkipsHiddenFiles error: NULL];
+	return [contents filteredArrayUsingPredicate: [NSPredicate predicateWithFormat: @"pathExtension == 'mom'"]];
+}
++ (NSArray *) modelVersionURLsInBundle: (NSBundle *) bundle
+{
+	NSMutableArray *URLs = [NSMutableArray array];
+	
+	for (NSURL *URL in [bundle URLsForResourcesWithExtension: @"momd" subdirectory: nil])
+		[URLs addObjectsFromArray: [self modelVersionURLsAtURL: URL]];
+	
+	[URLs addObjectsFromArray: [bundle URLsForResourcesWithExtension: @"mom" subdirectory: nil]];
+	
+	return URLs;
 }
 
 @end
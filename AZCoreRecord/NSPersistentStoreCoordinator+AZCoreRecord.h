@@ -26,4 +26,20 @@
 
 - (void) seedWithPersistentStoreAtURL: (NSURL *) oldStoreURL usingBlock:(void(^)(NSManagedObjectContext *oldMOC, NSManagedObjectContext *newMOC))block;
 
+/** Copies every object in the store at `oldStoreURL` into the receiver's
+ ubiquitous store (or its only store) without holding the whole graph in
+ memory.
+
+ Objects are copied entity by entity, `pageSize` at a time, with both
+ contexts saved and reset between pages. Relationships are wired up in a
+ second pass through a table mapping old object IDs to new ones; objects
+ outside the copied store are left unconnected. `progress` and `completion`
+ are called on the main queue.
+
+ Pages are committed as they go, so if one fails to save, the copies
+ already saved are deleted again, page by page, before `completion` is
+ called with NO. AZCoreRecordDidFinishSeedingPersistentStoreNotification
+ is only posted for a seed that finished. */
+- (void) seedWithPersistentStoreAtURL: (NSURL *) oldStoreURL pageSize: (NSUInteger) pageSize progress: (void (^)(double fractionCompleted)) progress completion: (void (^)(BOOL success)) completion;
+
 @end
@@ -73,11 +73,279 @@
         
         block(oldMOC, newMOC);
         
+        // If the block saved on its own, leave the names out so every entity is checked
+        NSSet *entityNames = [newMOC.insertedObjects valueForKeyPath: @"entity.name"];
+        
         if ([newMOC hasChanges] && [newMOC save])
             [newMOC reset];
         
-        [[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordDidFinishSeedingPersistentStoreNotification object: self];
+        NSDictionary *userInfo = entityNames.count ? [NSDictionary dictionaryWithObject: entityNames forKey: AZCoreRecordDeduplicationEntityNamesKey] : nil;
+        [[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordDidFinishSeedingPersistentStoreNotification object: self userInfo: userInfo];
     });
 }
 
+#pragma mark - Chunked seeding
+
+static BOOL azcr_shouldCopyRelationship(NSRelationshipDescription *relationship)
+{
+	if (relationship.isTransient)
+		return NO;
+	
+	// Core Data keeps inverses in step, so only one side of each pair needs setting
+	NSRelationshipDescription *inverse = relationship.inverseRelationship;
+	if (!inverse || !relationship.isToMany)
+		return YES;
+	if (!inverse.isToMany)
+		return NO;
+	
+	NSString *name = [relationship.entity.name stringByAppendingFormat: @".%@", relationship.name];
+	NSString *inverseName = [inverse.entity.name stringByAppendingFormat: @".%@", inverse.name];
+	return [name compare: inverseName] != NSOrderedDescending;
+}
+
+- (NSArray *) azcr_objectIDsForEntity: (NSEntityDescription *) entity inContext: (NSManagedObjectContext *) context
+{
+	NSFetchRequest *request = [NSFetchRequest new];
+	request.entity = entity;
+	request.includesSubentities = NO;
+	request.resultType = NSManagedObjectIDResultType;
+	
+	NSError *error = nil;
+	NSArray *objectIDs = [context executeFetchRequest: request error: &error];
+	[AZCoreRecordManager handleError: error];
+	return objectIDs;
+}
+
+- (NSArray *) azcr_objectsWithIDs: (NSArray *) objectIDs entity: (NSEntityDescription *) entity inContext: (NSManagedObjectContext *) context
+{
+	NSFetchRequest *request = [NSFetchRequest new];
+	request.entity = entity;
+	request.includesSubentities = NO;
+	request.predicate = [NSPredicate predicateWithFormat: @"self IN %@", objectIDs];
+	request.returnsObjectsAsFaults = NO;
+	
+	NSError *error = nil;
+	NSArray *objects = [context executeFetchRequest: request error: &error];
+	[AZCoreRecordManager handleError: error];
+	return objects;
+}
+
+- (void) azcr_deleteObjectsWithIDs: (NSArray *) objectIDs pageSize: (NSUInteger) pageSize inContext: (NSManagedObjectContext *) context
+{
+	for (NSUInteger location = 0; location < objectIDs.count; location += pageSize)
+	{
+		@autoreleasepool {
+			NSArray *page = [objectIDs subarrayWithRange: NSMakeRange(location, MIN(pageSize, objectIDs.count - location))];
+			for (NSManagedObjectID *objectID in page)
+			{
+				NSManagedObject *object = [context existingObjectWithID: objectID];
+				if (object)
+					[context deleteObject: object];
+			}
+			
+			NSError *error = nil;
+			if ([context hasChanges] && ![context save: &error])
+				[context rollback];
+			[AZCoreRecordManager handleError: error];
+			
+			[context reset];
+		}
+	}
+}
+
+- (void) seedWithPersistentStoreAtURL: (NSURL *) oldStoreURL pageSize: (NSUInteger) pageSize progress: (void (^)(double fractionCompleted)) progress completion: (void (^)(BOOL success)) completion
+{
+	NSParameterAssert(oldStoreURL);
+	
+	pageSize = MAX(pageSize, 1);
+	
+	dispatch_queue_t globalQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	dispatch_async(globalQueue, ^{
+		void (^finish)(BOOL) = ^(BOOL success){
+			if (completion)
+				dispatch_async(dispatch_get_main_queue(), ^{ completion(success); });
+		};
+		
+		__block NSPersistentStore *targetStore = self.persistentStores.lastObject;
+		[self.persistentStores enumerateObjectsUsingBlock:^(NSPersistentStore *obj, NSUInteger idx, BOOL *stop) {
+			if ([obj.options objectForKey: NSPersistentStoreUbiquitousContentNameKey]) {
+				targetStore = obj;
+				*stop = YES;
+			}
+		}];
+		
+		// A store added without a configuration reports a name of Core
+		// Data's own, which the model doesn't know
+		NSString *configuration = targetStore.configurationName;
+		if (![self.managedObjectModel.configurations containsObject: configuration])
+			configuration = nil;
+		
+		NSPersistentStoreCoordinator *oldPSC = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: self.managedObjectModel];
+		NSDictionary *oldPSOption = [NSDictionary dictionaryWithObject: [NSNumber numberWithBool: YES] forKey: NSReadOnlyPersistentStoreOption];
+		if (!targetStore || ![oldPSC addStoreAtURL: oldStoreURL configuration: configuration options: oldPSOption])
+		{
+			finish(NO);
+			return;
+		}
+		
+		// Both contexts stay on this queue for the whole copy
+		NSManagedObjectContext *oldMOC = [[NSManagedObjectContext alloc] init];
+		oldMOC.persistentStoreCoordinator = oldPSC;
+		oldMOC.undoManager = nil;
+		
+		NSManagedObjectContext *newMOC = [[NSManagedObjectContext alloc] init];
+		newMOC.persistentStoreCoordinator = self;
+		newMOC.undoManager = nil;
+		
+		NSArray *entities = configuration ? [self.managedObjectModel entitiesForConfiguration: configuration] : self.managedObjectModel.entities;
+		NSMutableDictionary *objectIDsByEntity = [NSMutableDictionary dictionaryWithCapacity: entities.count];
+		NSUInteger totalCount = 0;
+		
+		for (NSEntityDescription *entity in entities)
+		{
+			if (entity.isAbstract)
+				continue;
+			
+			NSArray *objectIDs = [self azcr_objectIDsForEntity: entity inContext: oldMOC];
+			if (!objectIDs.count)
+				continue;
+			
+			[objectIDsByEntity setObject: objectIDs forKey: entity.name];
+			totalCount += objectIDs.count;
+		}
+		
+		// Every object is visited twice: once for attributes, once for relationships
+		__block NSUInteger completedCount = 0;
+		void (^reportPage)(NSUInteger) = ^(NSUInteger count){
+			completedCount += count;
+			if (!progress)
+				return;
+			
+			double fraction = totalCount ? (double) completedCount / (double) (totalCount * 2) : 1.0;
+			dispatch_async(dispatch_get_main_queue(), ^{ progress(fraction); });
+		};
+		
+		NSMutableDictionary *translationTable = [NSMutableDictionary dictionaryWithCapacity: totalCount];
+		BOOL success = YES;
+		
+		// Pass 1: insert copies with their attributes
+		for (NSString *entityName in objectIDsByEntity)
+		{
+			NSEntityDescription *entity = [self.managedObjectModel.entitiesByName objectForKey: entityName];
+			NSArray *attributeNames = [[entity.attributesByName keysOfEntriesPassingTest: ^BOOL(id key, NSAttributeDescription *attribute, BOOL *stop) {
+				return !attribute.isTransient;
+			}] allObjects];
+			NSArray *objectIDs = [objectIDsByEntity objectForKey: entityName];
+			
+			for (NSUInteger location = 0; success && location < objectIDs.count; location += pageSize)
+			{
+				@autoreleasepool {
+					NSArray *page = [objectIDs subarrayWithRange: NSMakeRange(location, MIN(pageSize, objectIDs.count - location))];
+					NSArray *oldObjects = [self azcr_objectsWithIDs: page entity: entity inContext: oldMOC];
+					NSMutableArray *newObjects = [NSMutableArray arrayWithCapacity: oldObjects.count];
+					
+					for (NSManagedObject *oldObject in oldObjects)
+					{
+						NSManagedObject *newObject = [[NSManagedObject alloc] initWithEntity: entity insertIntoManagedObjectContext: newMOC];
+						[newMOC assignObject: newObject toPersistentStore: targetStore];
+						[newObject setValuesForKeysWithDictionary: [oldObject dictionaryWithValuesForKeys: attributeNames]];
+						[newObjects addObject: newObject];
+					}
+					
+					NSError *error = nil;
+					success = [newMOC obtainPermanentIDsForObjects: newObjects error: &error] && [newMOC save: &error];
+					[AZCoreRecordManager handleError: error];
+					
+					if (success)
+						[oldObjects enumerateObjectsUsingBlock: ^(NSManagedObject *oldObject, NSUInteger idx, BOOL *stop) {
+							[translationTable setObject: [[newObjects objectAtIndex: idx] objectID] forKey: oldObject.objectID];
+						}];
+					
+					[oldMOC reset];
+					[newMOC reset];
+					reportPage(page.count);
+				}
+			}
+		}
+		
+		// Pass 2: point relationships at the copies
+		for (NSString *entityName in objectIDsByEntity)
+		{
+			NSEntityDescription *entity = [self.managedObjectModel.entitiesByName objectForKey: entityName];
+			NSArray *relationships = [entity.relationshipsByName.allValues filteredArrayUsingPredicate: [NSPredicate predicateWithBlock: ^BOOL(NSRelationshipDescription *relationship, NSDictionary *bindings) {
+				return azcr_shouldCopyRelationship(relationship);
+			}]];
+			NSArray *objectIDs = [objectIDsByEntity objectForKey: entityName];
+			
+			if (!relationships.count)
+			{
+				reportPage(objectIDs.count);
+				continue;
+			}
+			
+			for (NSUInteger location = 0; success && location < objectIDs.count; location += pageSize)
+			{
+				@autoreleasepool {
+					NSArray *page = [objectIDs subarrayWithRange: NSMakeRange(location, MIN(pageSize, objectIDs.count - location))];
+					NSArray *oldObjects = [self azcr_objectsWithIDs: page entity: entity inContext: oldMOC];
+					
+					for (NSManagedObject *oldObject in oldObjects)
+					{
+						NSManagedObjectID *newID = [translationTable objectForKey: oldObject.objectID];
+						NSManagedObject *newObject = newID ? [newMOC existingObjectWithID: newID] : nil;
+						if (!newObject)
+							continue;
+						
+						for (NSRelationshipDescription *relationship in relationships)
+						{
+							id oldValue = [oldObject valueForKey: relationship.name];
+							
+							if (!relationship.isToMany)
+							{
+								NSManagedObjectID *destinationID = oldValue ? [translationTable objectForKey: [oldValue objectID]] : nil;
+								if (destinationID)
+									[newObject setValue: [newMOC existingObjectWithID: destinationID] forKey: relationship.name];
+								continue;
+							}
+							
+							id newValue = [oldValue isKindOfClass: [NSOrderedSet class]] ? [NSMutableOrderedSet orderedSet] : [NSMutableSet set];
+							for (NSManagedObject *destination in oldValue)
+							{
+								NSManagedObjectID *destinationID = [translationTable objectForKey: destination.objectID];
+								NSManagedObject *newDestination = destinationID ? [newMOC existingObjectWithID: destinationID] : nil;
+								if (newDestination)
+									[newValue addObject: newDestination];
+							}
+							[newObject setValue: newValue forKey: relationship.name];
+						}
+					}
+					
+					NSError *error = nil;
+					success = ![newMOC hasChanges] || [newMOC save: &error];
+					[AZCoreRecordManager handleError: error];
+					
+					[oldMOC reset];
+					[newMOC reset];
+					reportPage(page.count);
+				}
+			}
+		}
+		
+		if (!success)
+		{
+			// Take back the pages already saved so a retry starts clean and
+			// nothing half-copied is left for deduplication to trip over
+			[self azcr_deleteObjectsWithIDs: translationTable.allValues pageSize: pageSize inContext: newMOC];
+			finish(NO);
+			return;
+		}
+		
+		NSSet *entityNames = [NSSet setWithArray: objectIDsByEntity.allKeys];
+		NSDictionary *userInfo = entityNames.count ? [NSDictionary dictionaryWithObject: entityNames forKey: AZCoreRecordDeduplicationEntityNamesKey] : nil;
+		[[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordDidFinishSeedingPersistentStoreNotification object: self userInfo: userInfo];
+		
+		finish(YES);
+	});
+}
+
 @end
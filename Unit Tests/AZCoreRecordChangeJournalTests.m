@@ -0,0 +1,156 @@
+//
+//  AZCoreRecordChangeJournalTests.m
+//  AZCoreRecord Unit Tests
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordChangeJournalTests.h"
+#import "AZCoreRecordChangeJournal.h"
+#import "NSManagedObjectModel+AZCoreRecord.h"
+#import "NSPersistentStoreCoordinator+AZCoreRecord.h"
+
+@implementation AZCoreRecordChangeJournalTests {
+	NSURL *_directoryURL;
+	NSURL *_sourceURL;
+	NSManagedObjectModel *_model;
+	NSPersistentStore *_sourceStore;
+	NSManagedObjectContext *_sourceContext;
+	AZCoreRecordChangeJournal *_journal;
+}
+
+- (void) setUp
+{
+	NSString *directoryName = [[NSProcessInfo processInfo] globallyUniqueString];
+	_directoryURL = [NSURL fileURLWithPath: [NSTemporaryDirectory() stringByAppendingPathComponent: directoryName] isDirectory: YES];
+	[[NSFileManager defaultManager] createDirectoryAtURL: _directoryURL withIntermediateDirectories: YES attributes: nil error: NULL];
+	_sourceURL = [_directoryURL URLByAppendingPathComponent: @"Source.sqlite"];
+	
+	_model = [NSManagedObjectModel modelWithName: @"TestModel.momd"];
+	
+	NSPersistentStoreCoordinator *coordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: _model];
+	_sourceStore = [coordinator addStoreAtURL: _sourceURL configuration: nil options: nil];
+	
+	_sourceContext = [NSManagedObjectContext new];
+	_sourceContext.persistentStoreCoordinator = coordinator;
+	
+	_journal = [[AZCoreRecordChangeJournal alloc] initWithURL: [_directoryURL URLByAppendingPathComponent: @"Source.changes"]];
+}
+
+- (void) tearDown
+{
+	[_journal stopRecording];
+	_journal = nil;
+	_sourceContext = nil;
+	_sourceStore = nil;
+	[[NSFileManager defaultManager] removeItemAtURL: _directoryURL error: NULL];
+}
+
+- (NSManagedObject *) insertMappedEntityWithID: (NSInteger) primaryValue sample: (NSString *) sample inContext: (NSManagedObjectContext *) context
+{
+	NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName: @"MappedEntity" inManagedObjectContext: context];
+	[object setValue: [NSNumber numberWithInteger: primaryValue] forKey: @"mappedEntityID"];
+	[object setValue: sample forKey: @"sampleAttribute"];
+	return object;
+}
+
+- (NSArray *) objectsOfEntity: (NSString *) entityName inContext: (NSManagedObjectContext *) context
+{
+	return [context executeFetchRequest: [NSFetchRequest fetchRequestWithEntityName: entityName] error: NULL];
+}
+
+- (NSManagedObjectContext *) targetContextWithStore: (NSPersistentStore **) outStore
+{
+	NSPersistentStoreCoordinator *coordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: _model];
+	*outStore = [coordinator addInMemoryStore];
+	
+	NSManagedObjectContext *context = [NSManagedObjectContext new];
+	context.persistentStoreCoordinator = coordinator;
+	return context;
+}
+
+- (void) testInsertAbsorbsLaterUpdates
+{
+	[_journal startRecordingChangesToStore: _sourceStore];
+	
+	NSManagedObject *object = [self insertMappedEntityWithID: 1 sample: @"first" inContext: _sourceContext];
+	[_sourceContext save: NULL];
+	[object setValue: @"second" forKey: @"sampleAttribute"];
+	[_sourceContext save: NULL];
+	
+	assertThatUnsignedInteger(_journal.changeCount, equalToUnsignedInteger(1));
+	
+	// Still replayed as an insert, with the latest values
+	NSPersistentStore *targetStore = nil;
+	NSManagedObjectContext *targetContext = [self targetContextWithStore: &targetStore];
+	NSUInteger applied = [_journal replayChangesFromStoreAtURL: _sourceURL intoStore: targetStore pageSize: 1 error: NULL];
+	
+	assertThatUnsignedInteger(applied, equalToUnsignedInteger(1));
+	assertThat([[self objectsOfEntity: @"MappedEntity" inContext: targetContext] valueForKey: @"sampleAttribute"], is(equalTo([NSArray arrayWithObject: @"second"])));
+}
+
+- (void) testInsertThenDeleteDisappears
+{
+	[_journal startRecordingChangesToStore: _sourceStore];
+	
+	NSManagedObject *object = [self insertMappedEntityWithID: 1 sample: @"first" inContext: _sourceContext];
+	[_sourceContext save: NULL];
+	[_sourceContext deleteObject: object];
+	[_sourceContext save: NULL];
+	
+	assertThatUnsignedInteger(_journal.changeCount, equalToUnsignedInteger(0));
+	assertThatBool([_journal.URL checkResourceIsReachableAndReturnError: NULL], equalToBool(NO));
+}
+
+- (void) testReplayMatchesUpdatesAndDeletesByPrimaryValue
+{
+	NSManagedObject *updated = [self insertMappedEntityWithID: 1 sample: @"old" inContext: _sourceContext];
+	NSManagedObject *deleted = [self insertMappedEntityWithID: 2 sample: @"gone" inContext: _sourceContext];
+	[_sourceContext save: NULL];
+	
+	NSPersistentStore *targetStore = nil;
+	NSManagedObjectContext *targetContext = [self targetContextWithStore: &targetStore];
+	[self insertMappedEntityWithID: 1 sample: @"old" inContext: targetContext];
+	[self insertMappedEntityWithID: 2 sample: @"gone" inContext: targetContext];
+	[targetContext save: NULL];
+	
+	[_journal startRecordingChangesToStore: _sourceStore];
+	[updated setValue: @"new" forKey: @"sampleAttribute"];
+	[_sourceContext deleteObject: deleted];
+	[_sourceContext save: NULL];
+	
+	assertThatUnsignedInteger(_journal.changeCount, equalToUnsignedInteger(2));
+	
+	NSUInteger applied = [_journal replayChangesFromStoreAtURL: _sourceURL intoStore: targetStore pageSize: 1 error: NULL];
+	[targetContext reset];
+	
+	assertThatUnsignedInteger(applied, equalToUnsignedInteger(2));
+	NSArray *objects = [self objectsOfEntity: @"MappedEntity" inContext: targetContext];
+	assertThat([objects valueForKey: @"mappedEntityID"], is(equalTo([NSArray arrayWithObject: [NSNumber numberWithInteger: 1]])));
+	assertThat([objects valueForKey: @"sampleAttribute"], is(equalTo([NSArray arrayWithObject: @"new"])));
+}
+
+- (void) testReplayedEntriesAreNotReplayedAgain
+{
+	[_journal startRecordingChangesToStore: _sourceStore];
+	
+	// No primary attribute, so a second copy could never be matched up
+	for (NSUInteger i = 0; i < 3; i++)
+		[NSEntityDescription insertNewObjectForEntityForName: @"SingleEntityWithNoRelationships" inManagedObjectContext: _sourceContext];
+	[_sourceContext save: NULL];
+	[_journal stopRecording];
+	
+	NSPersistentStore *targetStore = nil;
+	NSManagedObjectContext *targetContext = [self targetContextWithStore: &targetStore];
+	
+	assertThatUnsignedInteger([_journal replayChangesFromStoreAtURL: _sourceURL intoStore: targetStore pageSize: 2 error: NULL], equalToUnsignedInteger(3));
+	assertThatUnsignedInteger(_journal.changeCount, equalToUnsignedInteger(0));
+	
+	// A journal reopened from disk has nothing left either
+	AZCoreRecordChangeJournal *reopened = [[AZCoreRecordChangeJournal alloc] initWithURL: _journal.URL];
+	assertThatUnsignedInteger([reopened replayChangesFromStoreAtURL: _sourceURL intoStore: targetStore pageSize: 2 error: NULL], equalToUnsignedInteger(0));
+	assertThatUnsignedInteger([self objectsOfEntity: @"SingleEntityWithNoRelationships" inContext: targetContext].count, equalToUnsignedInteger(3));
+}
+
+@end
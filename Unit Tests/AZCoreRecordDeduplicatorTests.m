@@ -0,0 +1,135 @@
+//
+//  AZCoreRecordDeduplicatorTests.m
+//  AZCoreRecord Unit Tests
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordDeduplicatorTests.h"
+#import "AZCoreRecordDeduplicator.h"
+#import "AZCoreRecordManager.h"
+
+@implementation AZCoreRecordDeduplicatorTests {
+	AZCoreRecordManager *_localManager;
+	NSManagedObjectContext *_context;
+}
+
+- (void) setUp
+{
+	// Grouped fetches need a SQLite store
+	_localManager = [[AZCoreRecordManager alloc] initWithStackName: [[NSProcessInfo processInfo] globallyUniqueString]];
+	_localManager.deduplicator.enabled = YES;
+	
+	_context = [[NSManagedObjectContext alloc] initWithConcurrencyType: NSConfinementConcurrencyType];
+	_context.persistentStoreCoordinator = _localManager.persistentStoreCoordinator;
+}
+
+- (void) tearDown
+{
+	NSURL *storeDirectory = _localManager.localStoreURL.URLByDeletingLastPathComponent;
+	_context = nil;
+	_localManager = nil;
+	[[NSFileManager defaultManager] removeItemAtURL: storeDirectory error: NULL];
+}
+
+- (void) insertMappedEntityWithID: (NSInteger) primaryValue sample: (NSString *) sample
+{
+	NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName: @"MappedEntity" inManagedObjectContext: _context];
+	[object setValue: [NSNumber numberWithInteger: primaryValue] forKey: @"mappedEntityID"];
+	[object setValue: sample forKey: @"sampleAttribute"];
+	
+	// One save each, so the objects are numbered in this order
+	[_context save: NULL];
+}
+
+- (NSArray *) samplesForMappedEntityWithID: (NSInteger) primaryValue
+{
+	[_context reset];
+	
+	NSFetchRequest *request = [NSFetchRequest fetchRequestWithEntityName: @"MappedEntity"];
+	request.predicate = [NSPredicate predicateWithFormat: @"mappedEntityID == %ld", (long) primaryValue];
+	
+	return [[_context executeFetchRequest: request error: NULL] valueForKey: @"sampleAttribute"];
+}
+
+- (void) testSeedingNotificationTriggersDeduplication
+{
+	[self prepare];
+	
+	[self insertMappedEntityWithID: 1 sample: @"first"];
+	[self insertMappedEntityWithID: 1 sample: @"second"];
+	[self insertMappedEntityWithID: 2 sample: @"other"];
+	
+	__block NSDictionary *report = nil;
+	id observer = [[NSNotificationCenter defaultCenter] addObserverForName: AZCoreRecordManagerDidDeduplicateNotification object: _localManager queue: [NSOperationQueue mainQueue] usingBlock: ^(NSNotification *note) {
+		report = note.userInfo;
+		[self notify: kGHUnitWaitStatusSuccess forSelector: @selector(testSeedingNotificationTriggersDeduplication)];
+	}];
+	
+	NSDictionary *userInfo = [NSDictionary dictionaryWithObject: [NSSet setWithObject: @"MappedEntity"] forKey: AZCoreRecordDeduplicationEntityNamesKey];
+	[[NSNotificationCenter defaultCenter] postNotificationName: AZCoreRecordDidFinishSeedingPersistentStoreNotification object: _localManager.persistentStoreCoordinator userInfo: userInfo];
+	
+	[self waitForStatus: kGHUnitWaitStatusSuccess timeout: 5.0];
+	[[NSNotificationCenter defaultCenter] removeObserver: observer];
+	
+	assertThatUnsignedInteger([[report objectForKey: AZCoreRecordDeduplicationDeletedCountKey] unsignedIntegerValue], equalToUnsignedInteger(1));
+	assertThatUnsignedInteger([self samplesForMappedEntityWithID: 1].count, equalToUnsignedInteger(1));
+	assertThatUnsignedInteger([self samplesForMappedEntityWithID: 2].count, equalToUnsignedInteger(1));
+}
+
+- (void) testKeepOldestPolicyKeepsFirstInserted
+{
+	[self prepare];
+	
+	[self insertMappedEntityWithID: 1 sample: @"first"];
+	[self insertMappedEntityWithID: 1 sample: @"second"];
+	[self insertMappedEntityWithID: 1 sample: @"third"];
+	
+	_localManager.deduplicator.policy = AZCoreRecordDeduplicationKeepOldest;
+	[_localManager.deduplicator deduplicateEntitiesNamed: nil completion: ^(NSDictionary *report) {
+		[self notify: kGHUnitWaitStatusSuccess forSelector: @selector(testKeepOldestPolicyKeepsFirstInserted)];
+	}];
+	
+	[self waitForStatus: kGHUnitWaitStatusSuccess timeout: 5.0];
+	assertThat([self samplesForMappedEntityWithID: 1], is(equalTo([NSArray arrayWithObject: @"first"])));
+}
+
+- (void) testKeepNewestPolicyKeepsLastInserted
+{
+	[self prepare];
+	
+	[self insertMappedEntityWithID: 1 sample: @"first"];
+	[self insertMappedEntityWithID: 1 sample: @"second"];
+	[self insertMappedEntityWithID: 1 sample: @"third"];
+	
+	_localManager.deduplicator.policy = AZCoreRecordDeduplicationKeepNewest;
+	[_localManager.deduplicator deduplicateEntitiesNamed: nil completion: ^(NSDictionary *report) {
+		[self notify: kGHUnitWaitStatusSuccess forSelector: @selector(testKeepNewestPolicyKeepsLastInserted)];
+	}];
+	
+	[self waitForStatus: kGHUnitWaitStatusSuccess timeout: 5.0];
+	assertThat([self samplesForMappedEntityWithID: 1], is(equalTo([NSArray arrayWithObject: @"third"])));
+}
+
+- (void) testWinnerBlockChoosesSurvivor
+{
+	[self prepare];
+	
+	[self insertMappedEntityWithID: 1 sample: @"first"];
+	[self insertMappedEntityWithID: 1 sample: @"keep"];
+	[self insertMappedEntityWithID: 1 sample: @"third"];
+	
+	_localManager.deduplicator.winnerBlock = ^NSManagedObject *(NSString *entityName, NSArray *duplicates) {
+		NSUInteger idx = [[duplicates valueForKey: @"sampleAttribute"] indexOfObject: @"keep"];
+		return idx == NSNotFound ? nil : [duplicates objectAtIndex: idx];
+	};
+	[_localManager.deduplicator deduplicateEntitiesNamed: [NSSet setWithObject: @"MappedEntity"] completion: ^(NSDictionary *report) {
+		[self notify: kGHUnitWaitStatusSuccess forSelector: @selector(testWinnerBlockChoosesSurvivor)];
+	}];
+	
+	[self waitForStatus: kGHUnitWaitStatusSuccess timeout: 5.0];
+	assertThat([self samplesForMappedEntityWithID: 1], is(equalTo([NSArray arrayWithObject: @"keep"])));
+}
+
+@end
@@ -0,0 +1,109 @@
+//
+//  AZCoreRecordDeviceRegistryTests.m
+//  AZCoreRecord Unit Tests
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordDeviceRegistryTests.h"
+#import "AZCoreRecordDeviceRegistry.h"
+
+@implementation AZCoreRecordDeviceRegistryTests {
+	NSURL *_directoryURL;
+	AZCoreRecordDeviceRegistry *_registry;
+}
+
+- (void) setUp
+{
+	NSString *directoryName = [[NSProcessInfo processInfo] globallyUniqueString];
+	_directoryURL = [NSURL fileURLWithPath: [NSTemporaryDirectory() stringByAppendingPathComponent: directoryName] isDirectory: YES];
+	_registry = [[AZCoreRecordDeviceRegistry alloc] initWithDirectoryURL: _directoryURL filePresenter: nil];
+}
+
+- (void) tearDown
+{
+	[[NSFileManager defaultManager] removeItemAtURL: _directoryURL error: NULL];
+	_registry = nil;
+}
+
+- (void) testRegisteringWritesOneRecordPerDevice
+{
+	assertThatBool([_registry containsDevice: @"DeviceA"], equalToBool(NO));
+	assertThatBool([_registry registerDevice: @"DeviceA" error: NULL], equalToBool(YES));
+	assertThatBool([_registry registerDevice: @"DeviceB" error: NULL], equalToBool(YES));
+	
+	assertThatBool([_registry containsDevice: @"DeviceA"], equalToBool(YES));
+	assertThatBool([[NSFileManager defaultManager] fileExistsAtPath: [_registry recordURLForDevice: @"DeviceB"].path], equalToBool(YES));
+}
+
+- (void) testRegisteringAgainLeavesRecordUntouched
+{
+	[_registry registerDevice: @"DeviceA" error: NULL];
+	NSString *path = [_registry recordURLForDevice: @"DeviceA"].path;
+	
+	// Backdate the record so any rewrite would show up without waiting
+	NSDate *pastDate = [NSDate dateWithTimeIntervalSinceReferenceDate: 0];
+	[[NSFileManager defaultManager] setAttributes: [NSDictionary dictionaryWithObject: pastDate forKey: NSFileModificationDate] ofItemAtPath: path error: NULL];
+	
+	[_registry registerDevice: @"DeviceA" error: NULL];
+	NSDate *modificationDate = [[[NSFileManager defaultManager] attributesOfItemAtPath: path error: NULL] fileModificationDate];
+	
+	assertThat(modificationDate, is(equalTo(pastDate)));
+}
+
+- (void) testRefreshReportsOnlyNewDevices
+{
+	AZCoreRecordDeviceRegistry *otherDevice = [[AZCoreRecordDeviceRegistry alloc] initWithDirectoryURL: _directoryURL filePresenter: nil];
+	[otherDevice registerDevice: @"DeviceA" error: NULL];
+	
+	assertThat([_registry refreshKnownDevices], is(equalTo([NSSet setWithObject: @"DeviceA"])));
+	
+	[otherDevice registerDevice: @"DeviceB" error: NULL];
+	
+	assertThat([_registry refreshKnownDevices], is(equalTo([NSSet setWithObject: @"DeviceB"])));
+	assertThat(_registry.knownDevices, is(equalTo([NSSet setWithObjects: @"DeviceA", @"DeviceB", nil])));
+}
+
+- (void) testRefreshImportsLegacyDevicesListOnce
+{
+	NSString *fileName = [_directoryURL.lastPathComponent stringByAppendingPathExtension: @"plist"];
+	NSURL *legacyURL = [_directoryURL.URLByDeletingLastPathComponent URLByAppendingPathComponent: fileName];
+	[[NSArray arrayWithObjects: @"DeviceA", @"DeviceB", nil] writeToURL: legacyURL atomically: YES];
+	
+	assertThat([_registry refreshKnownDevices], is(equalTo([NSSet setWithObjects: @"DeviceA", @"DeviceB", nil])));
+	assertThatBool([_registry containsDevice: @"DeviceB"], equalToBool(YES));
+	
+	// Later additions to the old list are not picked up again
+	[[NSArray arrayWithObjects: @"DeviceA", @"DeviceB", @"DeviceC", nil] writeToURL: legacyURL atomically: YES];
+	
+	assertThat([_registry refreshKnownDevices], is(equalTo([NSSet set])));
+	assertThatBool([_registry containsDevice: @"DeviceC"], equalToBool(NO));
+	
+	[[NSFileManager defaultManager] removeItemAtURL: legacyURL error: NULL];
+}
+
+- (void) testImportGivesLegacyDevicesRecords
+{
+	NSString *fileName = [_directoryURL.lastPathComponent stringByAppendingPathExtension: @"plist"];
+	NSURL *legacyURL = [_directoryURL.URLByDeletingLastPathComponent URLByAppendingPathComponent: fileName];
+	[[NSArray arrayWithObject: @"DeviceA"] writeToURL: legacyURL atomically: YES];
+	
+	// Without a refresh, as the sentinel does before its membership check
+	assertThatBool([_registry containsDevice: @"DeviceA"], equalToBool(NO));
+	[_registry importLegacyDevices];
+	assertThatBool([_registry containsDevice: @"DeviceA"], equalToBool(YES));
+	
+	[[NSFileManager defaultManager] removeItemAtURL: legacyURL error: NULL];
+}
+
+- (void) testRemovedRecordIsNoLongerContained
+{
+	[_registry registerDevice: @"DeviceA" error: NULL];
+	[[NSFileManager defaultManager] removeItemAtURL: _directoryURL error: NULL];
+	
+	assertThatBool([_registry containsDevice: @"DeviceA"], equalToBool(NO));
+	assertThat(_registry.knownDevices, isNot(hasItem(@"DeviceA")));
+}
+
+@end
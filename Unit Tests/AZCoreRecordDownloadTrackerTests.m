@@ -0,0 +1,110 @@
+//
+//  AZCoreRecordDownloadTrackerTests.m
+//  AZCoreRecord Unit Tests
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordDownloadTrackerTests.h"
+#import "AZCoreRecordDownloadTracker.h"
+#import "AZCoreRecordManager.h"
+
+@implementation AZCoreRecordDownloadTrackerTests {
+	NSURL *_directoryURL;
+	AZCoreRecordDownloadTracker *_tracker;
+}
+
+- (void) setUp
+{
+	NSString *directoryName = [[NSProcessInfo processInfo] globallyUniqueString];
+	_directoryURL = [NSURL fileURLWithPath: [NSTemporaryDirectory() stringByAppendingPathComponent: directoryName] isDirectory: YES];
+	[[NSFileManager defaultManager] createDirectoryAtURL: _directoryURL withIntermediateDirectories: YES attributes: nil error: NULL];
+	
+	// A plain local directory stands in for the ubiquity container
+	_tracker = [AZCoreRecordDownloadTracker new];
+	_tracker.usesUbiquitousItemState = NO;
+}
+
+- (void) tearDown
+{
+	[[NSFileManager defaultManager] removeItemAtURL: _directoryURL error: NULL];
+	_tracker = nil;
+}
+
+- (void) testCompletesWhenItemAppears
+{
+	[self prepare];
+	
+	NSURL *itemURL = [_directoryURL URLByAppendingPathComponent: @"Item"];
+	__block BOOL succeeded = NO;
+	
+	[_tracker waitForItemAtURL: itemURL completion: ^(BOOL success, NSError *error) {
+		succeeded = success;
+		[self notify: kGHUnitWaitStatusSuccess forSelector: @selector(testCompletesWhenItemAppears)];
+	}];
+	
+	assertThatUnsignedInteger(_tracker.pendingItemCount, equalToUnsignedInteger(1));
+	[[NSData data] writeToURL: itemURL atomically: YES];
+	
+	[self waitForStatus: kGHUnitWaitStatusSuccess timeout: 3.0];
+	assertThatBool(succeeded, equalToBool(YES));
+	assertThatUnsignedInteger(_tracker.pendingItemCount, equalToUnsignedInteger(0));
+}
+
+- (void) testDefaultTimeoutIsFinite
+{
+	assertThatDouble(_tracker.timeout, equalToDouble(600.0));
+}
+
+- (void) testTimesOutWhenItemNeverAppears
+{
+	[self prepare];
+	
+	_tracker.timeout = 0.3;
+	NSURL *itemURL = [_directoryURL URLByAppendingPathComponent: @"Missing"];
+	__block BOOL succeeded = YES;
+	__block NSError *waitError = nil;
+	
+	[_tracker waitForItemAtURL: itemURL completion: ^(BOOL success, NSError *error) {
+		succeeded = success;
+		waitError = error;
+		[self notify: kGHUnitWaitStatusSuccess forSelector: @selector(testTimesOutWhenItemNeverAppears)];
+	}];
+	
+	[self waitForStatus: kGHUnitWaitStatusSuccess timeout: 3.0];
+	assertThatBool(succeeded, equalToBool(NO));
+	assertThat(waitError.domain, is(equalTo(AZCoreRecordErrorDomain)));
+	assertThatInteger(waitError.code, equalToInteger(AZCoreRecordTimedOutError));
+}
+
+- (void) testFollowsItemMovedByCoordinatedWrite
+{
+	[self prepare];
+	
+	NSURL *itemURL = [_directoryURL URLByAppendingPathComponent: @"Item"];
+	NSURL *movedDirectoryURL = [_directoryURL URLByAppendingPathComponent: @"Moved" isDirectory: YES];
+	NSURL *movedURL = [movedDirectoryURL URLByAppendingPathComponent: @"Item"];
+	[[NSFileManager defaultManager] createDirectoryAtURL: movedDirectoryURL withIntermediateDirectories: YES attributes: nil error: NULL];
+	__block BOOL succeeded = NO;
+	
+	[_tracker waitForItemAtURL: itemURL completion: ^(BOOL success, NSError *error) {
+		succeeded = success;
+		[self notify: kGHUnitWaitStatusSuccess forSelector: @selector(testFollowsItemMovedByCoordinatedWrite)];
+	}];
+	
+	// Let the tracker register its presenter before announcing the move
+	assertThatUnsignedInteger(_tracker.pendingItemCount, equalToUnsignedInteger(1));
+	
+	NSFileCoordinator *coordinator = [[NSFileCoordinator alloc] initWithFilePresenter: nil];
+	[coordinator coordinateWritingItemAtURL: itemURL options: NSFileCoordinatorWritingForMoving writingItemAtURL: movedURL options: NSFileCoordinatorWritingForReplacing error: NULL byAccessor: ^(NSURL *oldURL, NSURL *newURL) {
+		[[NSData data] writeToURL: newURL atomically: YES];
+		[coordinator itemAtURL: oldURL didMoveToURL: newURL];
+	}];
+	
+	[self waitForStatus: kGHUnitWaitStatusSuccess timeout: 3.0];
+	assertThatBool(succeeded, equalToBool(YES));
+	assertThatUnsignedInteger(_tracker.pendingItemCount, equalToUnsignedInteger(0));
+}
+
+@end
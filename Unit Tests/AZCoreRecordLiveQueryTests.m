@@ -0,0 +1,195 @@
+//
+//  AZCoreRecordLiveQueryTests.m
+//  AZCoreRecord Unit Tests
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordLiveQueryTests.h"
+#import "AZCoreRecordLiveQuery.h"
+#import "NSManagedObjectModel+AZCoreRecord.h"
+#import "NSPersistentStoreCoordinator+AZCoreRecord.h"
+
+@implementation AZCoreRecordLiveQueryTests {
+	NSURL *_directoryURL;
+	NSManagedObjectContext *_context;
+	NSManagedObject *_first;
+	NSManagedObject *_second;
+	NSManagedObject *_third;
+	AZCoreRecordLiveQuery *_query;
+}
+
+- (NSManagedObject *) insertObjectWithValue: (NSInteger) value
+{
+	NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName: @"SingleEntityWithNoRelationships" inManagedObjectContext: _context];
+	[object setValue: [NSNumber numberWithInteger: value] forKey: @"int16TestAttribute"];
+	return object;
+}
+
+- (void) setUp
+{
+	// The query fetches dictionaries of object IDs, so use a real store
+	NSString *directoryName = [[NSProcessInfo processInfo] globallyUniqueString];
+	_directoryURL = [NSURL fileURLWithPath: [NSTemporaryDirectory() stringByAppendingPathComponent: directoryName] isDirectory: YES];
+	[[NSFileManager defaultManager] createDirectoryAtURL: _directoryURL withIntermediateDirectories: YES attributes: nil error: NULL];
+	
+	NSManagedObjectModel *model = [NSManagedObjectModel modelWithName: @"TestModel.momd"];
+	NSPersistentStoreCoordinator *coordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: model];
+	[coordinator addStoreAtURL: [_directoryURL URLByAppendingPathComponent: @"LiveQuery.sqlite"] configuration: nil options: nil];
+	
+	_context = [NSManagedObjectContext new];
+	_context.persistentStoreCoordinator = coordinator;
+	
+	_first = [self insertObjectWithValue: 10];
+	_second = [self insertObjectWithValue: 20];
+	_third = [self insertObjectWithValue: 30];
+	[_context save: NULL];
+	
+	NSFetchRequest *request = [NSFetchRequest fetchRequestWithEntityName: @"SingleEntityWithNoRelationships"];
+	request.sortDescriptors = [NSArray arrayWithObject: [NSSortDescriptor sortDescriptorWithKey: @"int16TestAttribute" ascending: YES]];
+	_query = [AZCoreRecordLiveQuery liveQueryForRequest: request inContext: _context];
+}
+
+- (void) tearDown
+{
+	[_query stop];
+	_query = nil;
+	_first = _second = _third = nil;
+	_context = nil;
+	[[NSFileManager defaultManager] removeItemAtURL: _directoryURL error: NULL];
+}
+
+- (NSDictionary *) changesAfterSavingForSelector: (SEL) selector
+{
+	__block NSDictionary *delivered = nil;
+	
+	[self prepare];
+	
+	_query.changeBlock = ^(AZCoreRecordLiveQuery *query, NSDictionary *changes) {
+		delivered = changes;
+		[self notify: kGHUnitWaitStatusSuccess forSelector: selector];
+	};
+	
+	[_context save: NULL];
+	
+	[self waitForStatus: kGHUnitWaitStatusSuccess timeout: 3.0];
+	
+	_query.changeBlock = nil;
+	
+	// The published list is the one the indexes refer to
+	assertThat([delivered objectForKey: AZCoreRecordLiveQueryObjectIDsKey], is(equalTo(_query.objectIDs)));
+	
+	return delivered;
+}
+
+- (void) testInitialFetchIsSorted
+{
+	NSArray *expected = [NSArray arrayWithObjects: _first.objectID, _second.objectID, _third.objectID, nil];
+	assertThat(_query.objectIDs, is(equalTo(expected)));
+}
+
+- (void) testInsertsAreReportedAtTheirNewIndexes
+{
+	NSManagedObject *early = [self insertObjectWithValue: 15];
+	NSManagedObject *late = [self insertObjectWithValue: 40];
+	
+	NSDictionary *changes = [self changesAfterSavingForSelector: _cmd];
+	NSArray *objectIDs = [changes objectForKey: AZCoreRecordLiveQueryObjectIDsKey];
+	NSIndexSet *inserted = [changes objectForKey: AZCoreRecordLiveQueryInsertedIndexesKey];
+	
+	NSMutableIndexSet *expected = [NSMutableIndexSet indexSetWithIndex: 1];
+	[expected addIndex: 4];
+	
+	assertThat(inserted, is(equalTo(expected)));
+	assertThat([NSSet setWithArray: [objectIDs objectsAtIndexes: inserted]], is(equalTo([NSSet setWithObjects: early.objectID, late.objectID, nil])));
+	assertThatUnsignedInteger([[changes objectForKey: AZCoreRecordLiveQueryDeletedIndexesKey] count], equalToUnsignedInteger(0));
+	assertThatUnsignedInteger([[changes objectForKey: AZCoreRecordLiveQueryUpdatedIndexesKey] count], equalToUnsignedInteger(0));
+	
+	NSArray *expectedIDs = [NSArray arrayWithObjects: _first.objectID, early.objectID, _second.objectID, _third.objectID, late.objectID, nil];
+	assertThat(objectIDs, is(equalTo(expectedIDs)));
+}
+
+- (void) testUpdateThatChangesSortPositionIsReportedAsMove
+{
+	NSArray *previous = _query.objectIDs;
+	
+	[_first setValue: [NSNumber numberWithInteger: 25] forKey: @"int16TestAttribute"];
+	
+	NSDictionary *changes = [self changesAfterSavingForSelector: _cmd];
+	NSArray *objectIDs = [changes objectForKey: AZCoreRecordLiveQueryObjectIDsKey];
+	NSIndexSet *deleted = [changes objectForKey: AZCoreRecordLiveQueryDeletedIndexesKey];
+	NSIndexSet *inserted = [changes objectForKey: AZCoreRecordLiveQueryInsertedIndexesKey];
+	
+	// Deleted from where it was, inserted where it now sorts
+	assertThat(deleted, is(equalTo([NSIndexSet indexSetWithIndex: 0])));
+	assertThat([previous objectAtIndex: deleted.firstIndex], is(equalTo(_first.objectID)));
+	assertThat(inserted, is(equalTo([NSIndexSet indexSetWithIndex: 1])));
+	assertThat([objectIDs objectAtIndex: inserted.firstIndex], is(equalTo(_first.objectID)));
+	assertThatUnsignedInteger([[changes objectForKey: AZCoreRecordLiveQueryUpdatedIndexesKey] count], equalToUnsignedInteger(0));
+	
+	NSArray *expectedIDs = [NSArray arrayWithObjects: _second.objectID, _first.objectID, _third.objectID, nil];
+	assertThat(objectIDs, is(equalTo(expectedIDs)));
+}
+
+- (void) testUpdateInPlaceIsReportedAsUpdate
+{
+	[_second setValue: @"changed" forKey: @"notInJsonAttribute"];
+	
+	NSDictionary *changes = [self changesAfterSavingForSelector: _cmd];
+	NSArray *objectIDs = [changes objectForKey: AZCoreRecordLiveQueryObjectIDsKey];
+	NSIndexSet *updated = [changes objectForKey: AZCoreRecordLiveQueryUpdatedIndexesKey];
+	
+	assertThat(updated, is(equalTo([NSIndexSet indexSetWithIndex: 1])));
+	assertThat([objectIDs objectAtIndex: updated.firstIndex], is(equalTo(_second.objectID)));
+	assertThatUnsignedInteger([[changes objectForKey: AZCoreRecordLiveQueryInsertedIndexesKey] count], equalToUnsignedInteger(0));
+	assertThatUnsignedInteger([[changes objectForKey: AZCoreRecordLiveQueryDeletedIndexesKey] count], equalToUnsignedInteger(0));
+}
+
+- (void) testDeletesAreReportedAgainstPreviousList
+{
+	NSArray *previous = _query.objectIDs;
+	NSManagedObjectID *firstID = _first.objectID;
+	NSManagedObjectID *thirdID = _third.objectID;
+	
+	[_context deleteObject: _first];
+	[_context deleteObject: _third];
+	
+	NSDictionary *changes = [self changesAfterSavingForSelector: _cmd];
+	NSIndexSet *deleted = [changes objectForKey: AZCoreRecordLiveQueryDeletedIndexesKey];
+	
+	NSMutableIndexSet *expected = [NSMutableIndexSet indexSetWithIndex: 0];
+	[expected addIndex: 2];
+	
+	assertThat(deleted, is(equalTo(expected)));
+	assertThat([NSSet setWithArray: [previous objectsAtIndexes: deleted]], is(equalTo([NSSet setWithObjects: firstID, thirdID, nil])));
+	assertThatUnsignedInteger([[changes objectForKey: AZCoreRecordLiveQueryInsertedIndexesKey] count], equalToUnsignedInteger(0));
+	assertThat([changes objectForKey: AZCoreRecordLiveQueryObjectIDsKey], is(equalTo([NSArray arrayWithObject: _second.objectID])));
+}
+
+- (void) testTiesAreOrderedByObjectID
+{
+	// Enough rows that the store's primary keys reach two digits
+	NSMutableArray *tied = [NSMutableArray arrayWithObject: _second];
+	for (NSUInteger i = 0; i < 12; i++)
+		[tied addObject: [self insertObjectWithValue: 20]];
+	
+	NSDictionary *changes = [self changesAfterSavingForSelector: _cmd];
+	NSArray *objectIDs = [changes objectForKey: AZCoreRecordLiveQueryObjectIDsKey];
+	
+	NSArray *expectedTies = [[tied valueForKey: @"objectID"] sortedArrayUsingComparator: ^NSComparisonResult(NSManagedObjectID *a, NSManagedObjectID *b) {
+		return [a.URIRepresentation.absoluteString compare: b.URIRepresentation.absoluteString options: NSNumericSearch];
+	}];
+	
+	NSRange tiedRange = NSMakeRange(1, tied.count);
+	assertThat([objectIDs subarrayWithRange: tiedRange], is(equalTo(expectedTies)));
+	assertThat([objectIDs objectAtIndex: 0], is(equalTo(_first.objectID)));
+	assertThat(objectIDs.lastObject, is(equalTo(_third.objectID)));
+	
+	// Every new row is reported where it landed among the ties
+	NSMutableIndexSet *expectedInserted = [NSMutableIndexSet indexSetWithIndexesInRange: tiedRange];
+	[expectedInserted removeIndex: [objectIDs indexOfObject: _second.objectID]];
+	assertThat([changes objectForKey: AZCoreRecordLiveQueryInsertedIndexesKey], is(equalTo(expectedInserted)));
+}
+
+@end
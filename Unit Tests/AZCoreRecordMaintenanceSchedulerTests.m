@@ -0,0 +1,101 @@
+//
+//  AZCoreRecordMaintenanceSchedulerTests.m
+//  AZCoreRecord Unit Tests
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordMaintenanceSchedulerTests.h"
+#import "AZCoreRecordManager.h"
+#import "AZCoreRecordMaintenanceScheduler.h"
+
+@implementation AZCoreRecordMaintenanceSchedulerTests {
+	NSMutableArray *_managers;
+}
+
+- (void) setUp
+{
+	_managers = [NSMutableArray array];
+}
+
+- (void) tearDown
+{
+	for (AZCoreRecordManager *manager in _managers)
+	{
+		manager.maintenanceScheduler.enabled = NO;
+		[[NSFileManager defaultManager] removeItemAtURL: [manager.localStoreURL URLByDeletingLastPathComponent] error: NULL];
+	}
+	
+	_managers = nil;
+	[[NSUserDefaults standardUserDefaults] removeObjectForKey: @"AZCoreRecordMaintenanceHistory"];
+}
+
+- (AZCoreRecordManager *) manager
+{
+	AZCoreRecordManager *manager = [[AZCoreRecordManager alloc] initWithStackName: [[NSProcessInfo processInfo] globallyUniqueString]];
+	manager.stackModelName = @"TestModel.momd";
+	manager.stackShouldUseInMemoryStore = YES;
+	[_managers addObject: manager];
+	return manager;
+}
+
+- (void) createFileAtURL: (NSURL *) URL
+{
+	NSFileManager *fileManager = [NSFileManager defaultManager];
+	[fileManager createDirectoryAtURL: [URL URLByDeletingLastPathComponent] withIntermediateDirectories: YES attributes: nil error: NULL];
+	[fileManager createFileAtPath: URL.path contents: [NSData data] attributes: nil];
+}
+
+- (BOOL) vacuumsWhenAttachingLocalStoreOfManager: (AZCoreRecordManager *) manager
+{
+	NSDictionary *options = [manager.maintenanceScheduler storeOptions: [NSDictionary dictionary] forAttachingStoreAtURL: manager.localStoreURL];
+	return [[options objectForKey: NSSQLiteManualVacuumOption] boolValue];
+}
+
+- (void) testHistoryIsKeptPerStack
+{
+	AZCoreRecordManager *first = [self manager];
+	AZCoreRecordManager *second = [self manager];
+	first.maintenanceScheduler.fullVacuumInterval = 60.0;
+	second.maintenanceScheduler.fullVacuumInterval = 60.0;
+	
+	// Both stacks keep their store at the same relative path
+	assertThat(first.localStoreURL.lastPathComponent, is(equalTo(second.localStoreURL.lastPathComponent)));
+	
+	[self createFileAtURL: first.localStoreURL];
+	[self createFileAtURL: second.localStoreURL];
+	
+	assertThatBool([self vacuumsWhenAttachingLocalStoreOfManager: first], equalToBool(YES));
+	assertThatBool([self vacuumsWhenAttachingLocalStoreOfManager: first], equalToBool(NO));
+	
+	// The first stack's vacuum doesn't make the second one's look recent
+	assertThatBool([self vacuumsWhenAttachingLocalStoreOfManager: second], equalToBool(YES));
+}
+
+- (void) testSavesElsewhereDoNotBuildTheStack
+{
+	AZCoreRecordManager *manager = [self manager];
+	manager.maintenanceScheduler.enabled = YES;
+	
+	__block NSUInteger loadCount = 0;
+	id observer = [[NSNotificationCenter defaultCenter] addObserverForName: AZCoreRecordManagerDidFinishAdddingPersistentStoresNotification object: manager queue: nil usingBlock: ^(NSNotification *note) {
+		loadCount++;
+	}];
+	
+	NSPersistentStoreCoordinator *coordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: [NSManagedObjectModel modelWithName: @"TestModel.momd"]];
+	[coordinator addPersistentStoreWithType: NSInMemoryStoreType configuration: nil URL: nil options: nil error: NULL];
+	
+	NSManagedObjectContext *context = [NSManagedObjectContext new];
+	context.persistentStoreCoordinator = coordinator;
+	[NSEntityDescription insertNewObjectForEntityForName: @"SingleEntityWithNoRelationships" inManagedObjectContext: context];
+	assertThatBool([context save: NULL], equalToBool(YES));
+	
+	[[NSRunLoop currentRunLoop] runUntilDate: [NSDate dateWithTimeIntervalSinceNow: 0.2]];
+	[[NSNotificationCenter defaultCenter] removeObserver: observer];
+	
+	assertThatUnsignedInteger(loadCount, equalToUnsignedInteger(0));
+	assertThatBool(manager.isStackReady, equalToBool(NO));
+}
+
+@end
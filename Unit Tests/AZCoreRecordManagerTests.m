@@ -0,0 +1,344 @@
+//
+//  AZCoreRecordManagerTests.m
+//  AZCoreRecord Unit Tests
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordManagerTests.h"
+#import "AZCoreRecordManager.h"
+#import "AZCoreRecordStoreShard.h"
+#import "AZCoreRecordUbiquitySentinel.h"
+
+@implementation AZCoreRecordManagerTests {
+	AZCoreRecordManager *_manager;
+}
+
+- (void) setUp
+{
+	_manager = [[AZCoreRecordManager alloc] initWithStackName: [[NSProcessInfo processInfo] globallyUniqueString]];
+	_manager.stackModelName = @"TestModel.momd";
+	_manager.stackShouldUseInMemoryStore = YES;
+	
+	// Thread contexts are children of the main context; build it here
+	[_manager managedObjectContext];
+}
+
+- (void) tearDown
+{
+	_manager.threadContextIdleInterval = 0;
+	_manager = nil;
+}
+
+#pragma mark - Thread context memory
+
+- (NSManagedObjectContext *) threadContextWithSavedObject: (NSManagedObject **) outSaved pendingObject: (NSManagedObject **) outPending forSelector: (SEL) selector
+{
+	__block NSManagedObjectContext *threadContext = nil;
+	__block NSManagedObject *saved = nil;
+	__block NSManagedObject *pending = nil;
+	
+	[self prepare];
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		NSManagedObjectContext *context = [_manager contextForCurrentThread];
+		[context performBlockAndWait: ^{
+			saved = [NSEntityDescription insertNewObjectForEntityForName: @"SingleEntityWithNoRelationships" inManagedObjectContext: context];
+			[context save: NULL];
+			
+			if (outPending)
+				pending = [NSEntityDescription insertNewObjectForEntityForName: @"SingleEntityWithNoRelationships" inManagedObjectContext: context];
+		}];
+		
+		threadContext = context;
+		[self notify: kGHUnitWaitStatusSuccess forSelector: selector];
+	});
+	
+	[self waitForStatus: kGHUnitWaitStatusSuccess timeout: 3.0];
+	
+	if (outSaved)
+		*outSaved = saved;
+	if (outPending)
+		*outPending = pending;
+	return threadContext;
+}
+
+- (void) testIdleThreadContextIsResetWithoutItsThread
+{
+	_manager.threadContextIdleInterval = 0.2;
+	
+	NSManagedObjectContext *threadContext = [self threadContextWithSavedObject: NULL pendingObject: NULL forSelector: _cmd];
+	assertThat(threadContext, is(notNilValue()));
+	
+	// Its thread never asks for it again; the sweep has to get to it anyway
+	__block NSUInteger registeredCount = NSNotFound;
+	NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow: 3.0];
+	do
+	{
+		[[NSRunLoop currentRunLoop] runUntilDate: [NSDate dateWithTimeIntervalSinceNow: 0.05]];
+		[threadContext performBlockAndWait: ^{
+			registeredCount = threadContext.registeredObjects.count;
+		}];
+	}
+	while (registeredCount && deadline.timeIntervalSinceNow > 0);
+	
+	assertThatUnsignedInteger(registeredCount, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(_manager.reclaimedObjectCount, isNot(equalToUnsignedInteger(0)));
+}
+
+- (void) testMemoryPressureFaultsUnchangedObjects
+{
+	NSManagedObject *saved = nil;
+	NSManagedObject *pending = nil;
+	NSManagedObjectContext *threadContext = [self threadContextWithSavedObject: &saved pendingObject: &pending forSelector: _cmd];
+	
+	[_manager reclaimThreadContextMemory];
+	
+	// Queued behind the reclaim on the context's own queue
+	__block BOOL savedIsFault = NO, pendingIsFault = YES, pendingIsInserted = NO;
+	[threadContext performBlockAndWait: ^{
+		savedIsFault = saved.isFault;
+		pendingIsFault = pending.isFault;
+		pendingIsInserted = pending.isInserted;
+	}];
+	
+	assertThatBool(savedIsFault, equalToBool(YES));
+	assertThatBool(pendingIsFault, equalToBool(NO));
+	assertThatBool(pendingIsInserted, equalToBool(YES));
+	assertThatUnsignedInteger(_manager.reclaimedObjectCount, equalToUnsignedInteger(1));
+}
+
+#pragma mark - Store shards
+
+- (AZCoreRecordManager *) shardedManager
+{
+	// Local, synced and sharded entities, each in its own configuration
+	NSManagedObjectModel *model = [NSManagedObjectModel new];
+	NSMutableDictionary *entities = [NSMutableDictionary dictionary];
+	for (NSString *name in [NSArray arrayWithObjects: @"Note", @"Item", @"Event", nil])
+	{
+		NSAttributeDescription *title = [NSAttributeDescription new];
+		title.name = @"title";
+		title.attributeType = NSStringAttributeType;
+		title.optional = YES;
+		
+		NSEntityDescription *entity = [NSEntityDescription new];
+		entity.name = name;
+		entity.managedObjectClassName = NSStringFromClass([NSManagedObject class]);
+		entity.properties = [NSArray arrayWithObject: title];
+		[entities setObject: entity forKey: name];
+	}
+	
+	model.entities = entities.allValues;
+	[model setEntities: [NSArray arrayWithObject: [entities objectForKey: @"Note"]] forConfiguration: @"Local"];
+	[model setEntities: [NSArray arrayWithObject: [entities objectForKey: @"Item"]] forConfiguration: @"Synced"];
+	[model setEntities: [NSArray arrayWithObject: [entities objectForKey: @"Event"]] forConfiguration: @"Events"];
+	
+	NSString *modelPath = [NSTemporaryDirectory() stringByAppendingPathComponent: [[[NSProcessInfo processInfo] globallyUniqueString] stringByAppendingPathExtension: @"mom"]];
+	[NSKeyedArchiver archiveRootObject: model toFile: modelPath];
+	
+	AZCoreRecordManager *manager = [[AZCoreRecordManager alloc] initWithStackName: [[NSProcessInfo processInfo] globallyUniqueString]];
+	manager.stackModelURL = [NSURL fileURLWithPath: modelPath];
+	manager.stackModelConfigurations = [NSDictionary dictionaryWithObjectsAndKeys: @"Local", AZCoreRecordLocalStoreConfigurationNameKey, @"Synced", AZCoreRecordUbiquitousStoreConfigurationNameKey, nil];
+	return manager;
+}
+
+- (void) removeShardedManager: (AZCoreRecordManager *) manager
+{
+	NSURL *directoryURL = [manager.localStoreURL URLByDeletingLastPathComponent];
+	[[NSFileManager defaultManager] removeItemAtURL: manager.stackModelURL error: NULL];
+	[[NSFileManager defaultManager] removeItemAtURL: directoryURL error: NULL];
+}
+
+- (void) testShardsMayNotReuseStackFilesOrConfigurations
+{
+	AZCoreRecordManager *manager = [self shardedManager];
+	
+	AZCoreRecordStoreShard *localFile = [AZCoreRecordStoreShard shardWithConfiguration: @"Events"];
+	localFile.fileName = manager.localStoreURL.lastPathComponent;
+	
+	AZCoreRecordStoreShard *fallbackFile = [AZCoreRecordStoreShard shardWithConfiguration: @"Events"];
+	fallbackFile.fileName = manager.fallbackStoreURL.lastPathComponent.uppercaseString;
+	
+	AZCoreRecordStoreShard *defaultLocalFile = [AZCoreRecordStoreShard shardWithConfiguration: @"LocalStore"];
+	AZCoreRecordStoreShard *localConfiguration = [AZCoreRecordStoreShard shardWithConfiguration: @"Local"];
+	localConfiguration.fileName = @"Other.sqlite";
+	AZCoreRecordStoreShard *syncedConfiguration = [AZCoreRecordStoreShard shardWithConfiguration: @"Synced"];
+	syncedConfiguration.fileName = @"Other.sqlite";
+	
+	AZCoreRecordStoreShard *events = [AZCoreRecordStoreShard shardWithConfiguration: @"Events"];
+	AZCoreRecordStoreShard *moreEvents = [AZCoreRecordStoreShard shardWithConfiguration: @"Events"];
+	moreEvents.fileName = @"MoreEvents.sqlite";
+	
+	for (AZCoreRecordStoreShard *shard in [NSArray arrayWithObjects: localFile, fallbackFile, defaultLocalFile, localConfiguration, syncedConfiguration, nil])
+	{
+		manager.stackStoreShards = [NSArray arrayWithObject: shard];
+		assertThatUnsignedInteger(manager.stackStoreShards.count, equalToUnsignedInteger(0));
+	}
+	
+	manager.stackStoreShards = [NSArray arrayWithObjects: events, moreEvents, nil];
+	assertThatUnsignedInteger(manager.stackStoreShards.count, equalToUnsignedInteger(0));
+	
+	manager.stackStoreShards = [NSArray arrayWithObject: events];
+	assertThatUnsignedInteger(manager.stackStoreShards.count, equalToUnsignedInteger(1));
+	
+	[self removeShardedManager: manager];
+}
+
+- (void) testShardIsLoadedBesideStackStores
+{
+	AZCoreRecordManager *manager = [self shardedManager];
+	AZCoreRecordStoreShard *shard = [AZCoreRecordStoreShard shardWithConfiguration: @"Events"];
+	manager.stackStoreShards = [NSArray arrayWithObject: shard];
+	
+	NSPersistentStoreCoordinator *coordinator = manager.persistentStoreCoordinator;
+	NSMutableDictionary *configurations = [NSMutableDictionary dictionary];
+	for (NSPersistentStore *store in coordinator.persistentStores)
+		[configurations setObject: store.URL.lastPathComponent forKey: store.configurationName];
+	
+	assertThat([configurations objectForKey: @"Events"], is(equalTo(@"Events.sqlite")));
+	assertThat([configurations objectForKey: @"Local"], is(equalTo(manager.localStoreURL.lastPathComponent)));
+	assertThat([configurations objectForKey: @"Synced"], is(equalTo(manager.fallbackStoreURL.lastPathComponent)));
+	
+	// Each entity is saved into its own file
+	NSManagedObjectContext *context = [NSManagedObjectContext new];
+	context.persistentStoreCoordinator = coordinator;
+	NSManagedObject *event = [NSEntityDescription insertNewObjectForEntityForName: @"Event" inManagedObjectContext: context];
+	assertThatBool([context save: NULL], equalToBool(YES));
+	assertThat(event.objectID.persistentStore.URL.lastPathComponent, is(equalTo(@"Events.sqlite")));
+	
+	[self removeShardedManager: manager];
+}
+
+#pragma mark - Stack replacement
+
+- (void) testOldStackServesWhileRebuiltStackLoads
+{
+	AZCoreRecordManager *manager = [self shardedManager];
+	NSManagedObjectContext *oldContext = manager.managedObjectContext;
+	NSPersistentStoreCoordinator *oldCoordinator = manager.persistentStoreCoordinator;
+	
+	// Once the new coordinator has its stores, but before the swap, save
+	// through the old stack
+	__block BOOL savedDuringRebuild = NO;
+	__block NSUInteger oldStoreCount = 0;
+	NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+	id loadObserver = [nc addObserverForName: AZCoreRecordManagerDidFinishAdddingPersistentStoresNotification object: manager queue: nil usingBlock: ^(NSNotification *note) {
+		[oldContext performBlockAndWait: ^{
+			oldStoreCount = oldCoordinator.persistentStores.count;
+			
+			NSManagedObject *item = [NSEntityDescription insertNewObjectForEntityForName: @"Item" inManagedObjectContext: oldContext];
+			[item setValue: @"Saved during rebuild" forKey: @"title"];
+			savedDuringRebuild = [oldContext save: NULL];
+		}];
+	}];
+	
+	id replaceObserver = [nc addObserverForName: AZCoreRecordManagerDidReplaceStackNotification object: manager queue: nil usingBlock: ^(NSNotification *note) {
+		[self notify: kGHUnitWaitStatusSuccess forSelector: @selector(testOldStackServesWhileRebuiltStackLoads)];
+	}];
+	
+	[self prepare];
+	manager.stackShouldAutoMigrateStore = YES;
+	[self waitForStatus: kGHUnitWaitStatusSuccess timeout: 5.0];
+	
+	[nc removeObserver: loadObserver];
+	[nc removeObserver: replaceObserver];
+	
+	assertThatUnsignedInteger(oldStoreCount, equalToUnsignedInteger(2));
+	assertThatBool(savedDuringRebuild, equalToBool(YES));
+	
+	// Read back through the new stack
+	NSManagedObjectContext *newContext = manager.managedObjectContext;
+	assertThat(newContext, isNot(sameInstance(oldContext)));
+	assertThat(manager.persistentStoreCoordinator, isNot(sameInstance(oldCoordinator)));
+	
+	__block NSUInteger count = 0;
+	[newContext performBlockAndWait: ^{
+		NSFetchRequest *request = [NSFetchRequest fetchRequestWithEntityName: @"Item"];
+		request.predicate = [NSPredicate predicateWithFormat: @"title == %@", @"Saved during rebuild"];
+		count = [newContext countForFetchRequest: request error: NULL];
+	}];
+	assertThatUnsignedInteger(count, equalToUnsignedInteger(1));
+	
+	[self removeShardedManager: manager];
+}
+
+#pragma mark - Synced store reattachment
+
+- (NSPersistentStore *) storeAtURL: (NSURL *) URL inCoordinator: (NSPersistentStoreCoordinator *) coordinator
+{
+	// Temporary directories may be reached through a symlink
+	for (NSPersistentStore *store in coordinator.persistentStores)
+		if ([store.URL.lastPathComponent isEqualToString: URL.lastPathComponent])
+			return store;
+	return nil;
+}
+
+- (void) testIdentityChangeReattachesOnlyTheSyncedStore
+{
+	AZCoreRecordManager *manager = [self shardedManager];
+	NSManagedObjectContext *context = manager.managedObjectContext;
+	NSPersistentStoreCoordinator *coordinator = manager.persistentStoreCoordinator;
+	NSPersistentStore *localStore = [self storeAtURL: manager.localStoreURL inCoordinator: coordinator];
+	NSPersistentStore *syncedStore = [self storeAtURL: manager.fallbackStoreURL inCoordinator: coordinator];
+	
+	__block NSManagedObject *edited = nil;
+	__block NSManagedObject *untouched = nil;
+	[context performBlockAndWait: ^{
+		edited = [NSEntityDescription insertNewObjectForEntityForName: @"Item" inManagedObjectContext: context];
+		untouched = [NSEntityDescription insertNewObjectForEntityForName: @"Item" inManagedObjectContext: context];
+		[NSEntityDescription insertNewObjectForEntityForName: @"Note" inManagedObjectContext: context];
+		[context save: NULL];
+		
+		[edited setValue: @"Edited" forKey: @"title"];
+	}];
+	
+	__block NSError *reportedError = nil;
+	void (^errorHandler)(NSError *) = [AZCoreRecordManager errorHandler];
+	[AZCoreRecordManager setErrorHandler: ^(NSError *error) {
+		if ([error.domain isEqualToString: AZCoreRecordErrorDomain] && error.code == AZCoreRecordUnsavedChangesError)
+			reportedError = error;
+	}];
+	
+	__block NSSet *invalidatedNames = nil;
+	id observer = [[NSNotificationCenter defaultCenter] addObserverForName: AZCoreRecordManagerDidReattachUbiquitousStoreNotification object: manager queue: nil usingBlock: ^(NSNotification *note) {
+		invalidatedNames = [note.userInfo objectForKey: AZCoreRecordInvalidatedEntityNamesKey];
+		[self notify: kGHUnitWaitStatusSuccess forSelector: @selector(testIdentityChangeReattachesOnlyTheSyncedStore)];
+	}];
+	
+	[self prepare];
+	[[NSNotificationCenter defaultCenter] postNotificationName: AZUbiquityIdentityDidChangeNotification object: nil];
+	[self waitForStatus: kGHUnitWaitStatusSuccess timeout: 5.0];
+	
+	// Errors are reported on the main queue
+	[[NSRunLoop currentRunLoop] runUntilDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+	[[NSNotificationCenter defaultCenter] removeObserver: observer];
+	[AZCoreRecordManager setErrorHandler: errorHandler];
+	
+	assertThat(invalidatedNames, is(equalTo([NSSet setWithObject: @"Item"])));
+	assertThat(manager.persistentStoreCoordinator, is(sameInstance(coordinator)));
+	assertThat([self storeAtURL: manager.localStoreURL inCoordinator: coordinator], is(sameInstance(localStore)));
+	
+	NSPersistentStore *reattachedStore = [self storeAtURL: manager.fallbackStoreURL inCoordinator: coordinator];
+	assertThat(reattachedStore, is(notNilValue()));
+	assertThat(reattachedStore, isNot(sameInstance(syncedStore)));
+	
+	// Unchanged objects are dropped; edited ones are kept and reported
+	__block BOOL editedIsUpdated = NO, untouchedIsFault = NO;
+	__block id editedTitle = nil;
+	[context performBlockAndWait: ^{
+		editedIsUpdated = edited.isUpdated;
+		editedTitle = [edited valueForKey: @"title"];
+		untouchedIsFault = untouched.isFault;
+	}];
+	
+	assertThatBool(editedIsUpdated, equalToBool(YES));
+	assertThat(editedTitle, is(equalTo(@"Edited")));
+	assertThatBool(untouchedIsFault, equalToBool(YES));
+	assertThat([reportedError.userInfo objectForKey: NSAffectedObjectsErrorKey], is(equalTo([NSArray arrayWithObject: edited])));
+	
+	[self removeShardedManager: manager];
+}
+
+@end
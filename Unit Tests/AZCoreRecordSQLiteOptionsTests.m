@@ -0,0 +1,86 @@
+//
+//  AZCoreRecordSQLiteOptionsTests.m
+//  AZCoreRecord Unit Tests
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordSQLiteOptionsTests.h"
+#import "AZCoreRecordSQLiteOptions.h"
+#import "AZCoreRecordManager.h"
+
+@implementation AZCoreRecordSQLiteOptionsTests
+
+- (void) testDefaultOptionsProduceNoPragmas
+{
+	AZCoreRecordSQLiteOptions *options = [AZCoreRecordSQLiteOptions new];
+	
+	assertThatBool([options validate: NULL], equalToBool(YES));
+	assertThat(options.pragmas, is(empty()));
+}
+
+- (void) testPragmasMapEveryOption
+{
+	AZCoreRecordSQLiteOptions *options = [AZCoreRecordSQLiteOptions new];
+	options.journalMode = AZCoreRecordSQLiteJournalModeTruncate;
+	options.synchronous = AZCoreRecordSQLiteSynchronousFull;
+	options.autoVacuum = AZCoreRecordSQLiteAutoVacuumIncremental;
+	options.cacheSize = -2048;
+	options.mmapSize = 1048576;
+	
+	NSDictionary *expected = [NSDictionary dictionaryWithObjectsAndKeys:
+							  @"TRUNCATE", @"journal_mode",
+							  @"FULL", @"synchronous",
+							  @"INCREMENTAL", @"auto_vacuum",
+							  @"-2048", @"cache_size",
+							  @"1048576", @"mmap_size", nil];
+	
+	assertThat(options.pragmas, is(equalTo(expected)));
+	assertThat([options copy].pragmas, is(equalTo(expected)));
+}
+
+- (void) testPresetsUseWriteAheadLogging
+{
+	NSDictionary *writeHeavy = [AZCoreRecordSQLiteOptions writeHeavyOptions].pragmas;
+	NSDictionary *readHeavy = [AZCoreRecordSQLiteOptions readHeavyOptions].pragmas;
+	
+	assertThat([writeHeavy objectForKey: @"journal_mode"], is(equalTo(@"WAL")));
+	assertThat([writeHeavy objectForKey: @"synchronous"], is(equalTo(@"NORMAL")));
+	assertThat([writeHeavy objectForKey: @"mmap_size"], is(nilValue()));
+	assertThat([readHeavy objectForKey: @"journal_mode"], is(equalTo(@"WAL")));
+	assertThat([readHeavy objectForKey: @"mmap_size"], is(equalTo(@"67108864")));
+}
+
+- (void) testValidationRejectsUnknownValues
+{
+	AZCoreRecordSQLiteOptions *options = [AZCoreRecordSQLiteOptions new];
+	options.journalMode = AZCoreRecordSQLiteJournalModeWAL + 1;
+	
+	NSError *error = nil;
+	assertThatBool([options validate: &error], equalToBool(NO));
+	assertThat(error.domain, is(equalTo(AZCoreRecordErrorDomain)));
+	assertThatInteger(error.code, equalToInteger(AZCoreRecordInvalidConfigurationError));
+	
+	options.journalMode = AZCoreRecordSQLiteJournalModeDefault;
+	options.synchronous = AZCoreRecordSQLiteSynchronousFull + 1;
+	assertThatBool([options validate: NULL], equalToBool(NO));
+	
+	options.synchronous = AZCoreRecordSQLiteSynchronousDefault;
+	options.autoVacuum = AZCoreRecordSQLiteAutoVacuumIncremental + 1;
+	assertThatBool([options validate: NULL], equalToBool(NO));
+}
+
+- (void) testValidationRejectsUnsafeJournalWithoutSync
+{
+	AZCoreRecordSQLiteOptions *options = [AZCoreRecordSQLiteOptions new];
+	options.journalMode = AZCoreRecordSQLiteJournalModeMemory;
+	options.synchronous = AZCoreRecordSQLiteSynchronousOff;
+	
+	assertThatBool([options validate: NULL], equalToBool(NO));
+	
+	options.synchronous = AZCoreRecordSQLiteSynchronousNormal;
+	assertThatBool([options validate: NULL], equalToBool(YES));
+}
+
+@end
@@ -0,0 +1,160 @@
+//
+//  AZCoreRecordSectionDiffTests.m
+//  AZCoreRecord Unit Tests
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "AZCoreRecordSectionDiffTests.h"
+#import "AZCoreRecordSectionDiff.h"
+
+static NSIndexPath *indexPath(NSUInteger section, NSUInteger row)
+{
+	NSUInteger indexes[2] = { section, row };
+	return [NSIndexPath indexPathWithIndexes: indexes length: 2];
+}
+
+static NSArray *move(NSIndexPath *from, NSIndexPath *to)
+{
+	return [NSArray arrayWithObjects: from, to, nil];
+}
+
+@implementation AZCoreRecordSectionDiffTests
+
+- (void) testReorderedSectionsAreDeletedAndInsertedWithTheirRows
+{
+	NSArray *oldIDs = [NSArray arrayWithObjects: @"a", @"b", @"c", @"d", @"e", nil];
+	NSArray *oldKeys = [NSArray arrayWithObjects: @"A", @"A", @"B", @"B", @"C", nil];
+	NSArray *newIDs = [NSArray arrayWithObjects: @"c", @"d", @"a", @"b", @"e", nil];
+	NSArray *newKeys = [NSArray arrayWithObjects: @"B", @"B", @"A", @"A", @"C", nil];
+	
+	AZCoreRecordSectionDiff *diff = [AZCoreRecordSectionDiff diffFromObjectIDs: oldIDs sectionKeys: oldKeys toObjectIDs: newIDs sectionKeys: newKeys updatedObjectIDs: [NSSet setWithObject: @"e"]];
+	
+	// B and C keep their relative order, so only A changes places
+	assertThat(diff.deletedSections, is(equalTo([NSIndexSet indexSetWithIndex: 0])));
+	assertThat(diff.insertedSections, is(equalTo([NSIndexSet indexSetWithIndex: 1])));
+	assertThatUnsignedInteger(diff.deletedIndexPaths.count, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(diff.insertedIndexPaths.count, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(diff.movedIndexPaths.count, equalToUnsignedInteger(0));
+	
+	// Updates refer to the old snapshot
+	assertThat(diff.updatedIndexPaths, is(equalTo([NSArray arrayWithObject: indexPath(2, 0)])));
+}
+
+- (void) testRowMovingAcrossSections
+{
+	NSArray *oldIDs = [NSArray arrayWithObjects: @"a", @"b", @"c", nil];
+	NSArray *oldKeys = [NSArray arrayWithObjects: @"A", @"A", @"B", nil];
+	NSArray *newIDs = [NSArray arrayWithObjects: @"a", @"c", @"b", nil];
+	NSArray *newKeys = [NSArray arrayWithObjects: @"A", @"B", @"B", nil];
+	
+	AZCoreRecordSectionDiff *diff = [AZCoreRecordSectionDiff diffFromObjectIDs: oldIDs sectionKeys: oldKeys toObjectIDs: newIDs sectionKeys: newKeys updatedObjectIDs: [NSSet setWithObject: @"b"]];
+	
+	assertThatUnsignedInteger(diff.deletedSections.count, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(diff.insertedSections.count, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(diff.deletedIndexPaths.count, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(diff.insertedIndexPaths.count, equalToUnsignedInteger(0));
+	assertThat(diff.movedIndexPaths, is(equalTo([NSArray arrayWithObject: move(indexPath(0, 1), indexPath(1, 1))])));
+	
+	// Moved rows are left to be reconfigured after the moves
+	assertThatUnsignedInteger(diff.updatedIndexPaths.count, equalToUnsignedInteger(0));
+}
+
+- (void) testOnlyRowsOutsideLongestRunMove
+{
+	NSArray *oldIDs = [NSArray arrayWithObjects: @"a", @"b", @"c", @"d", @"e", nil];
+	NSArray *newIDs = [NSArray arrayWithObjects: @"d", @"a", @"b", @"e", @"c", nil];
+	
+	AZCoreRecordSectionDiff *diff = [AZCoreRecordSectionDiff diffFromObjectIDs: oldIDs sectionKeys: nil toObjectIDs: newIDs sectionKeys: nil updatedObjectIDs: [NSSet setWithObjects: @"a", @"d", nil]];
+	
+	// a, b and c stay in order; d and e are the only moves
+	NSArray *expectedMoves = [NSArray arrayWithObjects: move(indexPath(0, 3), indexPath(0, 0)), move(indexPath(0, 4), indexPath(0, 3)), nil];
+	assertThat(diff.movedIndexPaths, is(equalTo(expectedMoves)));
+	assertThat(diff.updatedIndexPaths, is(equalTo([NSArray arrayWithObject: indexPath(0, 0)])));
+	assertThatUnsignedInteger(diff.deletedIndexPaths.count, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(diff.insertedIndexPaths.count, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(diff.deletedSections.count, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(diff.insertedSections.count, equalToUnsignedInteger(0));
+}
+
+- (void) testInsertsAndDeletesAroundKeptRows
+{
+	NSArray *oldIDs = [NSArray arrayWithObjects: @"a", @"b", @"c", nil];
+	NSArray *newIDs = [NSArray arrayWithObjects: @"x", @"a", @"c", nil];
+	
+	AZCoreRecordSectionDiff *diff = [AZCoreRecordSectionDiff diffFromObjectIDs: oldIDs sectionKeys: nil toObjectIDs: newIDs sectionKeys: nil updatedObjectIDs: nil];
+	
+	assertThat(diff.deletedIndexPaths, is(equalTo([NSArray arrayWithObject: indexPath(0, 1)])));
+	assertThat(diff.insertedIndexPaths, is(equalTo([NSArray arrayWithObject: indexPath(0, 0)])));
+	assertThatUnsignedInteger(diff.movedIndexPaths.count, equalToUnsignedInteger(0));
+}
+
+- (void) testNilSectionKeysMatchNullKeys
+{
+	NSArray *objectIDs = [NSArray arrayWithObjects: @"a", @"b", nil];
+	NSArray *nullKeys = [NSArray arrayWithObjects: [NSNull null], [NSNull null], nil];
+	
+	AZCoreRecordSectionDiff *diff = [AZCoreRecordSectionDiff diffFromObjectIDs: objectIDs sectionKeys: nil toObjectIDs: objectIDs sectionKeys: nullKeys updatedObjectIDs: nil];
+	
+	assertThatBool(diff.isEmpty, equalToBool(YES));
+}
+
+- (void) testEmptySnapshots
+{
+	NSArray *objectIDs = [NSArray arrayWithObjects: @"a", @"b", nil];
+	
+	AZCoreRecordSectionDiff *none = [AZCoreRecordSectionDiff diffFromObjectIDs: [NSArray array] sectionKeys: nil toObjectIDs: [NSArray array] sectionKeys: [NSArray array] updatedObjectIDs: nil];
+	assertThatBool(none.isEmpty, equalToBool(YES));
+	
+	// Rows in a new or removed section go with it
+	AZCoreRecordSectionDiff *filled = [AZCoreRecordSectionDiff diffFromObjectIDs: [NSArray array] sectionKeys: nil toObjectIDs: objectIDs sectionKeys: nil updatedObjectIDs: nil];
+	assertThat(filled.insertedSections, is(equalTo([NSIndexSet indexSetWithIndex: 0])));
+	assertThatUnsignedInteger(filled.deletedSections.count, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(filled.insertedIndexPaths.count, equalToUnsignedInteger(0));
+	
+	AZCoreRecordSectionDiff *emptied = [AZCoreRecordSectionDiff diffFromObjectIDs: objectIDs sectionKeys: nil toObjectIDs: [NSArray array] sectionKeys: nil updatedObjectIDs: nil];
+	assertThat(emptied.deletedSections, is(equalTo([NSIndexSet indexSetWithIndex: 0])));
+	assertThatUnsignedInteger(emptied.insertedSections.count, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(emptied.deletedIndexPaths.count, equalToUnsignedInteger(0));
+}
+
+- (void) testEmptyStringIsItsOwnSectionKey
+{
+	NSArray *objectIDs = [NSArray arrayWithObjects: @"a", @"b", nil];
+	NSArray *oldKeys = [NSArray arrayWithObjects: @"", @"", nil];
+	NSArray *newKeys = [NSArray arrayWithObjects: @"", [NSNull null], nil];
+	
+	AZCoreRecordSectionDiff *diff = [AZCoreRecordSectionDiff diffFromObjectIDs: objectIDs sectionKeys: oldKeys toObjectIDs: objectIDs sectionKeys: newKeys updatedObjectIDs: nil];
+	
+	assertThatUnsignedInteger(diff.deletedSections.count, equalToUnsignedInteger(0));
+	assertThat(diff.insertedSections, is(equalTo([NSIndexSet indexSetWithIndex: 1])));
+	
+	// b lands in the new section, so it's inserted along with it
+	assertThat(diff.deletedIndexPaths, is(equalTo([NSArray arrayWithObject: indexPath(0, 1)])));
+	assertThatUnsignedInteger(diff.insertedIndexPaths.count, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(diff.movedIndexPaths.count, equalToUnsignedInteger(0));
+}
+
+- (void) testDuplicateIdentifiersPairUpInOrder
+{
+	NSArray *oldIDs = [NSArray arrayWithObjects: @"a", @"b", @"a", nil];
+	NSArray *newIDs = [NSArray arrayWithObjects: @"a", @"a", @"b", nil];
+	
+	AZCoreRecordSectionDiff *diff = [AZCoreRecordSectionDiff diffFromObjectIDs: oldIDs sectionKeys: nil toObjectIDs: newIDs sectionKeys: nil updatedObjectIDs: nil];
+	
+	// The second a moves ahead of b; no old row is used twice
+	assertThat(diff.movedIndexPaths, is(equalTo([NSArray arrayWithObject: move(indexPath(0, 2), indexPath(0, 1))])));
+	assertThatUnsignedInteger(diff.deletedIndexPaths.count, equalToUnsignedInteger(0));
+	assertThatUnsignedInteger(diff.insertedIndexPaths.count, equalToUnsignedInteger(0));
+	
+	AZCoreRecordSectionDiff *added = [AZCoreRecordSectionDiff diffFromObjectIDs: [NSArray arrayWithObject: @"a"] sectionKeys: nil toObjectIDs: [NSArray arrayWithObjects: @"a", @"a", nil] sectionKeys: nil updatedObjectIDs: nil];
+	assertThat(added.insertedIndexPaths, is(equalTo([NSArray arrayWithObject: indexPath(0, 1)])));
+	assertThatUnsignedInteger(added.movedIndexPaths.count, equalToUnsignedInteger(0));
+	
+	AZCoreRecordSectionDiff *removed = [AZCoreRecordSectionDiff diffFromObjectIDs: [NSArray arrayWithObjects: @"a", @"a", nil] sectionKeys: nil toObjectIDs: [NSArray arrayWithObject: @"a"] sectionKeys: nil updatedObjectIDs: nil];
+	assertThat(removed.deletedIndexPaths, is(equalTo([NSArray arrayWithObject: indexPath(0, 1)])));
+	assertThatUnsignedInteger(removed.movedIndexPaths.count, equalToUnsignedInteger(0));
+}
+
+@end
@@ -0,0 +1,111 @@
+//
+//  NSFetchedResultsControllerHelperTests.m
+//  AZCoreRecord Unit Tests
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "NSFetchedResultsControllerHelperTests.h"
+#import "NSFetchedResultsController+AZCoreRecord.h"
+
+@implementation NSFetchedResultsControllerHelperTests
+
+#ifdef __IPHONE_OS_VERSION_MIN_REQUIRED
+
+- (NSFetchRequest *) requestWithPredicate: (NSPredicate *) predicate sortKey: (NSString *) sortKey ascending: (BOOL) ascending
+{
+	NSFetchRequest *request = [NSFetchRequest fetchRequestWithEntityName: @"SingleEntityWithNoRelationships"];
+	request.predicate = predicate;
+	request.sortDescriptors = [NSArray arrayWithObject: [NSSortDescriptor sortDescriptorWithKey: sortKey ascending: ascending]];
+	return request;
+}
+
+- (void) testEquivalentRequestsShareCacheName
+{
+	NSFetchRequest *request = [self requestWithPredicate: [NSPredicate predicateWithFormat: @"int16TestAttribute > %d", 5] sortKey: @"int16TestAttribute" ascending: YES];
+	NSFetchRequest *equivalent = [self requestWithPredicate: [NSPredicate predicateWithFormat: @"int16TestAttribute > %d", 5] sortKey: @"int16TestAttribute" ascending: YES];
+	
+	NSString *name = [NSFetchedResultsController cacheNameForRequest: request groupedBy: @"booleanTestAttribute"];
+	
+	assertThat(name, is(equalTo([NSFetchedResultsController cacheNameForRequest: equivalent groupedBy: @"booleanTestAttribute"])));
+	assertThat(name, is(equalTo([NSFetchedResultsController cacheNameForRequest: [request copy] groupedBy: @"booleanTestAttribute"])));
+}
+
+- (void) testDifferentValuesUseDifferentCacheNames
+{
+	NSPredicate *searchTemplate = [NSPredicate predicateWithFormat: @"mappedStringAttribute BEGINSWITH[cd] $term"];
+	NSFetchRequest *first = [self requestWithPredicate: [searchTemplate predicateWithSubstitutionVariables: [NSDictionary dictionaryWithObject: @"a" forKey: @"term"]] sortKey: @"mappedStringAttribute" ascending: YES];
+	NSFetchRequest *second = [self requestWithPredicate: [searchTemplate predicateWithSubstitutionVariables: [NSDictionary dictionaryWithObject: @"ab" forKey: @"term"]] sortKey: @"mappedStringAttribute" ascending: YES];
+	NSFetchRequest *firstAgain = [self requestWithPredicate: [searchTemplate predicateWithSubstitutionVariables: [NSDictionary dictionaryWithObject: @"a" forKey: @"term"]] sortKey: @"mappedStringAttribute" ascending: YES];
+	
+	NSString *firstName = [NSFetchedResultsController cacheNameForRequest: first groupedBy: nil];
+	assertThat(firstName, isNot(equalTo([NSFetchedResultsController cacheNameForRequest: second groupedBy: nil])));
+	assertThat(firstName, is(equalTo([NSFetchedResultsController cacheNameForRequest: firstAgain groupedBy: nil])));
+	
+	// A number and the string spelling it are different values
+	NSFetchRequest *number = [self requestWithPredicate: [NSPredicate predicateWithFormat: @"mappedStringAttribute == %@", [NSNumber numberWithInt: 1]] sortKey: @"mappedStringAttribute" ascending: YES];
+	NSFetchRequest *string = [self requestWithPredicate: [NSPredicate predicateWithFormat: @"mappedStringAttribute == %@", @"1"] sortKey: @"mappedStringAttribute" ascending: YES];
+	assertThat([NSFetchedResultsController cacheNameForRequest: number groupedBy: nil], isNot(equalTo([NSFetchedResultsController cacheNameForRequest: string groupedBy: nil])));
+	
+	// Sets match whatever order they enumerate in
+	NSFetchRequest *set = [self requestWithPredicate: [NSPredicate predicateWithFormat: @"mappedStringAttribute IN %@", [NSSet setWithObjects: @"a", @"b", @"c", nil]] sortKey: @"mappedStringAttribute" ascending: YES];
+	NSFetchRequest *sameSet = [self requestWithPredicate: [NSPredicate predicateWithFormat: @"mappedStringAttribute IN %@", [NSSet setWithObjects: @"c", @"b", @"a", nil]] sortKey: @"mappedStringAttribute" ascending: YES];
+	assertThat([NSFetchedResultsController cacheNameForRequest: set groupedBy: nil], is(equalTo([NSFetchedResultsController cacheNameForRequest: sameSet groupedBy: nil])));
+}
+
+- (void) testBlockPredicatesShareCacheName
+{
+	// Block predicates describe themselves by address
+	NSPredicate *(^blockPredicate)(void) = ^{
+		return [NSPredicate predicateWithBlock: ^BOOL(id object, NSDictionary *bindings) {
+			return YES;
+		}];
+	};
+	NSFetchRequest *firstBlock = [self requestWithPredicate: blockPredicate() sortKey: @"mappedStringAttribute" ascending: YES];
+	NSFetchRequest *secondBlock = [self requestWithPredicate: blockPredicate() sortKey: @"mappedStringAttribute" ascending: YES];
+	
+	assertThat([NSFetchedResultsController cacheNameForRequest: firstBlock groupedBy: nil], is(equalTo([NSFetchedResultsController cacheNameForRequest: secondBlock groupedBy: nil])));
+}
+
+- (void) testDifferentPredicateShapesUseDifferentCacheNames
+{
+	NSFetchRequest *greater = [self requestWithPredicate: [NSPredicate predicateWithFormat: @"int16TestAttribute > 5"] sortKey: @"int16TestAttribute" ascending: YES];
+	NSFetchRequest *less = [self requestWithPredicate: [NSPredicate predicateWithFormat: @"int16TestAttribute < 5"] sortKey: @"int16TestAttribute" ascending: YES];
+	NSFetchRequest *otherKey = [self requestWithPredicate: [NSPredicate predicateWithFormat: @"int32TestAttribute > 5"] sortKey: @"int16TestAttribute" ascending: YES];
+	NSFetchRequest *unfiltered = [self requestWithPredicate: nil sortKey: @"int16TestAttribute" ascending: YES];
+	
+	NSString *name = [NSFetchedResultsController cacheNameForRequest: greater groupedBy: nil];
+	
+	assertThat(name, isNot(equalTo([NSFetchedResultsController cacheNameForRequest: less groupedBy: nil])));
+	assertThat(name, isNot(equalTo([NSFetchedResultsController cacheNameForRequest: otherKey groupedBy: nil])));
+	assertThat(name, isNot(equalTo([NSFetchedResultsController cacheNameForRequest: unfiltered groupedBy: nil])));
+}
+
+- (void) testDifferentSortOrdersUseDifferentCacheNames
+{
+	NSFetchRequest *ascending = [self requestWithPredicate: nil sortKey: @"int16TestAttribute" ascending: YES];
+	NSFetchRequest *descending = [self requestWithPredicate: nil sortKey: @"int16TestAttribute" ascending: NO];
+	NSFetchRequest *otherKey = [self requestWithPredicate: nil sortKey: @"int32TestAttribute" ascending: YES];
+	
+	NSString *name = [NSFetchedResultsController cacheNameForRequest: ascending groupedBy: nil];
+	
+	assertThat(name, isNot(equalTo([NSFetchedResultsController cacheNameForRequest: descending groupedBy: nil])));
+	assertThat(name, isNot(equalTo([NSFetchedResultsController cacheNameForRequest: otherKey groupedBy: nil])));
+}
+
+- (void) testDifferentSectionKeyPathsUseDifferentCacheNames
+{
+	NSFetchRequest *request = [self requestWithPredicate: nil sortKey: @"int16TestAttribute" ascending: YES];
+	
+	NSString *ungrouped = [NSFetchedResultsController cacheNameForRequest: request groupedBy: nil];
+	NSString *grouped = [NSFetchedResultsController cacheNameForRequest: request groupedBy: @"booleanTestAttribute"];
+	NSString *otherGroup = [NSFetchedResultsController cacheNameForRequest: request groupedBy: @"mappedStringAttribute"];
+	
+	assertThat(ungrouped, isNot(equalTo(grouped)));
+	assertThat(grouped, isNot(equalTo(otherGroup)));
+}
+
+#endif
+
+@end
@@ -61,6 +61,64 @@
     [self waitForStatus:kGHUnitWaitStatusSuccess timeout:1.0];
 }
 
+- (void) testContextForQueueIsStableAcrossThreadHops
+{
+    [self prepare];
+    
+    dispatch_queue_t queue = dispatch_queue_create("AZCoreRecordTestQueue", DISPATCH_QUEUE_SERIAL);
+    __block NSManagedObjectContext *firstContext = nil;
+    
+    dispatch_async(queue, ^{
+        [_localManager performWithContextForQueue: queue block: ^(NSManagedObjectContext *context) {
+            firstContext = context;
+        }];
+    });
+    
+    dispatch_async(queue, ^{
+        NSManagedObjectContext *secondContext = [_localManager contextForQueue: queue];
+        
+        assertThat(firstContext, is(notNilValue()));
+        assertThat(firstContext, is(sameInstance(secondContext)));
+        assertThatInteger(secondContext.concurrencyType, equalToInteger(NSPrivateQueueConcurrencyType));
+        
+        [self notify:kGHUnitWaitStatusSuccess forSelector:@selector(testContextForQueueIsStableAcrossThreadHops)];
+    });
+    
+    [self waitForStatus:kGHUnitWaitStatusSuccess timeout:3.0];
+    dispatch_release(queue);
+}
+
+- (void) testPerformWithQueueContextUsesCallingQueue
+{
+    [self prepare];
+    
+    dispatch_queue_t queue = dispatch_queue_create("AZCoreRecordTestQueue", DISPATCH_QUEUE_SERIAL);
+    
+    dispatch_async(queue, ^{
+        __block NSManagedObjectContext *queueContext = nil;
+        [_localManager performWithQueueContext: ^(NSManagedObjectContext *context) {
+            queueContext = context;
+        }];
+        
+        assertThat(queueContext, is(notNilValue()));
+        assertThat(queueContext, is(sameInstance([_localManager contextForQueue: queue])));
+        
+        [self notify:kGHUnitWaitStatusSuccess forSelector:@selector(testPerformWithQueueContextUsesCallingQueue)];
+    });
+    
+    [self waitForStatus:kGHUnitWaitStatusSuccess timeout:3.0];
+    dispatch_release(queue);
+}
+
+- (void) testContextForQueueRejectsGlobalQueues
+{
+	dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	
+	assertThat([_localManager contextForQueue: queue], is(nilValue()));
+	
+	GHAssertThrowsSpecificNamed([_localManager performWithContextForQueue: queue block: ^(NSManagedObjectContext *context) {}], NSException, NSInvalidArgumentException, nil);
+}
+
 - (void) testCanCreateChildContext
 {
 	NSManagedObjectContext *defaultContext = _localManager.managedObjectContext;
@@ -69,5 +127,107 @@
 	assertThat(childContext.parentContext, is(equalTo(defaultContext)));
 }
 
+- (void) testReusesChildContextsAcrossSaves
+{
+	NSManagedObjectContext *defaultContext = _localManager.managedObjectContext;
+	[defaultContext drainReusableChildContexts];
+	
+	__block NSManagedObjectContext *firstContext = nil;
+	__block NSManagedObjectContext *secondContext = nil;
+	[defaultContext saveDataWithBlock: ^(NSManagedObjectContext *context) {
+		firstContext = context;
+	}];
+	[defaultContext saveDataWithBlock: ^(NSManagedObjectContext *context) {
+		secondContext = context;
+	}];
+	
+	assertThat(firstContext, is(sameInstance(secondContext)));
+	assertThat(firstContext.parentContext, is(equalTo(defaultContext)));
+	
+	NSDictionary *statistics = [defaultContext reusableChildContextStatistics];
+	assertThatUnsignedInteger([[statistics objectForKey: AZCoreRecordContextPoolHitCountKey] unsignedIntegerValue], is(greaterThanOrEqualTo([NSNumber numberWithUnsignedInteger: 1])));
+	assertThatUnsignedInteger([[statistics objectForKey: AZCoreRecordContextPoolAvailableCountKey] unsignedIntegerValue], equalToUnsignedInteger(1));
+}
+
+- (void) testMergeCompletionRunsOnceChangesAreMerged
+{
+	[self prepare];
+	
+	NSManagedObjectContext *context = _localManager.managedObjectContext;
+	NSDictionary *userInfo = [NSDictionary dictionaryWithObject: [NSSet set] forKey: NSUpdatedObjectsKey];
+	NSNotification *notification = [NSNotification notificationWithName: NSManagedObjectContextDidSaveNotification object: nil userInfo: userInfo];
+	
+	[context mergeChangesFromNotification: notification completion: ^{
+		[self notify:kGHUnitWaitStatusSuccess forSelector:@selector(testMergeCompletionRunsOnceChangesAreMerged)];
+	}];
+	
+	[self waitForStatus:kGHUnitWaitStatusSuccess timeout:3.0];
+}
+
+- (NSNotification *) saveNotificationInsertingObjectCount: (NSUInteger) count
+{
+	NSManagedObjectContext *context = [[NSManagedObjectContext alloc] initWithConcurrencyType: NSPrivateQueueConcurrencyType];
+	context.persistentStoreCoordinator = _localManager.persistentStoreCoordinator;
+	
+	__block NSNotification *saveNotification = nil;
+	id observer = [[NSNotificationCenter defaultCenter] addObserverForName: NSManagedObjectContextDidSaveNotification object: context queue: nil usingBlock: ^(NSNotification *note) {
+		saveNotification = note;
+	}];
+	
+	[context performBlockAndWait: ^{
+		for (NSUInteger i = 0; i < count; i++)
+			[NSEntityDescription insertNewObjectForEntityForName: @"SingleEntityWithNoRelationships" inManagedObjectContext: context];
+		[context save: NULL];
+	}];
+	
+	[[NSNotificationCenter defaultCenter] removeObserver: observer];
+	return saveNotification;
+}
+
+- (void) testMergeCompletionsSeeTheirChangesAcrossSlices
+{
+	[self prepare];
+	
+	NSManagedObjectContext *context = _localManager.managedObjectContext;
+	
+	// Well over one 256-object slice, so the merge runs in several
+	NSNotification *firstSave = [self saveNotificationInsertingObjectCount: 700];
+	NSNotification *secondSave = [self saveNotificationInsertingObjectCount: 300];
+	NSSet *firstIDs = [[firstSave.userInfo objectForKey: NSInsertedObjectsKey] valueForKey: @"objectID"];
+	NSSet *secondIDs = [[secondSave.userInfo objectForKey: NSInsertedObjectsKey] valueForKey: @"objectID"];
+	
+	__block BOOL firstDone = NO;
+	__block BOOL firstComplete = NO;
+	__block BOOL secondComplete = NO;
+	__block BOOL secondRanAfterFirst = NO;
+	
+	BOOL (^allRegistered)(NSSet *) = ^BOOL(NSSet *objectIDs) {
+		for (NSManagedObjectID *objectID in objectIDs)
+			if (![context objectRegisteredForID: objectID])
+				return NO;
+		return YES;
+	};
+	
+	[context mergeChangesFromNotification: firstSave completion: ^{
+		firstComplete = allRegistered(firstIDs);
+		firstDone = YES;
+	}];
+	
+	// The second merge arrives from another thread while the first is running
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		[context mergeChangesFromNotification: secondSave completion: ^{
+			secondRanAfterFirst = firstDone;
+			secondComplete = allRegistered(firstIDs) && allRegistered(secondIDs);
+			[self notify:kGHUnitWaitStatusSuccess forSelector:@selector(testMergeCompletionsSeeTheirChangesAcrossSlices)];
+		}];
+	});
+	
+	[self waitForStatus:kGHUnitWaitStatusSuccess timeout:10.0];
+	
+	assertThatUnsignedInteger(firstIDs.count, equalToUnsignedInteger(700));
+	assertThatBool(firstComplete, equalToBool(YES));
+	assertThatBool(secondRanAfterFirst, equalToBool(YES));
+	assertThatBool(secondComplete, equalToBool(YES));
+}
 
 @end
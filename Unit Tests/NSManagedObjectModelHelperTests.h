@@ -0,0 +1,11 @@
+//
+//  NSManagedObjectModelHelperTests.h
+//  AZCoreRecord Unit Tests
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+@interface NSManagedObjectModelHelperTests : GHTestCase
+
+@end
@@ -0,0 +1,79 @@
+//
+//  NSManagedObjectModelHelperTests.m
+//  AZCoreRecord Unit Tests
+//
+//  Created by Zachary Waldowski on 10/19/12.
+//  Copyright 2012 Alexsander Akers & Zachary Waldowski. All rights reserved.
+//
+
+#import "NSManagedObjectModelHelperTests.h"
+#import "NSManagedObjectModel+AZCoreRecord.h"
+
+@implementation NSManagedObjectModelHelperTests
+
+- (void) setUp
+{
+	[NSManagedObjectModel removeCachedModels];
+}
+
+- (void) tearDown
+{
+	[NSManagedObjectModel removeCachedModels];
+}
+
+- (void) testModelWithNameReturnsFreshInstances
+{
+	NSManagedObjectModel *firstModel = [NSManagedObjectModel modelWithName: @"TestModel.momd"];
+	NSManagedObjectModel *secondModel = [NSManagedObjectModel modelWithName: @"TestModel.momd"];
+	
+	assertThat(firstModel, is(notNilValue()));
+	assertThat(firstModel, isNot(sameInstance(secondModel)));
+	assertThat(firstModel, isNot(sameInstance([NSManagedObjectModel cachedModelWithName: @"TestModel.momd"])));
+}
+
+- (void) testCachedModelIsShared
+{
+	NSManagedObjectModel *firstModel = [NSManagedObjectModel cachedModelWithName: @"TestModel.momd"];
+	NSManagedObjectModel *secondModel = [NSManagedObjectModel cachedModelWithName: @"TestModel.momd"];
+	
+	assertThat(firstModel, is(notNilValue()));
+	assertThat(firstModel, is(sameInstance(secondModel)));
+	
+	[NSManagedObjectModel removeCachedModels];
+	
+	assertThat([NSManagedObjectModel cachedModelWithName: @"TestModel.momd"], isNot(sameInstance(firstModel)));
+}
+
+- (void) testCacheEvictsLeastRecentlyUsedModel
+{
+	NSFileManager *fileManager = [NSFileManager new];
+	NSURL *modelURL = [[NSManagedObjectModel modelVersionURLsInBundle: [NSBundle mainBundle]] lastObject];
+	NSString *directoryName = [[NSProcessInfo processInfo] globallyUniqueString];
+	NSURL *directoryURL = [NSURL fileURLWithPath: [NSTemporaryDirectory() stringByAppendingPathComponent: directoryName] isDirectory: YES];
+	[fileManager createDirectoryAtURL: directoryURL withIntermediateDirectories: YES attributes: nil error: NULL];
+	
+	NSMutableArray *URLs = [NSMutableArray array];
+	for (NSUInteger i = 0; i < 9; i++)
+	{
+		NSURL *URL = [directoryURL URLByAppendingPathComponent: [NSString stringWithFormat: @"Model%lu.mom", (unsigned long) i]];
+		[fileManager copyItemAtURL: modelURL toURL: URL error: NULL];
+		[URLs addObject: URL];
+	}
+	
+	NSManagedObjectModel *firstModel = [NSManagedObjectModel cachedModelWithContentsOfURL: [URLs objectAtIndex: 0]];
+	NSManagedObjectModel *secondModel = [NSManagedObjectModel cachedModelWithContentsOfURL: [URLs objectAtIndex: 1]];
+	
+	// Touching the first model again leaves the second as the oldest
+	for (NSURL *URL in [URLs subarrayWithRange: NSMakeRange(2, 7)])
+	{
+		[NSManagedObjectModel cachedModelWithContentsOfURL: [URLs objectAtIndex: 0]];
+		[NSManagedObjectModel cachedModelWithContentsOfURL: URL];
+	}
+	
+	assertThat([NSManagedObjectModel cachedModelWithContentsOfURL: [URLs objectAtIndex: 0]], is(sameInstance(firstModel)));
+	assertThat([NSManagedObjectModel cachedModelWithContentsOfURL: [URLs objectAtIndex: 1]], isNot(sameInstance(secondModel)));
+	
+	[fileManager removeItemAtURL: directoryURL error: NULL];
+}
+
+@end
@@ -9,6 +9,58 @@
 
 #import "NSPersistentStoreCoordinatorHelperTests.h"
 #import "AZCoreRecordManager.h"
+#import "NSPersistentStoreCoordinator+AZCoreRecord.h"
+
+static NSRelationshipDescription *azcr_testRelationship(NSString *name, NSEntityDescription *destination, BOOL toMany)
+{
+	NSRelationshipDescription *relationship = [NSRelationshipDescription new];
+	relationship.name = name;
+	relationship.destinationEntity = destination;
+	relationship.optional = YES;
+	relationship.minCount = 0;
+	relationship.maxCount = toMany ? 0 : 1;
+	relationship.deleteRule = NSNullifyDeleteRule;
+	return relationship;
+}
+
+static NSEntityDescription *azcr_testEntity(NSString *name)
+{
+	NSAttributeDescription *attribute = [NSAttributeDescription new];
+	attribute.name = @"name";
+	attribute.attributeType = NSStringAttributeType;
+	attribute.optional = YES;
+	
+	NSEntityDescription *entity = [NSEntityDescription new];
+	entity.name = name;
+	entity.managedObjectClassName = NSStringFromClass([NSManagedObject class]);
+	entity.properties = [NSArray arrayWithObject: attribute];
+	return entity;
+}
+
+// Author <->> Book covers a to-one/to-many pair, Book <<->> Tag a many-to-many one
+static NSManagedObjectModel *azcr_seedingTestModel(void)
+{
+	NSEntityDescription *author = azcr_testEntity(@"Author");
+	NSEntityDescription *book = azcr_testEntity(@"Book");
+	NSEntityDescription *tag = azcr_testEntity(@"Tag");
+	
+	NSRelationshipDescription *authorBooks = azcr_testRelationship(@"books", book, YES);
+	NSRelationshipDescription *bookAuthor = azcr_testRelationship(@"author", author, NO);
+	NSRelationshipDescription *bookTags = azcr_testRelationship(@"tags", tag, YES);
+	NSRelationshipDescription *tagBooks = azcr_testRelationship(@"books", book, YES);
+	authorBooks.inverseRelationship = bookAuthor;
+	bookAuthor.inverseRelationship = authorBooks;
+	bookTags.inverseRelationship = tagBooks;
+	tagBooks.inverseRelationship = bookTags;
+	
+	author.properties = [author.properties arrayByAddingObject: authorBooks];
+	book.properties = [book.properties arrayByAddingObjectsFromArray: [NSArray arrayWithObjects: bookAuthor, bookTags, nil]];
+	tag.properties = [tag.properties arrayByAddingObject: tagBooks];
+	
+	NSManagedObjectModel *model = [NSManagedObjectModel new];
+	model.entities = [NSArray arrayWithObjects: author, book, tag, nil];
+	return model;
+}
 
 @implementation NSPersistentStoreCoordinatorHelperTests {
     AZCoreRecordManager *_localManager;
@@ -53,4 +105,81 @@
     assertThatUnsignedInteger(storeIndex, isNot(equalToInteger(NSNotFound)));
 }
 
+- (void) testPagedSeedingCopiesBothSidesOfRelationships
+{
+	[self prepare];
+	
+	NSManagedObjectModel *model = azcr_seedingTestModel();
+	NSString *directory = [NSTemporaryDirectory() stringByAppendingPathComponent: [[NSProcessInfo processInfo] globallyUniqueString]];
+	[[NSFileManager defaultManager] createDirectoryAtPath: directory withIntermediateDirectories: YES attributes: nil error: NULL];
+	NSURL *sourceURL = [NSURL fileURLWithPath: [directory stringByAppendingPathComponent: @"Source.sqlite"]];
+	
+	NSPersistentStoreCoordinator *sourceCoordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: model];
+	[sourceCoordinator addStoreAtURL: sourceURL configuration: nil options: nil];
+	
+	NSManagedObjectContext *sourceContext = [NSManagedObjectContext new];
+	sourceContext.persistentStoreCoordinator = sourceCoordinator;
+	
+	NSManagedObject *author = [NSEntityDescription insertNewObjectForEntityForName: @"Author" inManagedObjectContext: sourceContext];
+	[author setValue: @"Author" forKey: @"name"];
+	NSManagedObject *fiction = [NSEntityDescription insertNewObjectForEntityForName: @"Tag" inManagedObjectContext: sourceContext];
+	[fiction setValue: @"Fiction" forKey: @"name"];
+	NSManagedObject *classic = [NSEntityDescription insertNewObjectForEntityForName: @"Tag" inManagedObjectContext: sourceContext];
+	[classic setValue: @"Classic" forKey: @"name"];
+	
+	for (NSString *title in [NSArray arrayWithObjects: @"First", @"Second", @"Third", nil])
+	{
+		NSManagedObject *book = [NSEntityDescription insertNewObjectForEntityForName: @"Book" inManagedObjectContext: sourceContext];
+		[book setValue: title forKey: @"name"];
+		[book setValue: author forKey: @"author"];
+		[book setValue: [title isEqualToString: @"Second"] ? [NSSet setWithObject: fiction] : [NSSet setWithObjects: fiction, classic, nil] forKey: @"tags"];
+	}
+	
+	assertThatBool([sourceContext save: NULL], equalToBool(YES));
+	sourceContext = nil;
+	[sourceCoordinator removePersistentStore: sourceCoordinator.persistentStores.lastObject error: NULL];
+	
+	NSPersistentStoreCoordinator *coordinator = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel: model];
+	[coordinator addInMemoryStore];
+	
+	__block BOOL seeded = NO;
+	[coordinator seedWithPersistentStoreAtURL: sourceURL pageSize: 1 progress: nil completion: ^(BOOL success) {
+		seeded = success;
+		[self notify: kGHUnitWaitStatusSuccess forSelector: @selector(testPagedSeedingCopiesBothSidesOfRelationships)];
+	}];
+	
+	[self waitForStatus: kGHUnitWaitStatusSuccess timeout: 5.0];
+	assertThatBool(seeded, equalToBool(YES));
+	
+	NSManagedObjectContext *context = [NSManagedObjectContext new];
+	context.persistentStoreCoordinator = coordinator;
+	
+	NSArray *authors = [context executeFetchRequest: [NSFetchRequest fetchRequestWithEntityName: @"Author"] error: NULL];
+	NSArray *books = [context executeFetchRequest: [NSFetchRequest fetchRequestWithEntityName: @"Book"] error: NULL];
+	NSArray *tags = [context executeFetchRequest: [NSFetchRequest fetchRequestWithEntityName: @"Tag"] error: NULL];
+	
+	assertThatUnsignedInteger(authors.count, equalToUnsignedInteger(1));
+	assertThatUnsignedInteger(books.count, equalToUnsignedInteger(3));
+	assertThatUnsignedInteger(tags.count, equalToUnsignedInteger(2));
+	
+	NSManagedObject *newAuthor = authors.lastObject;
+	assertThat([newAuthor valueForKeyPath: @"books.name"], is(equalTo([NSSet setWithObjects: @"First", @"Second", @"Third", nil])));
+	
+	for (NSManagedObject *book in books)
+	{
+		assertThat([book valueForKey: @"author"], is(sameInstance(newAuthor)));
+		
+		NSSet *expectedTags = [[book valueForKey: @"name"] isEqualToString: @"Second"] ? [NSSet setWithObject: @"Fiction"] : [NSSet setWithObjects: @"Fiction", @"Classic", nil];
+		assertThat([book valueForKeyPath: @"tags.name"], is(equalTo(expectedTags)));
+	}
+	
+	for (NSManagedObject *tag in tags)
+	{
+		NSSet *expectedBooks = [[tag valueForKey: @"name"] isEqualToString: @"Fiction"] ? [NSSet setWithObjects: @"First", @"Second", @"Third", nil] : [NSSet setWithObjects: @"First", @"Third", nil];
+		assertThat([tag valueForKeyPath: @"books.name"], is(equalTo(expectedBooks)));
+	}
+	
+	[[NSFileManager defaultManager] removeItemAtPath: directory error: NULL];
+}
+
 @end